@@ -8,6 +8,7 @@
 #include "absorber.h"
 #include "vector3D.h"
 #include "logger.h"
+#include "lockWait.h"
 
 
 
@@ -48,7 +49,7 @@ void Absorber::InitCommon(void)
 
 void Absorber::updateAbsorbedWeight(const double absorbed)
 {
-    boost::mutex::scoped_lock lock(m_mutex);
+    TimedLock lock(m_mutex);
     this->absorbedWeight += absorbed;
 }
 
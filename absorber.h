@@ -32,6 +32,12 @@ public:
     virtual bool crossedAbsorber(const boost::shared_ptr<Vector3d> currPoint, 
                                  const boost::shared_ptr<Vector3d> prevPoint) = 0;
     
+    // Return the shortest distance from 'point' to the surface of the absorber.
+    // Used when building the feature distance map of the medium.  The default
+    // of zero is conservative, it simply marks every location as being close
+    // to the absorber.
+    virtual double distanceToAbsorber(const coords &point) {return 0.0;}
+    
 
     double getAbsorberAbsorptionCoeff(void) {return this->mu_a;}
     double getAbsorberScatteringCoeff(void) {return this->mu_s;}
@@ -43,6 +49,12 @@ public:
     // Update absorber weight.
     void updateAbsorbedWeight(const double absorbed);
     
+    // Return the weight absorbed by this absorber so far.
+    double getAbsorbedWeight(void) {return absorbedWeight;}
+    
+    // Overwrite the absorbed weight, e.g. when restoring a checkpoint.
+    void setAbsorbedWeight(const double weight) {absorbedWeight = weight;}
+    
     // Write the absorber data out to file to be used in post-processing.
     void writeData(void);
     
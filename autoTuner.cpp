@@ -0,0 +1,237 @@
+//
+//  autoTuner.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "autoTuner.h"
+#include "cpuTopology.h"
+#include "workerPool.h"
+#include "numaRun.h"
+#include "photon.h"
+#include "timer.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+using std::cout;
+using std::endl;
+
+
+// Chunk size of the thread comparison, and the alternatives tried afterwards.  All
+// are whole seed blocks, so they propagate the same photons.
+static const unsigned long DEFAULT_CHUNK_SIZE = Photon::SEED_BLOCK;
+static const unsigned long CHUNK_SIZES[] = {2 * Photon::SEED_BLOCK, 4 * Photon::SEED_BLOCK};
+
+// Fractions of the cores tried besides one worker per core, for scenes where fewer
+// workers saturate the memory bandwidth.
+static const int CORE_DIVISORS[] = {1, 2, 4};
+
+// A later candidate has to beat the best so far by this factor, so timing noise of
+// the short calibration runs does not flip the choice between equal candidates.
+static const double MIN_GAIN = 1.02;
+
+
+
+AutoTuner::AutoTuner(const SceneDescription &description, const std::string &cache_file)
+: description(description), cache_file(cache_file)
+{
+    calibration_photons = 4000;
+    verbose = false;
+    cached = false;
+}
+
+
+std::string AutoTuner::getCpuModel(void)
+{
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+        if (line.compare(0, 10, "model name") != 0)
+            continue;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            break;
+        size_t start = line.find_first_not_of(" \t", colon + 1);
+        return start == std::string::npos ? "unknown" : line.substr(start);
+    }
+    return "unknown";
+}
+
+
+std::string AutoTuner::getKey(void) const
+{
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)description.hash());
+    std::ostringstream key;
+    key << hash << "\t" << getCpuModel() << " x" << CpuTopology::detect().getNumCpus();
+    return key.str();
+}
+
+
+void AutoTuner::writeChoice(std::ostream &output, const Choice &choice)
+{
+    output << choice.threads << " threads" << (choice.use_smt ? " (SMT)" : "")
+           << (choice.pinned ? ", bound, scene per node" : ", unbound, shared scene")
+           << ", chunks of " << choice.chunk_size;
+    if (choice.photons_per_second > 0)
+        output << ": " << (unsigned long)choice.photons_per_second << " photons/s";
+}
+
+
+WorkerPool * AutoTuner::createPool(const Choice &choice)
+{
+    if (choice.pinned)
+        return new WorkerPool(CpuTopology::detect().place(choice.threads, choice.use_smt));
+    return new WorkerPool(choice.threads);
+}
+
+
+void AutoTuner::measure(Choice &choice)
+{
+    unsigned long photons = std::max(calibration_photons, 2 * choice.chunk_size * choice.threads);
+    WorkerPool *pool = createPool(choice);
+    {
+        NumaRun run(*pool, description, choice.chunk_size, 1, choice.pinned);
+        double start = getWallTime();
+        run.run(photons);
+        choice.photons_per_second = photons / std::max(getWallTime() - start, 1e-9);
+    }
+    delete pool;
+
+    if (verbose)
+    {
+        cout << "  ";
+        writeChoice(cout, choice);
+        cout << endl;
+    }
+}
+
+
+AutoTuner::Choice AutoTuner::tune(const bool recalibrate)
+{
+    Choice best;
+    cached = !recalibrate && readCache(best);
+    if (cached)
+        return best;
+
+    CpuTopology topology = CpuTopology::detect();
+    std::vector<std::pair<int, bool> > thread_counts;
+    for (size_t i = 0; i < sizeof(CORE_DIVISORS) / sizeof(CORE_DIVISORS[0]); i++)
+    {
+        int threads = topology.getNumCores() / CORE_DIVISORS[i];
+        if (threads >= 1 && (i == 0 || threads < thread_counts.back().first))
+            thread_counts.push_back(std::make_pair(threads, false));
+    }
+    if (topology.getNumCpus() > topology.getNumCores())
+        thread_counts.push_back(std::make_pair(topology.getNumCpus(), true));
+
+    std::vector<Choice> candidates;
+    for (size_t i = 0; i < thread_counts.size(); i++)
+    {
+        for (int pinned = 1; pinned >= 0; pinned--)
+        {
+            Choice choice;
+            choice.threads = thread_counts[i].first;
+            choice.use_smt = thread_counts[i].second;
+            choice.pinned = pinned;
+            choice.chunk_size = DEFAULT_CHUNK_SIZE;
+            choice.photons_per_second = 0;
+            candidates.push_back(choice);
+        }
+    }
+
+    // Warm up the caches and the allocator before anything is timed.
+    Choice warm_up = candidates[0];
+    bool was_verbose = verbose;
+    verbose = false;
+    measure(warm_up);
+    verbose = was_verbose;
+
+    best = candidates[0];
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        measure(candidates[i]);
+        if (i == 0 || candidates[i].photons_per_second > MIN_GAIN * best.photons_per_second)
+            best = candidates[i];
+    }
+
+    Choice threads_best = best;
+    for (size_t i = 0; i < sizeof(CHUNK_SIZES) / sizeof(CHUNK_SIZES[0]); i++)
+    {
+        Choice choice = threads_best;
+        choice.chunk_size = CHUNK_SIZES[i];
+        measure(choice);
+        if (choice.photons_per_second > MIN_GAIN * best.photons_per_second)
+            best = choice;
+    }
+
+    writeCache(best);
+    return best;
+}
+
+
+// The cache holds one line per key: the scene hash and the machine, separated by a
+// tab, and after another tab the threads, SMT and binding flags, chunk size and rate.
+bool AutoTuner::readCache(Choice &choice) const
+{
+    std::ifstream input(cache_file.c_str());
+    std::string key = getKey() + "\t";
+    std::string line;
+    while (std::getline(input, line))
+    {
+        if (line.compare(0, key.size(), key) != 0)
+            continue;
+        std::istringstream values(line.substr(key.size()));
+        int use_smt, pinned;
+        if (values >> choice.threads >> use_smt >> pinned >> choice.chunk_size >> choice.photons_per_second &&
+            choice.threads > 0 && choice.chunk_size > 0)
+        {
+            choice.use_smt = use_smt != 0;
+            choice.pinned = pinned != 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool AutoTuner::writeCache(const Choice &choice) const
+{
+    // Keep the entries of other scenes and machines, and replace the file atomically
+    // since several processes may share it.
+    std::string key = getKey() + "\t";
+    std::vector<std::string> lines;
+    {
+        std::ifstream input(cache_file.c_str());
+        std::string line;
+        while (std::getline(input, line))
+            if (line.compare(0, key.size(), key) != 0)
+                lines.push_back(line);
+    }
+
+    std::ostringstream entry;
+    entry << key << choice.threads << " " << choice.use_smt << " " << choice.pinned << " "
+          << choice.chunk_size << " " << choice.photons_per_second;
+    lines.push_back(entry.str());
+
+    // The temporary file is unique to this process, also among hosts sharing the file.
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    std::ostringstream temp_name;
+    temp_name << cache_file << "." << host << "." << getpid() << ".tmp";
+    std::string temp_file = temp_name.str();
+    std::ofstream output(temp_file.c_str());
+    for (size_t i = 0; i < lines.size(); i++)
+        output << lines[i] << "\n";
+    output.close();
+    if (output.fail() || rename(temp_file.c_str(), cache_file.c_str()) != 0)
+    {
+        cout << "Error: could not write tuning cache " << cache_file << endl;
+        remove(temp_file.c_str());
+        return false;
+    }
+    return true;
+}
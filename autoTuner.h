@@ -0,0 +1,85 @@
+//
+//  autoTuner.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Picks the fastest run configuration for a scene on this machine.  A short
+// calibration propagates a few thousand photons of the scene with each candidate and
+// keeps the one with the highest photon rate.  The candidates cover what varies
+// between machines here: the number of workers (one per core, fewer for scenes bound
+// by memory bandwidth, or one per logical CPU to use SMT), whether workers are bound
+// to CPUs with a scene replica per NUMA node (see numaRun.h) or share one unbound
+// scene, and the chunk size of the work queue.  The thread configurations are
+// compared first with the default chunk size, and the chunk sizes then with the best
+// of those.  Chunk sizes are multiples of Photon::SEED_BLOCK, so the choice does not
+// change the photons of a seeded run.
+//
+// The choice is cached in a text file under the key (scene hash, CPU model, number of
+// CPUs), so every node type of a heterogeneous cluster calibrates once per scene.
+// Calibration only compares speed; every candidate propagates the same physics.
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include "scene.h"
+#include <string>
+#include <vector>
+#include <iostream>
+
+class WorkerPool;
+
+
+class AutoTuner
+{
+public:
+    struct Choice
+    {
+        int threads;
+        bool use_smt;
+        bool pinned;                // bound workers with a replica per node
+        unsigned long chunk_size;
+        double photons_per_second;  // measured during calibration
+    };
+
+    AutoTuner(const SceneDescription &description, const std::string &cache_file);
+
+    // Photons per candidate during calibration (default 4000).  Each candidate runs
+    // at least two chunks per worker.
+    void    setCalibrationPhotons(const unsigned long photons) {calibration_photons = photons;}
+
+    // Print every candidate as it is measured.
+    void    setVerbose(const bool verbose) {this->verbose = verbose;}
+
+    // Return the cached choice for this scene and machine, or calibrate and cache it.
+    // With 'recalibrate' the cache is ignored and overwritten.
+    Choice  tune(const bool recalibrate);
+
+    // Whether the last tune() came from the cache.
+    bool    fromCache(void) const {return cached;}
+
+    // Create a worker pool configured as 'choice'.  Delete it when done.
+    static WorkerPool * createPool(const Choice &choice);
+
+    // Model name of the CPU, as reported by /proc/cpuinfo.
+    static std::string getCpuModel(void);
+
+    static void writeChoice(std::ostream &output, const Choice &choice);
+
+private:
+    // Propagate the calibration photons with 'choice' and store the rate in it.
+    void    measure(Choice &choice);
+
+    // Cache key of the scene and this machine.
+    std::string getKey(void) const;
+
+    bool    readCache(Choice &choice) const;
+    bool    writeCache(const Choice &choice) const;
+
+    SceneDescription description;
+    std::string cache_file;
+    unsigned long calibration_photons;
+    bool verbose;
+    bool cached;
+};
+
+#endif // AUTOTUNER_H
@@ -0,0 +1,151 @@
+//
+//  batchStatistics.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "batchStatistics.h"
+#include <stdint.h>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+
+
+BatchStatistics::BatchStatistics(const int num_bins)
+{
+    resize(num_bins);
+}
+
+
+void BatchStatistics::resize(const int num_bins)
+{
+    sum.resize(num_bins);
+    sum_sq.resize(num_bins);
+    clear();
+}
+
+
+void BatchStatistics::clear(void)
+{
+    std::fill(sum.begin(), sum.end(), 0.0);
+    std::fill(sum_sq.begin(), sum_sq.end(), 0.0);
+    num_batches = 0;
+    num_photons = 0;
+}
+
+
+void BatchStatistics::addBatch(const double *values, const unsigned long photons)
+{
+    if (photons == 0)
+        return;
+
+    for (size_t i = 0; i < sum.size(); i++)
+    {
+        sum[i] += values[i];
+        sum_sq[i] += values[i] * values[i] / photons;
+    }
+    num_batches++;
+    num_photons += photons;
+}
+
+
+void BatchStatistics::merge(const BatchStatistics &other)
+{
+    assert(other.sum.size() == sum.size());
+
+    for (size_t i = 0; i < sum.size(); i++)
+    {
+        sum[i] += other.sum[i];
+        sum_sq[i] += other.sum_sq[i];
+    }
+    num_batches += other.num_batches;
+    num_photons += other.num_photons;
+}
+
+
+void BatchStatistics::write(std::ostream &output) const
+{
+    output << num_batches << " " << num_photons << " " << sum.size() << "\n";
+    for (size_t i = 0; i < sum.size(); i++)
+        output << sum[i] << (i == sum.size()-1 ? "\n" : " ");
+    for (size_t i = 0; i < sum_sq.size(); i++)
+        output << sum_sq[i] << (i == sum_sq.size()-1 ? "\n" : " ");
+}
+
+
+bool BatchStatistics::read(std::istream &input)
+{
+    size_t num_bins;
+    if (!(input >> num_batches >> num_photons >> num_bins))
+        return false;
+
+    sum.resize(num_bins);
+    sum_sq.resize(num_bins);
+    for (size_t i = 0; i < num_bins; i++)
+        input >> sum[i];
+    for (size_t i = 0; i < num_bins; i++)
+        input >> sum_sq[i];
+
+    return !input.fail();
+}
+
+
+void BatchStatistics::writeBinary(std::ostream &output) const
+{
+    uint64_t batches = num_batches;
+    uint64_t photons = num_photons;
+    uint32_t bins = sum.size();
+    output.write((const char *)&batches, sizeof(batches));
+    output.write((const char *)&photons, sizeof(photons));
+    output.write((const char *)&bins, sizeof(bins));
+    if (bins > 0)
+    {
+        output.write((const char *)&sum[0], bins * sizeof(double));
+        output.write((const char *)&sum_sq[0], bins * sizeof(double));
+    }
+}
+
+
+bool BatchStatistics::readBinary(std::istream &input)
+{
+    uint64_t batches = 0, photons = 0;
+    uint32_t bins = 0;
+    input.read((char *)&batches, sizeof(batches));
+    input.read((char *)&photons, sizeof(photons));
+    input.read((char *)&bins, sizeof(bins));
+    if (input.fail())
+        return false;
+
+    num_batches = batches;
+    num_photons = photons;
+    sum.resize(bins);
+    sum_sq.resize(bins);
+    if (bins > 0)
+    {
+        input.read((char *)&sum[0], bins * sizeof(double));
+        input.read((char *)&sum_sq[0], bins * sizeof(double));
+    }
+    return !input.fail();
+}
+
+
+double BatchStatistics::getMean(const int bin) const
+{
+    return num_photons > 0 ? sum[bin] / num_photons : 0.0;
+}
+
+
+// With batch means x_b = s_b/n_b weighted by their size, the variance of a single
+// photon is estimated by sum(n_b (x_b - mean)^2) / (B-1) = (sum(s_b^2/n_b) - N mean^2) / (B-1),
+// and the standard error of the mean over N photons follows by dividing by N.
+double BatchStatistics::getStdError(const int bin) const
+{
+    if (num_batches < 2)
+        return 0.0;
+
+    double N = num_photons;
+    double mean = sum[bin] / N;
+    double variance = (sum_sq[bin] - N * mean * mean) / (num_batches - 1);
+    return variance > 0 ? sqrt(variance / N) : 0.0;
+}
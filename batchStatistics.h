@@ -0,0 +1,64 @@
+//
+//  batchStatistics.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Batch-means statistics of a set of tally bins.  The photons of a run are divided
+// in batches; for every bin the sum of the batch totals and the sum of their squares
+// (divided by the batch size, so batches need not be equally large) give the mean
+// per photon and its standard error.  Each thread keeps its own copy, which is
+// merged into the tally of the medium once its photons are done.
+#ifndef BATCHSTATISTICS_H
+#define BATCHSTATISTICS_H
+
+#include <vector>
+#include <iostream>
+
+
+class BatchStatistics
+{
+public:
+    BatchStatistics(const int num_bins = 0);
+
+    // Change the number of bins.  Clears the statistics.
+    void    resize(const int num_bins);
+
+    // Add a batch of 'photons' photons, with 'values[num_bins]' the tally totals of
+    // those photons only.
+    void    addBatch(const double *values, const unsigned long photons);
+
+    // Add the batches of 'other', which must have the same number of bins.
+    void    merge(const BatchStatistics &other);
+
+    void    clear(void);
+
+    // Text form used by the tally files: the number of batches, photons and bins on
+    // one line, followed by a line of sums and a line of sums of squares.
+    void    write(std::ostream &output) const;
+    bool    read(std::istream &input);
+
+    // Binary form (native byte order) used by checkpoints and partial tallies:
+    // uint64 batches, uint64 photons, uint32 bins, double[bins] sums, double[bins] squares.
+    void    writeBinary(std::ostream &output) const;
+    bool    readBinary(std::istream &input);
+
+    int             getNumBins(void) const {return (int)sum.size();}
+    unsigned long   getNumBatches(void) const {return num_batches;}
+    unsigned long   getNumPhotons(void) const {return num_photons;}
+
+    // Mean of a bin per photon, and the standard error of that mean.  The error is
+    // zero with fewer than two batches.
+    double  getMean(const int bin) const;
+    double  getStdError(const int bin) const;
+
+private:
+    // Per bin sum of the batch totals 's', and of s^2/n with 'n' the batch size.
+    std::vector<double> sum;
+    std::vector<double> sum_sq;
+
+    unsigned long num_batches;
+    unsigned long num_photons;
+};
+
+#endif // BATCHSTATISTICS_H
@@ -0,0 +1,221 @@
+//
+//  beamConvolution.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "beamConvolution.h"
+#include "radialTally.h"
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#define PI 3.141592653589793238462643383
+
+// Number of quadrature points for the azimuthal integral over [0, pi].
+static const int NUM_PHI = 64;
+
+// Minimum number of quadrature points for the radial integral over the beam.
+static const int MIN_NUM_RHO = 64;
+
+
+
+GaussianBeam::GaussianBeam(const double radius)
+{
+    this->radius = radius;
+}
+
+double GaussianBeam::irradiance(const double rho) const
+{
+    return 2.0/(PI*radius*radius) * exp(-2.0*rho*rho/(radius*radius));
+}
+
+
+
+FlatTopBeam::FlatTopBeam(const double radius)
+{
+    this->radius = radius;
+}
+
+double FlatTopBeam::irradiance(const double rho) const
+{
+    return rho <= radius ? 1.0/(PI*radius*radius) : 0.0;
+}
+
+
+
+TabulatedBeam::TabulatedBeam(const std::vector<double> &rho, const std::vector<double> &values)
+{
+    this->rho = rho;
+    this->values = values;
+
+    // Normalize to unit power, i.e. the integral of 2*pi*rho*irradiance, using the
+    // trapezoidal rule.
+    double power = 0.0;
+    for (size_t i = 1; i < rho.size(); i++)
+    {
+        power += PI * (rho[i] - rho[i-1]) * (rho[i]*values[i] + rho[i-1]*values[i-1]);
+    }
+    if (power > 0.0)
+    {
+        for (size_t i = 0; i < this->values.size(); i++)
+            this->values[i] /= power;
+    }
+}
+
+double TabulatedBeam::irradiance(const double r) const
+{
+    if (r <= rho.front())
+        return values.front();
+    if (r >= rho.back())
+        return 0.0;
+
+    size_t i = 1;
+    while (rho[i] < r)
+        i++;
+
+    double t = (r - rho[i-1]) / (rho[i] - rho[i-1]);
+    return values[i-1] + t*(values[i] - values[i-1]);
+}
+
+TabulatedBeam * TabulatedBeam::read(const std::string &filename)
+{
+    std::ifstream input(filename.c_str());
+    if (!input.is_open())
+        return NULL;
+
+    std::vector<double> rho, values;
+    double r, v;
+    while (input >> r >> v)
+    {
+        rho.push_back(r);
+        values.push_back(v);
+    }
+
+    if (rho.size() < 2)
+        return NULL;
+
+    return new TabulatedBeam(rho, values);
+}
+
+
+
+// Linearly interpolate the pencil-beam response between bin centers.  The last bin
+// collects all weight beyond the grid and is not a density, so the response is taken
+// as zero past the center of the second to last bin.
+static double interpolatePencil(const std::vector<double> &pencil, const double dr, const double r)
+{
+    double x = r/dr - 0.5;
+    if (x <= 0.0)
+        return pencil[0];
+
+    int i = (int)x;
+    if (i + 1 >= (int)pencil.size() - 1)
+        return 0.0;
+
+    double t = x - i;
+    return pencil[i] + t*(pencil[i+1] - pencil[i]);
+}
+
+
+// The response at distance 'r' from the beam axis is the integral over the beam of
+// the irradiance at 'rho' times the pencil-beam response at the distance between the
+// two points:
+//     R_beam(r) = int_0^inf S(rho) rho int_0^2pi R_pencil(sqrt(r^2 + rho^2 - 2 r rho cos(phi))) dphi drho
+// Both integrals are evaluated with the midpoint rule, using the symmetry in 'phi'.
+std::vector<double> BeamConvolution::convolve(const std::vector<double> &pencil, const double dr,
+                                              const BeamProfile &beam)
+{
+    double extent = beam.getExtent();
+    int num_rho = (int)(4.0*extent/dr);
+    if (num_rho < MIN_NUM_RHO)
+        num_rho = MIN_NUM_RHO;
+    double drho = extent / num_rho;
+    double dphi = PI / NUM_PHI;
+
+    // Precompute the beam weights and the cosines since they are the same for every 'r'.
+    std::vector<double> rho_weight(num_rho);
+    for (int j = 0; j < num_rho; j++)
+    {
+        double rho = (j + 0.5)*drho;
+        rho_weight[j] = 2.0 * beam.irradiance(rho) * rho * drho * dphi;
+    }
+    std::vector<double> cos_phi(NUM_PHI);
+    for (int k = 0; k < NUM_PHI; k++)
+        cos_phi[k] = cos((k + 0.5)*dphi);
+
+    std::vector<double> result(pencil.size(), 0.0);
+    for (size_t i = 0; i < pencil.size(); i++)
+    {
+        double r = (i + 0.5)*dr;
+        double sum = 0.0;
+        for (int j = 0; j < num_rho; j++)
+        {
+            if (rho_weight[j] == 0.0)
+                continue;
+
+            double rho = (j + 0.5)*drho;
+            double ring = 0.0;
+            for (int k = 0; k < NUM_PHI; k++)
+            {
+                double dist2 = r*r + rho*rho - 2.0*r*rho*cos_phi[k];
+                ring += interpolatePencil(pencil, dr, sqrt(dist2 > 0.0 ? dist2 : 0.0));
+            }
+            sum += rho_weight[j] * ring;
+        }
+        result[i] = sum;
+    }
+
+    return result;
+}
+
+
+bool BeamConvolution::writeConvolved(const RadialTally &tally, const BeamProfile &beam,
+                                     const std::string &filename)
+{
+    std::ofstream output(filename.c_str());
+    if (!output.is_open())
+        return false;
+
+    int num_r = tally.getNumRadialBins();
+    int num_z = tally.getNumDepthBins();
+    double dr = tally.getRadialBinSize();
+
+    std::vector<double> R = convolve(tally.getReflectance(), dr, beam);
+    std::vector<double> T = convolve(tally.getTransmittance(), dr, beam);
+
+    // Convolve each depth of the absorption separately.
+    std::vector<double> A_pencil = tally.getAbsorption();
+    std::vector<double> A(num_r * num_z);
+    std::vector<double> column(num_r);
+    for (int iz = 0; iz < num_z; iz++)
+    {
+        for (int ir = 0; ir < num_r; ir++)
+            column[ir] = A_pencil[ir*num_z + iz];
+
+        std::vector<double> convolved = convolve(column, dr, beam);
+        for (int ir = 0; ir < num_r; ir++)
+            A[ir*num_z + iz] = convolved[ir];
+    }
+
+    // First block: r [cm], R(r) [1/cm^2], T(r) [1/cm^2].
+    // Second block: A(r,z) [1/cm^3], one row per radial bin and one column per depth bin.
+    output << "# r [cm] \t R [1/cm2] \t T [1/cm2]\n";
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        output << std::fixed << std::setprecision(5) << tally.getRadius(ir) << "\t";
+        output << std::scientific << std::setprecision(4) << R[ir] << "\t" << T[ir] << "\n";
+    }
+    output << "\n# A(r,z) [1/cm3]\n";
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        for (int iz = 0; iz < num_z; iz++)
+            output << A[ir*num_z + iz] << (iz == num_z-1 ? "\n" : "\t");
+    }
+
+    output.close();
+    return true;
+}
@@ -0,0 +1,92 @@
+//
+//  beamConvolution.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Convolution of pencil-beam responses with finite beam profiles.  For a laterally
+// uniform medium the response to any cylindrically symmetric beam is the pencil-beam
+// response convolved with the beam irradiance, so a single pencil-beam run (see
+// Medium::enablePencilBeamTallies) serves any number of beam profiles.
+#ifndef BEAMCONVOLUTION_H
+#define BEAMCONVOLUTION_H
+
+#include <vector>
+#include <string>
+
+class RadialTally;
+
+
+// Irradiance of a cylindrically symmetric beam carrying unit power.
+class BeamProfile
+{
+public:
+    virtual ~BeamProfile() {}
+
+    // Irradiance [1/cm^2] at radial distance 'rho' from the beam axis.
+    virtual double irradiance(const double rho) const = 0;
+
+    // Radius beyond which the irradiance is negligible.
+    virtual double getExtent(void) const = 0;
+};
+
+
+// Gaussian beam with 'radius' being the 1/e^2 radius.
+class GaussianBeam : public BeamProfile
+{
+public:
+    GaussianBeam(const double radius);
+    virtual double irradiance(const double rho) const;
+    virtual double getExtent(void) const {return 3.0*radius;}
+
+private:
+    double radius;
+};
+
+
+// Uniform (flat-top) beam of the given radius.
+class FlatTopBeam : public BeamProfile
+{
+public:
+    FlatTopBeam(const double radius);
+    virtual double irradiance(const double rho) const;
+    virtual double getExtent(void) const {return radius;}
+
+private:
+    double radius;
+};
+
+
+// Arbitrary beam given as irradiance samples at increasing radial positions.
+// The samples are linearly interpolated and normalized to unit power.
+class TabulatedBeam : public BeamProfile
+{
+public:
+    TabulatedBeam(const std::vector<double> &rho, const std::vector<double> &values);
+    virtual double irradiance(const double rho) const;
+    virtual double getExtent(void) const {return rho.back();}
+
+    // Read a two column (rho [cm], irradiance) text file.  Returns NULL if the
+    // file could not be read.
+    static TabulatedBeam * read(const std::string &filename);
+
+private:
+    std::vector<double> rho;
+    std::vector<double> values;
+};
+
+
+namespace BeamConvolution
+{
+    // Convolve a pencil-beam response 'pencil', binned radially with bin size 'dr'
+    // (bin centers at (i+0.5)*dr), with 'beam'.  The result is given at the same bins.
+    std::vector<double> convolve(const std::vector<double> &pencil, const double dr,
+                                 const BeamProfile &beam);
+
+    // Convolve R(r), T(r) and A(r,z) of a pencil-beam run with 'beam' and write the
+    // results to 'filename'.  Returns false if the file could not be written.
+    bool writeConvolved(const RadialTally &tally, const BeamProfile &beam,
+                        const std::string &filename);
+}
+
+#endif // BEAMCONVOLUTION_H
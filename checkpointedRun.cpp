@@ -0,0 +1,402 @@
+//
+//  checkpointedRun.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "checkpointedRun.h"
+#include "workerPool.h"
+#include "photon.h"
+#include "medium.h"
+#include "scene.h"
+#include "tallySet.h"
+#include "liveTallies.h"
+#include "perfCounters.h"
+#include "traceRecorder.h"
+#include "lockWait.h"
+#include "timer.h"
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// Identifies the binary checkpoint file and its layout version.
+static const char CHECKPOINT_MAGIC[8] = {'M', 'C', 'C', 'K', 'P', 'T', '0', '2'};
+
+
+
+CheckpointedRun::CheckpointedRun(WorkerPool &pool, Scene *scene, const unsigned long chunk_size,
+                                 const uint64_t seed)
+: pool(pool)
+{
+    this->scene = scene;
+    this->chunk_size = chunk_size > 0 ? chunk_size : 1;
+    this->seed = seed;
+    checkpoint_interval = 0;
+    live_writer = NULL;
+    live_interval = 0;
+    report_interval = 0;
+    target_photons = 0;
+    start_time = 0;
+    running = false;
+    cancelled = false;
+    photons = new Photon[pool.getNumThreads()];
+    perf_enabled = false;
+    perf_counters = new PerfCounters[pool.getNumThreads()];
+    perf_counts = new PerfCounts[pool.getNumThreads()];
+}
+
+
+CheckpointedRun::~CheckpointedRun()
+{
+    delete [] photons;
+    delete [] perf_counters;
+    delete [] perf_counts;
+}
+
+
+void CheckpointedRun::setCheckpoint(const std::string &filename, const double interval)
+{
+    checkpoint_file = filename;
+    checkpoint_interval = interval;
+}
+
+
+void CheckpointedRun::setLiveTallies(LiveTallyWriter *writer, const double interval)
+{
+    live_writer = writer;
+    live_interval = interval;
+}
+
+
+void CheckpointedRun::addCompleted(const unsigned long first, const unsigned long count)
+{
+    std::map<unsigned long, unsigned long>::iterator next = completed.lower_bound(first);
+    unsigned long start = first;
+    unsigned long end = first + count;
+
+    // Join with the preceding range if it ends where this one starts.
+    if (next != completed.begin())
+    {
+        std::map<unsigned long, unsigned long>::iterator prev = next;
+        prev--;
+        if (prev->first + prev->second == start)
+        {
+            start = prev->first;
+            completed.erase(prev);
+        }
+    }
+
+    // Join with the following range if it starts where this one ends.
+    if (next != completed.end() && next->first == end)
+    {
+        end += next->second;
+        completed.erase(next);
+    }
+
+    completed[start] = end - start;
+}
+
+
+void CheckpointedRun::cancel(void)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    cancelled = true;
+}
+
+
+bool CheckpointedRun::isCancelled(void)
+{
+    // Called by the workers at the start of every chunk.
+    TimedLock lock(m_mutex);
+    return cancelled;
+}
+
+
+unsigned long CheckpointedRun::getNumCompleted(void)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    unsigned long total = 0;
+    std::map<unsigned long, unsigned long>::const_iterator it;
+    for (it = completed.begin(); it != completed.end(); it++)
+        total += it->second;
+    return total;
+}
+
+
+std::map<unsigned long, unsigned long> CheckpointedRun::getCompleted(void)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    return completed;
+}
+
+
+PerfCounts CheckpointedRun::getPerfCounts(void) const
+{
+    PerfCounts total;
+    for (int i = 0; i < pool.getNumThreads(); i++)
+        total.merge(perf_counts[i]);
+    return total;
+}
+
+
+void CheckpointedRun::runChunk(const unsigned long first_photon, const unsigned long count,
+                               const int worker)
+{
+    // Same steps as Photon::injectPhoton(), but the tallies are added to the medium
+    // under the snapshot lock so a checkpoint never holds part of a chunk.
+    TraceScope trace(TraceRecorder::CHUNK);
+    if (isCancelled())
+        return;
+
+    Photon &photon = photons[worker];
+    photon.beginInjection(scene->getMedium(), scene->getSource());
+
+    // The counters are opened by the worker itself, since they count the opening thread.
+    bool perf = perf_enabled && perf_counters[worker].open();
+    if (perf)
+        perf_counters[worker].start();
+    photon.propagateSeeded(seed, first_photon, count);
+    if (perf)
+        perf_counters[worker].stop(perf_counts[worker]);
+
+    TimedSharedLock snapshot_lock(m_snapshot_mutex);
+    photon.endInjection(count);
+
+    TimedLock lock(m_mutex);
+    addCompleted(first_photon, count);
+}
+
+
+void CheckpointedRun::run(const unsigned long first_photon, const unsigned long end_photon)
+{
+    // Queue the photons of the range that are not covered by completed ranges,
+    // split on the chunk boundaries.  Only the end of a run extended beyond a short
+    // last chunk starts in the middle of a chunk.
+    std::map<unsigned long, unsigned long> done;
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        done = completed;
+    }
+    unsigned long first = first_photon;
+    std::map<unsigned long, unsigned long>::const_iterator range = done.begin();
+    while (first < end_photon)
+    {
+        if (range != done.end() && range->first <= first)
+        {
+            first = std::max(first, range->first + range->second);
+            range++;
+            continue;
+        }
+
+        unsigned long end = (first / chunk_size + 1) * chunk_size;
+        end = std::min(end, end_photon);
+        if (range != done.end())
+            end = std::min(end, range->first);
+        pool.submit(boost::bind(&CheckpointedRun::runChunk, this, first, end - first, _1));
+        first = end;
+    }
+
+    target_photons = end_photon;
+    start_time = getWallTime();
+    if ((!checkpoint_file.empty() && checkpoint_interval > 0) || (live_writer && live_interval > 0) ||
+        report_interval > 0)
+    {
+        running = true;
+        checkpoint_thread = boost::thread(&CheckpointedRun::checkpointLoop, this);
+    }
+
+    pool.wait();
+
+    if (checkpoint_thread.joinable())
+    {
+        {
+            boost::mutex::scoped_lock lock(m_checkpoint_mutex);
+            running = false;
+        }
+        run_finished.notify_all();
+        checkpoint_thread.join();
+    }
+
+    if (!checkpoint_file.empty() && !writeCheckpoint())
+        cout << "Error: could not write checkpoint " << checkpoint_file << endl;
+    if (live_writer)
+        publishLiveTallies(true);
+}
+
+
+void CheckpointedRun::checkpointLoop(void)
+{
+    TraceRecorder::getInstance()->setThreadName("checkpoints");
+    bool checkpoints = !checkpoint_file.empty() && checkpoint_interval > 0;
+    bool snapshots = live_writer && live_interval > 0;
+    bool reports = report_interval > 0;
+    double next_checkpoint = checkpoints ? start_time + checkpoint_interval : 0;
+    double next_snapshot = snapshots ? start_time + live_interval : 0;
+    double next_report = reports ? start_time + report_interval : 0;
+
+    boost::mutex::scoped_lock lock(m_checkpoint_mutex);
+    while (running)
+    {
+        double next = checkpoints ? next_checkpoint : (snapshots ? next_snapshot : next_report);
+        if (snapshots && next_snapshot < next)
+            next = next_snapshot;
+        if (reports && next_report < next)
+            next = next_report;
+        double wait = std::max(next - getWallTime(), 0.0);
+        boost::system_time timeout = boost::get_system_time() +
+                                     boost::posix_time::milliseconds((long)(wait * 1000));
+        run_finished.timed_wait(lock, timeout);
+        if (!running)
+            break;
+
+        lock.unlock();
+        double now = getWallTime();
+        if (checkpoints && now >= next_checkpoint)
+        {
+            if (!writeCheckpoint())
+                cout << "Error: could not write checkpoint " << checkpoint_file << endl;
+            next_checkpoint = now + checkpoint_interval;
+        }
+        if (snapshots && now >= next_snapshot)
+        {
+            publishLiveTallies(false);
+            next_snapshot = now + live_interval;
+        }
+        if (reports && now >= next_report)
+        {
+            // The counters of a chunk reach the medium when it finishes.
+            cout << getNumCompleted() << "/" << target_photons << " photons: ";
+            scene->getMedium()->getEventCounters().writeSummary(cout, now - start_time);
+            next_report = now + report_interval;
+        }
+        lock.lock();
+    }
+}
+
+
+void CheckpointedRun::publishLiveTallies(const bool finished)
+{
+    // Workers only wait for the copy; readers of the segment never touch the run.
+    TraceScope trace(TraceRecorder::LIVE_SNAPSHOT);
+    TallySet tallies;
+    {
+        boost::unique_lock<boost::shared_mutex> snapshot_lock(m_snapshot_mutex);
+        tallies.capture(scene->getMedium());
+    }
+    if (!live_writer->publish(tallies, target_photons, getWallTime() - start_time, finished))
+        cout << "Error: could not publish live tallies to /" << live_writer->getName() << endl;
+}
+
+
+// Binary layout (native byte order):
+//     char[8]   magic "MCCKPT02"
+//     uint64    scene hash (see SceneDescription::hash)
+//     uint64    seed, uint64 chunk size, uint32 number of completed ranges
+//     uint64[2] first photon and number of photons of every completed range
+//     tallies of the medium (see TallySet::writeBinary)
+bool CheckpointedRun::writeCheckpoint(void)
+{
+    // Snapshot the state into memory, stalling the workers only for the copy.
+    TraceScope trace(TraceRecorder::CHECKPOINT);
+    std::ostringstream snapshot(std::ios::binary);
+    {
+        boost::unique_lock<boost::shared_mutex> snapshot_lock(m_snapshot_mutex);
+        boost::mutex::scoped_lock lock(m_mutex);
+
+        uint64_t scene_hash = scene->getDescription().hash();
+        uint64_t chunk = chunk_size;
+        uint32_t num_ranges = completed.size();
+        snapshot.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        snapshot.write((const char *)&scene_hash, sizeof(scene_hash));
+        snapshot.write((const char *)&seed, sizeof(seed));
+        snapshot.write((const char *)&chunk, sizeof(chunk));
+        snapshot.write((const char *)&num_ranges, sizeof(num_ranges));
+        std::map<unsigned long, unsigned long>::const_iterator it;
+        for (it = completed.begin(); it != completed.end(); it++)
+        {
+            uint64_t range[2] = {it->first, it->second};
+            snapshot.write((const char *)range, sizeof(range));
+        }
+        TallySet tallies;
+        tallies.capture(scene->getMedium());
+        tallies.writeBinary(snapshot);
+    }
+
+    // Write to a temporary file and rename it, so a crash while writing leaves the
+    // previous checkpoint intact.
+    std::string temp_file = checkpoint_file + ".tmp";
+    std::ofstream output(temp_file.c_str(), std::ios::binary);
+    if (!output.is_open())
+        return false;
+    std::string data = snapshot.str();
+    output.write(data.data(), data.size());
+    output.close();
+    if (output.fail())
+        return false;
+
+    return rename(temp_file.c_str(), checkpoint_file.c_str()) == 0;
+}
+
+
+bool CheckpointedRun::resume(void)
+{
+    std::ifstream input(checkpoint_file.c_str(), std::ios::binary);
+    if (!input.is_open())
+        return false;
+
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    uint64_t scene_hash = 0, file_seed = 0, chunk = 0;
+    uint32_t num_ranges = 0;
+    input.read(magic, sizeof(magic));
+    input.read((char *)&scene_hash, sizeof(scene_hash));
+    input.read((char *)&file_seed, sizeof(file_seed));
+    input.read((char *)&chunk, sizeof(chunk));
+    input.read((char *)&num_ranges, sizeof(num_ranges));
+    if (input.fail() || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 || chunk == 0)
+    {
+        cout << "Error: " << checkpoint_file << " is not a checkpoint\n";
+        return false;
+    }
+
+    // Tallies of another scene may have the same shapes, so the scene is compared
+    // first.  The seed and chunk size must match for the photons to line up with
+    // those of the interrupted run.
+    if (scene_hash != scene->getDescription().hash())
+    {
+        cout << "Error: checkpoint " << checkpoint_file << " is of another scene\n";
+        return false;
+    }
+    if (file_seed != seed || chunk != chunk_size)
+    {
+        cout << "Error: checkpoint " << checkpoint_file << " was run with seed " << file_seed
+             << " and chunks of " << chunk << " photons, not seed " << seed << " and chunks of "
+             << chunk_size << "\n";
+        return false;
+    }
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    completed.clear();
+    for (uint32_t i = 0; i < num_ranges; i++)
+    {
+        uint64_t range[2];
+        input.read((char *)range, sizeof(range));
+        completed[range[0]] = range[1];
+    }
+
+    TallySet tallies;
+    if (input.fail() || !tallies.readBinary(input) || !tallies.restore(scene->getMedium()))
+    {
+        cout << "Error: checkpoint " << checkpoint_file << " does not match the scene\n";
+        completed.clear();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,144 @@
+//
+//  checkpointedRun.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Long runs with periodic checkpoints.  Photons are propagated in chunks on the
+// worker pool, where chunk 'k' covers photons [k*chunk_size, (k+1)*chunk_size) and
+// seeds its RNG from the seed at every block of Photon::SEED_BLOCK photons.  The RNG
+// state of every chunk therefore follows from the seed, and a checkpoint only has to
+// hold the seed, the photon ranges completed so far and the tallies of the medium.  A
+// run resumed from a checkpoint propagates exactly the photons that were missing, and
+// a finished run can be extended by resuming it with a larger number of photons.
+//
+// Checkpoints are taken by a background thread.  Workers only hold a shared lock
+// while adding a finished chunk to the tallies; the snapshot takes the lock
+// exclusively to copy the tallies into memory and writes the file after releasing it.
+#ifndef CHECKPOINTEDRUN_H
+#define CHECKPOINTEDRUN_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+class WorkerPool;
+class Photon;
+class Scene;
+class LiveTallyWriter;
+class PerfCounters;
+struct PerfCounts;
+
+
+class CheckpointedRun
+{
+public:
+    CheckpointedRun(WorkerPool &pool, Scene *scene, const unsigned long chunk_size,
+                    const uint64_t seed);
+    ~CheckpointedRun();
+
+    // Write a checkpoint to 'filename' every 'interval' seconds while running, and
+    // once more when the run finishes.  The file is replaced atomically.
+    void    setCheckpoint(const std::string &filename, const double interval);
+
+    // Publish a snapshot of the tallies to 'writer' every 'interval' seconds while
+    // running, and a final one when the run finishes.
+    void    setLiveTallies(LiveTallyWriter *writer, const double interval);
+
+    // Print a line with the photon rate, steps per photon and energy imbalance of the
+    // photons propagated so far every 'interval' seconds while running.  The event
+    // counters are not part of a checkpoint, so they only cover this process.
+    void    setProgressReport(const double interval) {report_interval = interval;}
+
+    // Read the hardware performance counters of every worker around the propagation
+    // of its chunks (see perfCounters.h).
+    void    enablePerfCounters(void) {perf_enabled = true;}
+
+    // Counts summed over the workers and the chunks run so far.  Call between runs.
+    PerfCounts  getPerfCounts(void) const;
+
+    // Restore the completed photon ranges and tallies from the checkpoint file.  The
+    // scene must be freshly compiled from the same description, and the run created
+    // with the seed and chunk size of the checkpoint.  Returns false, after printing
+    // why, if there is no usable checkpoint.
+    bool    resume(void);
+
+    // Propagate every photon in [0, num_photons) that was not completed yet.
+    void    run(const unsigned long num_photons) {run(0, num_photons);}
+
+    // As above for the photons in [first_photon, end_photon), e.g. one shard of a
+    // run split over several processes.  'first_photon' should lie on a chunk
+    // boundary for the photons to match those of an unsplit run.
+    void    run(const unsigned long first_photon, const unsigned long end_photon);
+
+    // Stop a run in progress: chunks that have not started yet are skipped and run()
+    // returns once the running chunks finish.  Safe to call from any thread.
+    void    cancel(void);
+    bool    isCancelled(void);
+
+    // Number of photons completed, including those of a resumed run.
+    unsigned long   getNumCompleted(void);
+
+    // Return the completed photon ranges, first photon -> number of photons.
+    std::map<unsigned long, unsigned long> getCompleted(void);
+
+    unsigned long   getChunkSize(void) const {return chunk_size;}
+    uint64_t        getSeed(void) const {return seed;}
+
+    // Write a checkpoint now.  Returns false if the file could not be written.
+    bool    writeCheckpoint(void);
+
+private:
+    // Task run on the pool.
+    void    runChunk(const unsigned long first_photon, const unsigned long count, const int worker);
+
+    // Record [first, first + count) as completed.  Called with 'm_mutex' held.
+    void    addCompleted(const unsigned long first, const unsigned long count);
+
+    // Main loop of the thread taking checkpoints, live snapshots and progress reports.
+    void    checkpointLoop(void);
+
+    // Publish the tallies to the live tally writer.
+    void    publishLiveTallies(const bool finished);
+
+    WorkerPool &pool;
+    Scene *scene;
+    unsigned long chunk_size;
+    uint64_t seed;
+
+    // Completed photon ranges, first photon -> number of photons.  Adjacent ranges
+    // are coalesced, so a run in progress holds only a few entries.
+    std::map<unsigned long, unsigned long> completed;
+    bool cancelled;
+    boost::mutex m_mutex;
+
+    // Held shared by workers while they add tallies, and exclusively by snapshots.
+    boost::shared_mutex m_snapshot_mutex;
+
+    // One photon object per worker.
+    Photon *photons;
+
+    // Hardware counters of every worker, and the counts of the chunks they ran.
+    bool perf_enabled;
+    PerfCounters *perf_counters;
+    PerfCounts *perf_counts;
+
+    // Checkpoint, live snapshot and progress report settings, and the thread taking them.
+    std::string checkpoint_file;
+    double checkpoint_interval;
+    LiveTallyWriter *live_writer;
+    double live_interval;
+    double report_interval;
+    unsigned long target_photons;
+    double start_time;
+    bool running;
+    boost::thread checkpoint_thread;
+    boost::mutex m_checkpoint_mutex;
+    boost::condition_variable run_finished;
+};
+
+#endif // CHECKPOINTEDRUN_H
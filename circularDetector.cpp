@@ -170,4 +170,25 @@ void CircularDetector::savePhotonExitData(const boost::shared_ptr<Vector3d> phot
 void CircularDetector::savePhotonExitWeight(void)
 {
     
-}
\ No newline at end of file
+}
+
+
+// The distance to a disc is found by splitting the vector from the center of the
+// detector to 'point' into the component along the normal of the detector plane
+// and the component lying in the plane.  Only the in-plane distance beyond the
+// radius of the disc contributes to the distance.
+double CircularDetector::distanceToDetector(const coords &point)
+{
+    double dx = point.x - center.location.x;
+    double dy = point.y - center.location.y;
+    double dz = point.z - center.location.z;
+    
+    double normal_dist = dx*normalVector.location.x +
+                         dy*normalVector.location.y +
+                         dz*normalVector.location.z;
+    double in_plane_dist = sqrt(fabs(dx*dx + dy*dy + dz*dz - normal_dist*normal_dist)) - radius;
+    if (in_plane_dist < 0.0)
+        in_plane_dist = 0.0;
+    
+    return sqrt(normal_dist*normal_dist + in_plane_dist*in_plane_dist);
+}
@@ -27,6 +27,7 @@ public:
                        const double weight,
                        const bool tagged);
     virtual void savePhotonExitWeight(void);
+    virtual double distanceToDetector(const coords &point);
     
     
 private:
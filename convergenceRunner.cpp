@@ -0,0 +1,211 @@
+//
+//  convergenceRunner.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "convergenceRunner.h"
+#include "workerPool.h"
+#include "photon.h"
+#include "medium.h"
+#include "scene.h"
+#include "timer.h"
+#include "traceRecorder.h"
+#include <boost/bind.hpp>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+
+ConvergenceRunner::ConvergenceRunner(WorkerPool &pool, const unsigned long batch_size)
+: pool(pool)
+{
+    this->batch_size = batch_size > 0 ? batch_size : 1;
+
+    target_rel_error = 0;
+    target_tally = DETECTED_WEIGHT;
+    min_detected = 0;
+    time_budget = 0;
+    max_photons = 0;
+    min_batches = 16;
+
+    scene = NULL;
+    seed = 0;
+    num_batches = next_batch = 0;
+    num_detected = 0;
+    for (int t = 0; t < NUM_TALLIES; t++)
+        sum[t] = sum_sq[t] = 0;
+    reason = NOT_STOPPED;
+    start_time = elapsed = 0;
+
+    photons = new Photon[pool.getNumThreads()];
+}
+
+
+ConvergenceRunner::~ConvergenceRunner()
+{
+    delete [] photons;
+}
+
+
+void ConvergenceRunner::setTargetRelativeError(const double rel_error, const Tally tally)
+{
+    target_rel_error = rel_error;
+    target_tally = tally;
+}
+
+
+void ConvergenceRunner::setMinDetected(const unsigned long count)
+{
+    min_detected = count;
+}
+
+
+void ConvergenceRunner::setTimeBudget(const double seconds)
+{
+    time_budget = seconds;
+}
+
+
+void ConvergenceRunner::setMaxPhotons(const unsigned long count)
+{
+    max_photons = count;
+}
+
+
+bool ConvergenceRunner::run(Scene *scene, const uint64_t seed)
+{
+    if (target_rel_error <= 0 && min_detected == 0 && time_budget <= 0 && max_photons == 0)
+    {
+        cout << "Error: no stopping criterion set\n";
+        return false;
+    }
+
+    this->scene = scene;
+    this->seed = seed;
+    num_batches = next_batch = 0;
+    num_detected = 0;
+    for (int t = 0; t < NUM_TALLIES; t++)
+        sum[t] = sum_sq[t] = 0;
+    reason = NOT_STOPPED;
+    start_time = getWallTime();
+
+    // Two batches per worker keep every worker busy while the statistics of a
+    // finished batch are added and its successor is queued.
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        for (int i = 0; i < 2 * pool.getNumThreads() && !shouldStop(); i++)
+            pool.submit(boost::bind(&ConvergenceRunner::runBatch, this, next_batch++, _1));
+    }
+    pool.wait();
+
+    elapsed = getWallTime() - start_time;
+    return true;
+}
+
+
+void ConvergenceRunner::runBatch(const unsigned long batch, const int worker)
+{
+    TraceScope trace(TraceRecorder::CHUNK);
+
+    // Seeding from the batch index makes the photons of a batch independent of the
+    // worker that runs it.
+    unsigned int state[4];
+    Photon::counterSeeds(seed, batch * batch_size, state);
+    Photon &photon = photons[worker];
+    photon.injectPhoton(scene->getMedium(), batch_size, state[0], state[1], state[2], state[3],
+                        scene->getSource());
+
+    double score[NUM_TALLIES];
+    score[DETECTED_WEIGHT] = photon.getDetectedWeight() / batch_size;
+    score[ABSORBER_WEIGHT] = photon.getAbsorberWeight() / batch_size;
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    for (int t = 0; t < NUM_TALLIES; t++)
+    {
+        sum[t] += score[t];
+        sum_sq[t] += score[t] * score[t];
+    }
+    num_detected += photon.getNumDetected();
+    num_batches++;
+
+    if (!shouldStop())
+        pool.submit(boost::bind(&ConvergenceRunner::runBatch, this, next_batch++, _1));
+}
+
+
+bool ConvergenceRunner::shouldStop(void)
+{
+    if (reason != NOT_STOPPED)
+        return true;
+
+    if (target_rel_error > 0 && num_batches >= min_batches &&
+        getRelativeError(target_tally) <= target_rel_error)
+        reason = TARGET_ERROR;
+    else if (min_detected > 0 && num_detected >= min_detected)
+        reason = MIN_DETECTED;
+    else if (time_budget > 0 && getWallTime() - start_time >= time_budget)
+        reason = TIME_BUDGET;
+    else if (max_photons > 0 && next_batch * batch_size >= max_photons)
+        reason = MAX_PHOTONS;
+
+    return reason != NOT_STOPPED;
+}
+
+
+const char * ConvergenceRunner::getStopReasonName(void) const
+{
+    switch (reason)
+    {
+        case TARGET_ERROR:  return "target relative error";
+        case MIN_DETECTED:  return "minimum detected photons";
+        case TIME_BUDGET:   return "time budget";
+        case MAX_PHOTONS:   return "maximum photons";
+        default:            return "not stopped";
+    }
+}
+
+
+double ConvergenceRunner::getMean(const Tally tally) const
+{
+    return num_batches > 0 ? sum[tally] / num_batches : 0.0;
+}
+
+
+double ConvergenceRunner::getRelativeError(const Tally tally) const
+{
+    // Without a nonzero mean over at least two batches the error is unknown.
+    double mean = getMean(tally);
+    if (num_batches < 2 || mean == 0.0)
+        return HUGE_VAL;
+
+    double n = num_batches;
+    double variance = (sum_sq[tally] - n * mean * mean) / (n - 1);
+    if (variance < 0)
+        variance = 0;
+    return sqrt(variance / n) / fabs(mean);
+}
+
+
+bool ConvergenceRunner::writeResults(const std::string &filename) const
+{
+    std::ofstream output(filename.c_str());
+    if (!output.is_open())
+        return false;
+
+    output << "stopped by\t" << getStopReasonName() << "\n";
+    output << "photons\t" << getNumPhotons() << "\n";
+    output << "batches\t" << num_batches << "\n";
+    output << "elapsed [s]\t" << elapsed << "\n";
+    output << "detected photons\t" << num_detected << "\n";
+    output << "detected weight/photon\t" << getMean(DETECTED_WEIGHT)
+           << "\trelative error\t" << getRelativeError(DETECTED_WEIGHT) << "\n";
+    output << "absorber weight/photon\t" << getMean(ABSORBER_WEIGHT)
+           << "\trelative error\t" << getRelativeError(ABSORBER_WEIGHT) << "\n";
+
+    output.close();
+    return !output.fail();
+}
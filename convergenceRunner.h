@@ -0,0 +1,106 @@
+//
+//  convergenceRunner.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Runs a scene until a stopping criterion is met instead of for a fixed number of
+// photons.  Photons are propagated in batches of equal size; the batch means of the
+// tallies give their standard error as the run progresses.  The run stops at the
+// first of: a target relative standard error on a chosen tally, a minimum number of
+// detected photons, a wall-clock budget, or a maximum number of photons.
+#ifndef CONVERGENCERUNNER_H
+#define CONVERGENCERUNNER_H
+
+#include <stdint.h>
+#include <string>
+#include <boost/thread/mutex.hpp>
+
+class WorkerPool;
+class Photon;
+class Scene;
+
+
+class ConvergenceRunner
+{
+public:
+    // Tallies whose batch statistics are tracked, per photon.
+    enum Tally {DETECTED_WEIGHT, ABSORBER_WEIGHT, NUM_TALLIES};
+
+    enum StopReason {NOT_STOPPED, TARGET_ERROR, MIN_DETECTED, TIME_BUDGET, MAX_PHOTONS};
+
+    // Each batch propagates 'batch_size' photons on one worker.
+    ConvergenceRunner(WorkerPool &pool, const unsigned long batch_size);
+    ~ConvergenceRunner();
+
+    // Stopping criteria.  A value of zero disables the criterion, and at least one
+    // must be enabled before run() is called.
+    void    setTargetRelativeError(const double rel_error, const Tally tally);
+    void    setMinDetected(const unsigned long count);
+    void    setTimeBudget(const double seconds);
+    void    setMaxPhotons(const unsigned long count);
+
+    // The relative error is not trusted before this many batches (default 16).
+    void    setMinBatches(const unsigned long count) {min_batches = count;}
+
+    // Propagate photons through 'scene' until a criterion is met.  Batches already
+    // running when it is met are finished and counted.  Returns false when no
+    // criterion was set.
+    bool    run(Scene *scene, const uint64_t seed);
+
+    unsigned long   getNumPhotons(void) const {return num_batches * batch_size;}
+    unsigned long   getNumBatches(void) const {return num_batches;}
+    unsigned long   getNumDetected(void) const {return num_detected;}
+    double          getElapsed(void) const {return elapsed;}
+    StopReason      getStopReason(void) const {return reason;}
+    const char *    getStopReasonName(void) const;
+
+    // Mean of a tally per photon and its relative standard error from the batch means.
+    double  getMean(const Tally tally) const;
+    double  getRelativeError(const Tally tally) const;
+
+    // Write the run summary.  Returns false on failure.
+    bool    writeResults(const std::string &filename) const;
+
+private:
+    // Task run on the pool.  Queues the next batch unless the run is stopping.
+    void    runBatch(const unsigned long batch, const int worker);
+
+    // Test the criteria and set 'reason' if one is met.  Called with the lock held.
+    bool    shouldStop(void);
+
+    WorkerPool &pool;
+    unsigned long batch_size;
+
+    // Criteria.
+    double target_rel_error;
+    Tally target_tally;
+    unsigned long min_detected;
+    double time_budget;
+    unsigned long max_photons;
+    unsigned long min_batches;
+
+    Scene *scene;
+    uint64_t seed;
+
+    // Batch statistics of the finished batches.
+    unsigned long num_batches;
+    unsigned long num_detected;
+    double sum[NUM_TALLIES];
+    double sum_sq[NUM_TALLIES];
+
+    // Index of the next batch to queue.
+    unsigned long next_batch;
+
+    StopReason reason;
+    double start_time;
+    double elapsed;
+
+    // One photon object per worker.
+    Photon *photons;
+
+    // Serializes the batch statistics and queueing of batches.
+    boost::mutex m_mutex;
+};
+
+#endif // CONVERGENCERUNNER_H
@@ -0,0 +1,237 @@
+//
+//  correlatedSampler.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "correlatedSampler.h"
+#include "workerPool.h"
+#include "photon.h"
+#include "medium.h"
+#include "traceRecorder.h"
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+
+
+CorrelatedSampler::CorrelatedSampler(WorkerPool &pool, const unsigned long chunk_size)
+: pool(pool)
+{
+    this->chunk_size = chunk_size > 0 ? chunk_size : 1;
+    seed = 0;
+    num_photons = 0;
+    photons = NULL;
+}
+
+
+CorrelatedSampler::~CorrelatedSampler()
+{
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        if (variants[i].scene)
+            delete variants[i].scene;
+    }
+    if (photons)
+        delete [] photons;
+}
+
+
+int CorrelatedSampler::addVariant(const std::string &name, const SceneDescription &scene)
+{
+    Variant variant;
+    variant.name = name;
+    variant.description = scene;
+    variant.scene = NULL;
+    variants.push_back(variant);
+
+    return variants.size() - 1;
+}
+
+
+void CorrelatedSampler::compileVariant(const int variant, const int worker)
+{
+    variants[variant].scene = new Scene(variants[variant].description);
+}
+
+
+void CorrelatedSampler::runChunk(const unsigned long first_photon, const unsigned long count,
+                                 const int worker)
+{
+    TraceScope trace(TraceRecorder::CHUNK);
+    int num_variants = variants.size();
+    Photon *photon = &photons[worker * num_variants];
+    Sums &sums = worker_sums[worker];
+
+    for (int v = 0; v < num_variants; v++)
+        photon[v].beginInjection(variants[v].scene->getMedium(), variants[v].scene->getSource());
+
+    // Scores of the current photon in the reference variant.
+    double reference[NUM_OBSERVABLES];
+
+    for (unsigned long i = first_photon; i < first_photon + count; i++)
+    {
+        for (int v = 0; v < num_variants; v++)
+        {
+            // The running totals of the photon object give the score of this photon.
+            double detected = photon[v].getDetectedWeight();
+            double absorbed = photon[v].getAbsorberWeight();
+            photon[v].injectSeededPhoton(seed, i);
+
+            double score[NUM_OBSERVABLES];
+            score[DETECTED_WEIGHT] = photon[v].getDetectedWeight() - detected;
+            score[ABSORBER_WEIGHT] = photon[v].getAbsorberWeight() - absorbed;
+
+            for (int o = 0; o < NUM_OBSERVABLES; o++)
+            {
+                int k = v * NUM_OBSERVABLES + o;
+                sums.score[k] += score[o];
+                sums.score_sq[k] += score[o] * score[o];
+
+                if (v == 0)
+                {
+                    reference[o] = score[o];
+                    continue;
+                }
+                double d = score[o] - reference[o];
+                sums.diff[k] += d;
+                sums.diff_sq[k] += d * d;
+            }
+        }
+    }
+
+    for (int v = 0; v < num_variants; v++)
+        photon[v].endInjection(count);
+}
+
+
+void CorrelatedSampler::run(const unsigned long num_photons, const uint64_t seed)
+{
+    this->num_photons = num_photons;
+    this->seed = seed;
+
+    for (size_t v = 0; v < variants.size(); v++)
+    {
+        if (!variants[v].scene)
+            pool.submit(boost::bind(&CorrelatedSampler::compileVariant, this, (int)v, _1));
+    }
+    pool.wait();
+
+    int num_workers = pool.getNumThreads();
+    size_t num_sums = variants.size() * NUM_OBSERVABLES;
+    if (photons)
+        delete [] photons;
+    photons = new Photon[num_workers * variants.size()];
+
+    totals.score.assign(num_sums, 0.0);
+    totals.score_sq.assign(num_sums, 0.0);
+    totals.diff.assign(num_sums, 0.0);
+    totals.diff_sq.assign(num_sums, 0.0);
+    worker_sums.assign(num_workers, totals);
+
+    for (unsigned long first = 0; first < num_photons; first += chunk_size)
+    {
+        unsigned long count = std::min(chunk_size, num_photons - first);
+        pool.submit(boost::bind(&CorrelatedSampler::runChunk, this, first, count, _1));
+    }
+    pool.wait();
+
+    for (int w = 0; w < num_workers; w++)
+    {
+        for (size_t k = 0; k < num_sums; k++)
+        {
+            totals.score[k] += worker_sums[w].score[k];
+            totals.score_sq[k] += worker_sums[w].score_sq[k];
+            totals.diff[k] += worker_sums[w].diff[k];
+            totals.diff_sq[k] += worker_sums[w].diff_sq[k];
+        }
+    }
+    worker_sums.clear();
+}
+
+
+double CorrelatedSampler::stdError(const double sum, const double sum_sq) const
+{
+    if (num_photons < 2)
+        return 0.0;
+
+    double n = num_photons;
+    double mean = sum / n;
+    double variance = (sum_sq / n - mean * mean) * n / (n - 1);
+    return variance > 0 ? sqrt(variance / n) : 0.0;
+}
+
+
+double CorrelatedSampler::getMean(const int variant, const Observable obs) const
+{
+    if (num_photons == 0)
+        return 0.0;
+    return totals.score[variant * NUM_OBSERVABLES + obs] / num_photons;
+}
+
+
+double CorrelatedSampler::getStdError(const int variant, const Observable obs) const
+{
+    int k = variant * NUM_OBSERVABLES + obs;
+    return stdError(totals.score[k], totals.score_sq[k]);
+}
+
+
+double CorrelatedSampler::getDifference(const int variant, const Observable obs) const
+{
+    if (num_photons == 0)
+        return 0.0;
+    return totals.diff[variant * NUM_OBSERVABLES + obs] / num_photons;
+}
+
+
+double CorrelatedSampler::getDifferenceStdError(const int variant, const Observable obs) const
+{
+    int k = variant * NUM_OBSERVABLES + obs;
+    return stdError(totals.diff[k], totals.diff_sq[k]);
+}
+
+
+double CorrelatedSampler::getIndependentStdError(const int variant, const Observable obs) const
+{
+    double se_variant = getStdError(variant, obs);
+    double se_reference = getStdError(0, obs);
+    return sqrt(se_variant * se_variant + se_reference * se_reference);
+}
+
+
+bool CorrelatedSampler::writeResults(const std::string &filename) const
+{
+    std::ofstream output(filename.c_str());
+    if (!output.is_open())
+        return false;
+
+    const char *names[NUM_OBSERVABLES] = {"detected weight", "absorber weight"};
+
+    output << "photons\t" << num_photons << "\n";
+    output << "seed\t" << seed << "\n";
+    output << "reference\t" << variants[0].name << "\n";
+    output << "variant\tobservable\tmean/photon\tstd error\t"
+           << "difference\tcorrelated std error\tindependent std error\tvariance reduction\n";
+    for (size_t v = 0; v < variants.size(); v++)
+    {
+        for (int o = 0; o < NUM_OBSERVABLES; o++)
+        {
+            Observable obs = (Observable)o;
+            output << variants[v].name << "\t" << names[o] << "\t"
+                   << getMean(v, obs) << "\t" << getStdError(v, obs);
+            if (v > 0)
+            {
+                double correlated = getDifferenceStdError(v, obs);
+                double independent = getIndependentStdError(v, obs);
+                output << "\t" << getDifference(v, obs) << "\t" << correlated << "\t" << independent
+                       << "\t" << (correlated > 0 ? independent*independent / (correlated*correlated) : 0.0);
+            }
+            output << "\n";
+        }
+    }
+
+    output.close();
+    return !output.fail();
+}
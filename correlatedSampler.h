@@ -0,0 +1,98 @@
+//
+//  correlatedSampler.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Correlated sampling of scene variants.  Photon 'i' draws the same random sequence
+// (the i-th counter-based stream of the seed) in every variant and the variants are
+// run in lock-step, photon by photon.  Paths agree until the variants' properties make
+// them diverge, so the per-photon differences to the reference variant (variant 0)
+// have a far smaller variance than the difference of two independent runs.
+#ifndef CORRELATEDSAMPLER_H
+#define CORRELATEDSAMPLER_H
+
+#include "scene.h"
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+class WorkerPool;
+class Photon;
+
+
+class CorrelatedSampler
+{
+public:
+    // Per-photon scores that are compared between the variants.
+    enum Observable {DETECTED_WEIGHT, ABSORBER_WEIGHT, NUM_OBSERVABLES};
+
+    // Photons are handed out to the workers 'chunk_size' at a time.
+    CorrelatedSampler(WorkerPool &pool, const unsigned long chunk_size);
+    ~CorrelatedSampler();
+
+    // Add a variant.  The first variant added is the reference of the differences.
+    int     addVariant(const std::string &name, const SceneDescription &scene);
+
+    // Propagate 'num_photons' photons through every variant.  Blocks until done.
+    void    run(const unsigned long num_photons, const uint64_t seed);
+
+    int     getNumVariants(void) const {return (int)variants.size();}
+    const std::string & getName(const int variant) const {return variants[variant].name;}
+    Scene * getScene(const int variant) {return variants[variant].scene;}
+
+    // Mean score per photon of a variant and its standard error.
+    double  getMean(const int variant, const Observable obs) const;
+    double  getStdError(const int variant, const Observable obs) const;
+
+    // Mean difference per photon between a variant and the reference, and its standard
+    // error from the correlated samples.
+    double  getDifference(const int variant, const Observable obs) const;
+    double  getDifferenceStdError(const int variant, const Observable obs) const;
+
+    // Standard error the difference would have if both variants were run independently
+    // with the same number of photons.
+    double  getIndependentStdError(const int variant, const Observable obs) const;
+
+    // Write the scores and differences of all variants.  Returns false on failure.
+    bool    writeResults(const std::string &filename) const;
+
+private:
+    struct Variant
+    {
+        std::string name;
+        SceneDescription description;
+        Scene *scene;
+    };
+
+    // Running sums of the scores and of the differences to the reference, indexed by
+    // variant * NUM_OBSERVABLES + observable.
+    struct Sums
+    {
+        std::vector<double> score, score_sq;
+        std::vector<double> diff, diff_sq;
+    };
+
+    // Tasks run on the pool.
+    void    compileVariant(const int variant, const int worker);
+    void    runChunk(const unsigned long first_photon, const unsigned long count, const int worker);
+
+    // Standard error of the mean from a sum and a sum of squares.
+    double  stdError(const double sum, const double sum_sq) const;
+
+    WorkerPool &pool;
+    unsigned long chunk_size;
+    std::vector<Variant> variants;
+
+    uint64_t seed;
+    unsigned long num_photons;
+
+    // One photon object per worker and variant, so every variant keeps its own totals.
+    Photon *photons;
+
+    // Sums of each worker, and their total once run() has finished.
+    std::vector<Sums> worker_sums;
+    Sums totals;
+};
+
+#endif // CORRELATEDSAMPLER_H
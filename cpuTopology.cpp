@@ -0,0 +1,236 @@
+//
+//  cpuTopology.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "cpuTopology.h"
+#include <boost/thread/thread.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+
+static const std::string SYSFS_CPU = "/sys/devices/system/cpu/";
+
+
+// Read a single integer from a sysfs file, or return 'fallback'.
+static int readValue(const std::string &filename, const int fallback)
+{
+    std::ifstream input(filename.c_str());
+    int value;
+    if (input >> value)
+        return value;
+    return fallback;
+}
+
+
+// Parse a CPU list such as "0-3,8-11" into the CPU numbers.
+static std::vector<int> parseList(const std::string &list)
+{
+    std::vector<int> ids;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        int first, last;
+        char dash;
+        std::stringstream values(range);
+        if (!(values >> first))
+            continue;
+        if (!(values >> dash >> last))
+            last = first;
+        for (int id = first; id <= last; id++)
+            ids.push_back(id);
+    }
+    return ids;
+}
+
+
+// The node of a CPU is given by the 'node<N>' entry in its sysfs directory.
+static int readNode(const int id)
+{
+    std::string path = SYSFS_CPU + "cpu" + boost::lexical_cast<std::string>(id);
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return 0;
+
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        std::string name = entry->d_name;
+        if (name.compare(0, 4, "node") == 0 && name.size() > 4 &&
+            name.find_first_not_of("0123456789", 4) == std::string::npos)
+        {
+            node = atoi(name.c_str() + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+
+static bool byId(const CpuTopology::Cpu &a, const CpuTopology::Cpu &b)
+{
+    return a.id < b.id;
+}
+
+
+
+CpuTopology CpuTopology::detect(void)
+{
+    CpuTopology topology;
+
+    std::ifstream online((SYSFS_CPU + "online").c_str());
+    std::string list;
+    std::vector<int> ids;
+    if (std::getline(online, list))
+        ids = parseList(list);
+    if (ids.empty())
+    {
+        int count = boost::thread::hardware_concurrency();
+        for (int id = 0; id < std::max(count, 1); id++)
+            ids.push_back(id);
+    }
+
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        std::string path = SYSFS_CPU + "cpu" + boost::lexical_cast<std::string>(ids[i]) + "/topology/";
+        Cpu cpu;
+        cpu.id = ids[i];
+        cpu.node = readNode(ids[i]);
+        cpu.package = readValue(path + "physical_package_id", 0);
+        cpu.core = readValue(path + "core_id", ids[i]);
+        cpu.sibling = 0;
+        topology.cpus.push_back(cpu);
+    }
+    std::sort(topology.cpus.begin(), topology.cpus.end(), byId);
+
+    // Number the siblings of every core in the order of their CPU numbers.
+    for (size_t i = 0; i < topology.cpus.size(); i++)
+    {
+        for (size_t j = 0; j < i; j++)
+        {
+            if (topology.cpus[j].package == topology.cpus[i].package &&
+                topology.cpus[j].core == topology.cpus[i].core)
+                topology.cpus[i].sibling++;
+        }
+    }
+    return topology;
+}
+
+
+int CpuTopology::getNumCores(void) const
+{
+    int cores = 0;
+    for (size_t i = 0; i < cpus.size(); i++)
+        if (cpus[i].sibling == 0)
+            cores++;
+    return cores;
+}
+
+
+int CpuTopology::getNumNodes(void) const
+{
+    std::vector<int> nodes;
+    for (size_t i = 0; i < cpus.size(); i++)
+        if (std::find(nodes.begin(), nodes.end(), cpus[i].node) == nodes.end())
+            nodes.push_back(cpus[i].node);
+    return (int)nodes.size();
+}
+
+
+int CpuTopology::getNode(const int id) const
+{
+    for (size_t i = 0; i < cpus.size(); i++)
+        if (cpus[i].id == id)
+            return cpus[i].node;
+    return 0;
+}
+
+
+std::vector<int> CpuTopology::place(const int num_threads, const bool use_smt) const
+{
+    // Per node, the CPUs in the order they are handed out: first siblings, then
+    // second siblings, and so on.
+    std::vector<int> nodes;
+    std::vector< std::vector<int> > node_cpus;
+    int max_sibling = 0;
+    for (size_t i = 0; i < cpus.size(); i++)
+        max_sibling = std::max(max_sibling, cpus[i].sibling);
+    if (!use_smt)
+        max_sibling = 0;
+    for (int sibling = 0; sibling <= max_sibling; sibling++)
+    {
+        for (size_t i = 0; i < cpus.size(); i++)
+        {
+            if (cpus[i].sibling != sibling)
+                continue;
+            size_t n = std::find(nodes.begin(), nodes.end(), cpus[i].node) - nodes.begin();
+            if (n == nodes.size())
+            {
+                nodes.push_back(cpus[i].node);
+                node_cpus.push_back(std::vector<int>());
+            }
+            node_cpus[n].push_back(cpus[i].id);
+        }
+    }
+
+    // Alternate over the nodes until every CPU is handed out once.
+    std::vector<int> order;
+    for (size_t k = 0; order.size() < (size_t)(use_smt ? cpus.size() : getNumCores()); k++)
+    {
+        for (size_t n = 0; n < node_cpus.size(); n++)
+            if (k < node_cpus[n].size())
+                order.push_back(node_cpus[n][k]);
+    }
+
+    int count = num_threads > 0 ? num_threads : (int)order.size();
+    std::vector<int> placement;
+    for (int i = 0; i < count; i++)
+        placement.push_back(order[i % order.size()]);
+    return placement;
+}
+
+
+bool CpuTopology::pinCurrentThread(const int id)
+{
+    if (id < 0 || id >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(id, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+
+void CpuTopology::write(std::ostream &output) const
+{
+    std::vector<int> nodes;
+    for (size_t i = 0; i < cpus.size(); i++)
+        if (std::find(nodes.begin(), nodes.end(), cpus[i].node) == nodes.end())
+            nodes.push_back(cpus[i].node);
+    std::sort(nodes.begin(), nodes.end());
+
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        output << "Node " << nodes[n] << ":";
+        for (size_t i = 0; i < cpus.size(); i++)
+        {
+            if (cpus[i].node != nodes[n])
+                continue;
+            output << " " << cpus[i].id;
+            if (cpus[i].sibling > 0)
+                output << "(smt)";
+        }
+        output << "\n";
+    }
+}
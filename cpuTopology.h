@@ -0,0 +1,58 @@
+//
+//  cpuTopology.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// The logical CPUs of the machine with their NUMA node, socket, core and SMT sibling,
+// read from /sys/devices/system on Linux.  Used to place worker threads: one per
+// physical core, spread evenly over the NUMA nodes so every node's memory bandwidth
+// is used, with the SMT siblings of the cores added only on request.  Where the
+// topology cannot be read all CPUs are reported as separate cores of node 0.
+#ifndef CPUTOPOLOGY_H
+#define CPUTOPOLOGY_H
+
+#include <vector>
+#include <iostream>
+
+
+class CpuTopology
+{
+public:
+    struct Cpu
+    {
+        int id;         // logical CPU number
+        int node;       // NUMA node
+        int package;    // socket
+        int core;       // core within the socket
+        int sibling;    // SMT sibling within the core, 0 for the first
+    };
+
+    // Read the topology of this machine.
+    static CpuTopology detect(void);
+
+    int     getNumCpus(void) const {return (int)cpus.size();}
+    int     getNumCores(void) const;
+    int     getNumNodes(void) const;
+
+    // Node of logical CPU 'id', or 0 if it is unknown.
+    int     getNode(const int id) const;
+
+    // CPUs for 'num_threads' workers (<= 0 for one per core, or per logical CPU with
+    // 'use_smt').  The first sibling of every core is used before any second sibling,
+    // and consecutive workers alternate over the nodes.  With more workers than
+    // CPUs the list wraps around.
+    std::vector<int> place(const int num_threads, const bool use_smt) const;
+
+    // Bind the calling thread to logical CPU 'id'.  Returns false if that failed,
+    // e.g. on a system without affinity support.
+    static bool pinCurrentThread(const int id);
+
+    // One line per node with its CPUs.
+    void    write(std::ostream &output) const;
+
+private:
+    std::vector<Cpu> cpus;
+};
+
+#endif // CPUTOPOLOGY_H
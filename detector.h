@@ -29,6 +29,11 @@ public:
     virtual void savePhotonExitCoordinates(const boost::shared_ptr<Vector3d> exitCoords) = 0;
     virtual void savePhotonExitWeight(void) = 0;
     
+    // Return the shortest distance from 'point' to the detector surface.  Used
+    // when building the feature distance map of the medium.  The default of zero
+    // is conservative and marks every location as being close to the detector.
+    virtual double distanceToDetector(const coords &point) {return 0.0;}
+    
     virtual void setDetectorPlaneXY(void)
     {
         // Set which plane the detector resides.
@@ -0,0 +1,120 @@
+//
+//  eventCounters.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "eventCounters.h"
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+
+
+
+EventCounters::EventCounters()
+{
+    clear();
+}
+
+
+void EventCounters::clear(void)
+{
+    std::fill(events, events + NUM_EVENTS, 0);
+    std::fill(weights, weights + NUM_WEIGHTS, 0.0);
+    std::fill(step_histogram, step_histogram + NUM_STEP_BINS, 0);
+    max_steps = 0;
+}
+
+
+void EventCounters::merge(const EventCounters &other)
+{
+    for (int i = 0; i < NUM_EVENTS; i++)
+        events[i] += other.events[i];
+    for (int i = 0; i < NUM_WEIGHTS; i++)
+        weights[i] += other.weights[i];
+    for (int i = 0; i < NUM_STEP_BINS; i++)
+        step_histogram[i] += other.step_histogram[i];
+    max_steps = std::max(max_steps, other.max_steps);
+}
+
+
+void EventCounters::countPhoton(const unsigned long steps)
+{
+    // floor(log2(steps + 1)) without a call to log().
+    int bin = 0;
+    for (unsigned long n = steps + 1; n > 1 && bin < NUM_STEP_BINS - 1; n >>= 1)
+        bin++;
+    step_histogram[bin]++;
+    if (steps > max_steps)
+        max_steps = steps;
+}
+
+
+double EventCounters::getEnergyImbalance(void) const
+{
+    if (weights[LAUNCHED_WEIGHT] == 0)
+        return 0.0;
+    double in = weights[LAUNCHED_WEIGHT] + weights[ROULETTE_GAIN];
+    double out = weights[DEPOSITED_WEIGHT] + weights[ESCAPED_WEIGHT] + weights[SPECULAR_WEIGHT] +
+                 weights[ROULETTE_LOSS];
+    return (in - out) / weights[LAUNCHED_WEIGHT];
+}
+
+
+const char * EventCounters::getEventName(const Event event)
+{
+    static const char *names[NUM_EVENTS] = {"photons launched", "steps", "boundary hits",
+                                            "reflections", "transmissions", "absorber entries",
+                                            "roulette kills", "roulette survivals", "detections"};
+    return names[event];
+}
+
+
+void EventCounters::writeSummary(std::ostream &output, const double elapsed) const
+{
+    double photons = events[PHOTONS_LAUNCHED] > 0 ? events[PHOTONS_LAUNCHED] : 1;
+    output << events[PHOTONS_LAUNCHED] << " photons, "
+           << (elapsed > 0 ? events[PHOTONS_LAUNCHED] / elapsed : 0.0) << " photons/s, "
+           << events[STEPS] / photons << " steps/photon, energy imbalance "
+           << getEnergyImbalance() << "\n";
+}
+
+
+void EventCounters::write(std::ostream &output, const double elapsed) const
+{
+    double photons = events[PHOTONS_LAUNCHED] > 0 ? events[PHOTONS_LAUNCHED] : 1;
+
+    output << "photons/s (wall clock)\t" << (elapsed > 0 ? events[PHOTONS_LAUNCHED] / elapsed : 0.0) << "\n";
+    output << "steps/s (wall clock)\t" << (elapsed > 0 ? events[STEPS] / elapsed : 0.0) << "\n";
+    for (int i = 0; i < NUM_EVENTS; i++)
+    {
+        output << getEventName((Event)i) << "\t" << events[i];
+        if (i != PHOTONS_LAUNCHED)
+            output << "\t" << events[i] / photons << " /photon";
+        output << "\n";
+    }
+
+    output << "steps per photon\tphotons\n";
+    int last = NUM_STEP_BINS - 1;
+    while (last > 0 && step_histogram[last] == 0)
+        last--;
+    for (int k = 0; k <= last; k++)
+    {
+        output << "[" << (1UL << k) - 1 << ", ";
+        if (k == NUM_STEP_BINS - 1)
+            output << "inf)";
+        else
+            output << (1UL << (k + 1)) - 1 << ")";
+        output << "\t" << step_histogram[k] << "\n";
+    }
+    output << "max steps\t" << max_steps << "\n";
+
+    output << "energy audit (weight/photon)\n";
+    output << "  launched\t" << weights[LAUNCHED_WEIGHT] / photons << "\n";
+    output << "  roulette gain\t" << weights[ROULETTE_GAIN] / photons << "\n";
+    output << "  deposited\t" << weights[DEPOSITED_WEIGHT] / photons << "\n";
+    output << "  escaped\t" << weights[ESCAPED_WEIGHT] / photons << "\n";
+    output << "  specular\t" << weights[SPECULAR_WEIGHT] / photons << "\n";
+    output << "  roulette loss\t" << weights[ROULETTE_LOSS] / photons << "\n";
+    output << "  imbalance\t" << getEnergyImbalance() << "\n";
+}
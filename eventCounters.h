@@ -0,0 +1,83 @@
+//
+//  eventCounters.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Counts of the events in the photon propagation loop, the distribution of the
+// number of steps per photon and an energy-conservation audit.  Every Photon keeps
+// its own copy, padded to whole cache lines so the copies of different threads never
+// share a line, and adds it to the medium once its photons are done, just like the
+// other running totals.
+//
+// Weight enters the medium at launch and through roulette survivals, and leaves it
+// through absorption, escape, specular reflection and roulette kills, so
+//     launched + roulette gain = deposited + escaped + specular + roulette loss
+// up to rounding.  A larger imbalance points at a bug in the transport code, and the
+// step histogram shows pathologies such as photons trapped at a boundary.
+#ifndef EVENTCOUNTERS_H
+#define EVENTCOUNTERS_H
+
+#include <stdint.h>
+#include <iostream>
+
+
+struct EventCounters
+{
+    enum Event
+    {
+        PHOTONS_LAUNCHED,
+        STEPS,
+        BOUNDARY_HITS,          // steps cut short by a medium boundary
+        REFLECTIONS,            // internal reflections on a layer or medium boundary
+        TRANSMISSIONS,          // photons leaving the medium
+        ABSORBER_ENTRIES,
+        ROULETTE_KILLS,
+        ROULETTE_SURVIVALS,
+        DETECTIONS,
+        NUM_EVENTS
+    };
+
+    enum Weight
+    {
+        LAUNCHED_WEIGHT,
+        DEPOSITED_WEIGHT,
+        ESCAPED_WEIGHT,
+        SPECULAR_WEIGHT,
+        ROULETTE_GAIN,
+        ROULETTE_LOSS,
+        NUM_WEIGHTS
+    };
+
+    // Bin 'k' of the step histogram counts photons taking [2^k - 1, 2^(k+1) - 1) steps.
+    static const int NUM_STEP_BINS = 32;
+
+    EventCounters();
+
+    void    clear(void);
+    void    merge(const EventCounters &other);
+
+    void    count(const Event event) {events[event]++;}
+    void    addWeight(const Weight type, const double weight) {weights[type] += weight;}
+
+    // Add a finished photon that took 'steps' steps to the histogram.
+    void    countPhoton(const unsigned long steps);
+
+    // (in - out) / launched weight of the audit above.
+    double  getEnergyImbalance(void) const;
+
+    // One line with the photon rate, steps per photon and energy imbalance.
+    void    writeSummary(std::ostream &output, const double elapsed) const;
+
+    // Every counter per photon, the step histogram and the energy audit.
+    void    write(std::ostream &output, const double elapsed) const;
+
+    static const char * getEventName(const Event event);
+
+    uint64_t events[NUM_EVENTS];
+    double weights[NUM_WEIGHTS];
+    uint64_t step_histogram[NUM_STEP_BINS];
+    uint64_t max_steps;
+} __attribute__((aligned(64)));
+
+#endif // EVENTCOUNTERS_H
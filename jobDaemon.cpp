@@ -0,0 +1,428 @@
+//
+//  jobDaemon.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "jobDaemon.h"
+#include "checkpointedRun.h"
+#include "resultCache.h"
+#include "liveTallies.h"
+#include "perfCounters.h"
+#include "medium.h"
+#include "tallySet.h"
+#include "timer.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+volatile sig_atomic_t JobDaemon::stop_requested = 0;
+
+// How often the spool is scanned for new jobs and cancellations.
+static const long SCAN_INTERVAL_MS = 200;
+
+
+
+// Return the names of the files in 'dir' ending in 'suffix', with the suffix removed.
+static std::vector<std::string> listFiles(const std::string &dir, const std::string &suffix)
+{
+    std::vector<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return names;
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        std::string name = entry->d_name;
+        if (name[0] == '.' || name.size() <= suffix.size() ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+        names.push_back(name.substr(0, name.size() - suffix.size()));
+    }
+    closedir(d);
+
+    // Jobs dropped in together arrive in name order.
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+
+Job::Job()
+{
+    priority = 0;
+    num_photons = 100000;
+    seed = 1;
+    chunk_size = 1000;
+}
+
+
+bool Job::read(const std::string &filename)
+{
+    std::ifstream input(filename.c_str());
+    if (!input.is_open())
+    {
+        cout << "Error: could not read job " << filename << endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(input, line))
+    {
+        line_number++;
+        std::istringstream values(line);
+        std::string keyword;
+        if (!(values >> keyword) || keyword[0] == '#')
+            continue;
+
+        bool valid;
+        if (keyword == "photons")
+            valid = !(values >> num_photons).fail();
+        else if (keyword == "seed")
+            valid = !(values >> seed).fail();
+        else if (keyword == "chunk-size")
+            valid = !(values >> chunk_size).fail();
+        else if (keyword == "priority")
+            valid = !(values >> priority).fail();
+        else
+            valid = scene.readLine(keyword, values);
+
+        if (!valid)
+        {
+            cout << "Error: " << filename << ":" << line_number << ": invalid line '" << line << "'\n";
+            return false;
+        }
+    }
+
+    if (scene.x_dim <= 0 || scene.y_dim <= 0 || scene.z_dim <= 0 || scene.layers.empty() ||
+        num_photons == 0 || chunk_size == 0)
+    {
+        cout << "Error: " << filename << " needs dimensions, a layer and a number of photons\n";
+        return false;
+    }
+
+    // Absorbers are placed in the layer holding their center.
+    for (size_t i = 0; i < scene.absorbers.size(); i++)
+    {
+        double z = scene.absorbers[i].center.z;
+        bool inside = false;
+        for (size_t j = 0; j < scene.layers.size(); j++)
+            inside = inside || (z >= scene.layers[j].depth_start && z <= scene.layers[j].depth_end);
+        if (!inside)
+        {
+            cout << "Error: " << filename << ": absorber " << i << " lies outside the layers\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+
+JobDaemon::JobDaemon(const std::string &spool_dir, const int num_threads,
+                     const size_t max_cached_scenes)
+: pool(num_threads)
+{
+    this->spool_dir = spool_dir;
+    this->max_cached_scenes = max_cached_scenes > 0 ? max_cached_scenes : 1;
+    num_arrived = 0;
+    num_jobs_run = 0;
+    live_interval = 0;
+    perf_enabled = false;
+    running = NULL;
+    cancel_pending = false;
+}
+
+
+JobDaemon::~JobDaemon()
+{
+    std::map<uint64_t, CachedScene>::iterator it;
+    for (it = scenes.begin(); it != scenes.end(); it++)
+        delete it->second.scene;
+}
+
+
+bool JobDaemon::initialize(void)
+{
+    const char *dirs[] = {"", "/incoming", "/queued", "/cancel", "/done"};
+    for (size_t i = 0; i < sizeof(dirs)/sizeof(dirs[0]); i++)
+    {
+        std::string dir = spool_dir + dirs[i];
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            cout << "Error: could not create " << dir << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void JobDaemon::run(void)
+{
+    // Jobs accepted by a previous daemon that did not finish are run again.
+    std::vector<std::string> queued = listFiles(spool_dir + "/queued", ".job");
+    for (size_t i = 0; i < queued.size(); i++)
+    {
+        Job job;
+        if (job.read(path("queued", queued[i] + ".job")))
+        {
+            job.id = queued[i];
+            queue[std::make_pair(-job.priority, num_arrived++)] = job;
+        }
+    }
+    if (!queued.empty())
+        cout << "Requeued " << queue.size() << " unfinished jobs\n";
+
+    watch_thread = boost::thread(&JobDaemon::watchLoop, this);
+
+    Job job;
+    while (nextJob(job))
+        runJob(job);
+
+    watch_thread.join();
+}
+
+
+void JobDaemon::watchLoop(void)
+{
+    while (!stop_requested)
+    {
+        scanIncoming();
+        scanCancelled();
+        boost::this_thread::sleep(boost::posix_time::milliseconds(SCAN_INTERVAL_MS));
+    }
+
+    // The interrupted job stays in queued/ and is run again after a restart.
+    boost::mutex::scoped_lock lock(m_mutex);
+    if (running)
+        running->cancel();
+    job_available.notify_all();
+}
+
+
+void JobDaemon::scanIncoming(void)
+{
+    std::vector<std::string> incoming = listFiles(spool_dir + "/incoming", ".job");
+    for (size_t i = 0; i < incoming.size(); i++)
+    {
+        const std::string &id = incoming[i];
+        std::string queued_file = path("queued", id + ".job");
+        if (rename(path("incoming", id + ".job").c_str(), queued_file.c_str()) != 0)
+            continue;
+
+        Job job;
+        if (!job.read(queued_file))
+        {
+            remove(queued_file.c_str());
+            writeStatus(id, "failed: invalid job file");
+            continue;
+        }
+        job.id = id;
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        queue[std::make_pair(-job.priority, num_arrived++)] = job;
+        job_available.notify_one();
+    }
+}
+
+
+void JobDaemon::scanCancelled(void)
+{
+    std::vector<std::string> cancelled = listFiles(spool_dir + "/cancel", "");
+    for (size_t i = 0; i < cancelled.size(); i++)
+    {
+        const std::string &id = cancelled[i];
+        boost::mutex::scoped_lock lock(m_mutex);
+
+        // The running job removes the request itself once its chunks have drained.
+        if (id == running_id)
+        {
+            if (running)
+                running->cancel();
+            else
+                cancel_pending = true;
+            continue;
+        }
+
+        std::map<std::pair<int, unsigned long>, Job>::iterator it;
+        for (it = queue.begin(); it != queue.end(); it++)
+        {
+            if (it->second.id == id)
+                break;
+        }
+        if (it != queue.end())
+        {
+            queue.erase(it);
+            remove(path("queued", id + ".job").c_str());
+            writeStatus(id, "cancelled");
+            cout << "Job " << id << " cancelled\n";
+        }
+
+        // Requests for unknown or finished jobs are dropped.
+        remove(path("cancel", id).c_str());
+    }
+}
+
+
+bool JobDaemon::nextJob(Job &job)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    while (queue.empty() && !stop_requested)
+        job_available.timed_wait(lock, boost::posix_time::milliseconds(SCAN_INTERVAL_MS));
+    if (stop_requested)
+        return false;
+
+    job = queue.begin()->second;
+    queue.erase(queue.begin());
+    running_id = job.id;
+    cancel_pending = false;
+    return true;
+}
+
+
+Scene * JobDaemon::getScene(const SceneDescription &description, bool &cached)
+{
+    cached = false;
+    uint64_t key = description.hash();
+    std::map<uint64_t, CachedScene>::iterator it = scenes.find(key);
+    if (it != scenes.end())
+    {
+        // Guard against hash collisions by comparing the full descriptions.
+        std::ostringstream cached_text, text;
+        it->second.scene->getDescription().write(cached_text);
+        description.write(text);
+        if (cached_text.str() == text.str())
+        {
+            it->second.last_used = num_jobs_run;
+            cached = true;
+            return it->second.scene;
+        }
+        delete it->second.scene;
+        scenes.erase(it);
+    }
+
+    // Evict the least recently used scene.
+    if (scenes.size() >= max_cached_scenes)
+    {
+        std::map<uint64_t, CachedScene>::iterator oldest = scenes.begin();
+        for (it = scenes.begin(); it != scenes.end(); it++)
+        {
+            if (it->second.last_used < oldest->second.last_used)
+                oldest = it;
+        }
+        delete oldest->second.scene;
+        scenes.erase(oldest);
+    }
+
+    CachedScene entry;
+    entry.scene = new Scene(description);
+    entry.last_used = num_jobs_run;
+    scenes[key] = entry;
+    return entry.scene;
+}
+
+
+void JobDaemon::runJob(const Job &job)
+{
+    double start = getWallTime();
+    num_jobs_run++;
+    bool cached;
+    Scene *scene = getScene(job.scene, cached);
+
+    Medium *medium = scene->getMedium();
+    medium->clearTallies();
+
+    CheckpointedRun run(pool, scene, job.chunk_size, job.seed);
+    unsigned long restored = 0;
+    if (!cache_dir.empty())
+    {
+        ResultCache cache(cache_dir);
+        restored = cache.attach(run, job.scene, job.num_photons);
+    }
+    LiveTallyWriter live_writer("mc-boost-job-" + job.id);
+    if (live_interval > 0)
+        run.setLiveTallies(&live_writer, live_interval);
+    if (perf_enabled)
+        run.enablePerfCounters();
+
+    // Compiling the scene and attaching the cache can take a while, so a cancel or
+    // stop may have arrived since the job left the queue.
+    bool started;
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        if (cancel_pending)
+            run.cancel();
+        started = !cancel_pending && !stop_requested;
+        if (started)
+            running = &run;
+    }
+    if (started && restored < job.num_photons)
+        run.run(job.num_photons);
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        running = NULL;
+        running_id.clear();
+        cancel_pending = false;
+    }
+
+    if (stop_requested)
+        return;
+
+    remove(path("queued", job.id + ".job").c_str());
+    if (run.isCancelled())
+    {
+        remove(path("cancel", job.id).c_str());
+        writeStatus(job.id, "cancelled");
+        cout << "Job " << job.id << " cancelled after " << run.getNumCompleted() << " photons\n";
+        return;
+    }
+
+    TallySet tallies;
+    tallies.capture(medium);
+    if (!tallies.writeSummary(spool_dir + "/done/" + job.id))
+    {
+        cout << "Error: could not write the results of job " << job.id << endl;
+        writeStatus(job.id, "failed: could not write results");
+        return;
+    }
+    writeStatus(job.id, "completed");
+
+    cout << "Job " << job.id << ": " << job.num_photons << " photons in "
+         << getWallTime() - start << " s" << (cached ? " (cached scene)" : "");
+    if (restored > 0)
+        cout << " (" << restored << " photons from the result cache)";
+    cout << endl;
+
+    if (perf_enabled)
+    {
+        // Restored photons were not propagated, so only the new ones count.
+        EventCounters events = medium->getEventCounters();
+        run.getPerfCounts().write(cout, events.events[EventCounters::PHOTONS_LAUNCHED],
+                                  events.events[EventCounters::STEPS]);
+    }
+}
+
+
+void JobDaemon::writeStatus(const std::string &id, const std::string &status)
+{
+    std::string filename = path("done", id + ".status");
+    std::string temp_file = filename + ".tmp";
+    std::ofstream output(temp_file.c_str());
+    output << status << "\n";
+    output.close();
+    if (output.fail() || rename(temp_file.c_str(), filename.c_str()) != 0)
+        cout << "Error: could not write " << filename << endl;
+}
@@ -0,0 +1,147 @@
+//
+//  jobDaemon.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Long-running job server behind mc-boost-daemon.  Jobs are dropped as text files into
+// a spool directory and run one after another on a worker pool that lives as long as
+// the daemon, so a small job costs its photons and little else.  Compiled scenes are
+// cached by the hash of their description and reused by later jobs with the same scene.
+//
+// Spool layout:
+//     incoming/<id>.job    written by clients (write elsewhere and rename into place)
+//     queued/<id>.job      accepted jobs; jobs left here are run again after a restart
+//     cancel/<id>          created by clients to cancel a queued or running job
+//     done/<id>.txt        tallies of a finished job (and done/<id>-radial.txt)
+//     done/<id>.status     "completed", "cancelled" or "failed: <reason>", written last
+//
+// A job file holds the scene in the text form of SceneDescription plus the keywords
+//     photons <number>     (default 100000)
+//     seed <number>        (default 1)
+//     chunk-size <photons> (default 1000)
+//     priority <number>    (default 0, higher runs first, ties in order of arrival)
+// Empty lines and lines starting with '#' are ignored.
+#ifndef JOBDAEMON_H
+#define JOBDAEMON_H
+
+#include "scene.h"
+#include "workerPool.h"
+#include <stdint.h>
+#include <csignal>
+#include <map>
+#include <string>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+class CheckpointedRun;
+
+
+struct Job
+{
+    Job();
+
+    std::string id;
+    int priority;
+    unsigned long num_photons;
+    uint64_t seed;
+    unsigned long chunk_size;
+    SceneDescription scene;
+
+    // Parse a job file.  Prints the problem and returns false if it is malformed.
+    bool    read(const std::string &filename);
+};
+
+
+class JobDaemon
+{
+public:
+    // Run jobs from 'spool_dir' on 'num_threads' workers (<= 0 uses one per core),
+    // keeping up to 'max_cached_scenes' compiled scenes.
+    JobDaemon(const std::string &spool_dir, const int num_threads, const size_t max_cached_scenes);
+    ~JobDaemon();
+
+    // Reuse and store results in the ResultCache in 'directory'.
+    void    setResultCache(const std::string &directory) {cache_dir = directory;}
+
+    // Publish the tallies of the running job as '/mc-boost-job-<id>' every 'interval'
+    // seconds (see mc-boost-watch).
+    void    setLiveTallies(const double interval) {live_interval = interval;}
+
+    // Log the hardware performance counters of every job (see perfCounters.h).
+    void    enablePerfCounters(void) {perf_enabled = true;}
+
+    // Create the spool directories.  Returns false if that failed.
+    bool    initialize(void);
+
+    // Serve jobs until stop() is called.  A job interrupted by stop() stays queued.
+    void    run(void);
+
+    // Only sets a flag, so it may be called from a signal handler.
+    static void stop(void) {stop_requested = 1;}
+
+private:
+    struct CachedScene
+    {
+        Scene *scene;
+        unsigned long last_used;
+    };
+
+    // Main loop of the thread watching the spool for new jobs and cancellations.
+    void    watchLoop(void);
+    void    scanIncoming(void);
+    void    scanCancelled(void);
+
+    // Take the job with the highest priority off the queue.  Waits for one to arrive
+    // and returns false if the daemon is stopping.
+    bool    nextJob(Job &job);
+
+    void    runJob(const Job &job);
+
+    // Return the compiled scene of 'description', compiling it on a cache miss.
+    Scene * getScene(const SceneDescription &description, bool &cached);
+
+    // Write done/<id>.status, replacing it atomically.
+    void    writeStatus(const std::string &id, const std::string &status);
+
+    std::string path(const std::string &dir, const std::string &file) const
+                    {return spool_dir + "/" + dir + "/" + file;}
+
+    std::string spool_dir;
+    WorkerPool pool;
+
+    // Accepted jobs ordered on (-priority, arrival).
+    std::map<std::pair<int, unsigned long>, Job> queue;
+    unsigned long num_arrived;
+
+    // The job being run, so the watcher can cancel it.  'running_id' is set as soon as
+    // the job leaves the queue, and 'running' once its run has been set up; a cancel
+    // request arriving in between sets 'cancel_pending'.
+    std::string running_id;
+    CheckpointedRun *running;
+    bool cancel_pending;
+
+    // Guards the queue and the running job.
+    boost::mutex m_mutex;
+    boost::condition_variable job_available;
+
+    // Compiled scenes by description hash.  Only used by the thread running jobs.
+    std::map<uint64_t, CachedScene> scenes;
+    size_t max_cached_scenes;
+    unsigned long num_jobs_run;
+
+    // Directory of the result cache, empty for none.
+    std::string cache_dir;
+
+    // Interval of the live tally snapshots, zero for none.
+    double live_interval;
+
+    // Set to log the hardware counters of every job.
+    bool perf_enabled;
+
+    boost::thread watch_thread;
+    static volatile sig_atomic_t stop_requested;
+};
+
+#endif // JOBDAEMON_H
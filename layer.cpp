@@ -176,6 +176,19 @@ Absorber * Layer::getAbsorber(const boost::shared_ptr<Vector3d> photonVector)
     return NULL;
 }
 
+double Layer::getDistanceToAbsorber(const coords &point)
+{
+    double min_dist = -1;
+    for (std::vector<Absorber *>::iterator it = p_absorbers.begin(); it != p_absorbers.end(); it++)
+    {
+        double dist = (*it)->distanceToAbsorber(point);
+        if (min_dist < 0 || dist < min_dist)
+            min_dist = dist;
+    }
+    
+    return min_dist;
+}
+
 // Iterate over all absorbers and write their data out to file.
 void Layer::writeAbsorberData(void)
 {
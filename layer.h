@@ -52,10 +52,15 @@ public:
 
 	void	setAbsorpCoeff(const double mu_a);
 	void	setScatterCoeff(const double mu_s);
+	void	setAnisotropy(const double g) {this->g = g;}
+	void	setRefractiveIndex(const double n) {refractive_index = n;}
 	void	updateAlbedo();
     
     void    addAbsorber(Absorber * a);
     
+    // Return the absorbers of this layer in the order they were added.
+    const std::vector<Absorber *> & getAbsorbers(void) const {return p_absorbers;}
+    
     void    updateAbsorbedWeightByAbsorber(const boost::shared_ptr<Vector3d> currLocation, const double absorbed);
     
     // Iterate over all absorbers and write their data out to file.
@@ -64,6 +69,10 @@ public:
     // Return the absorber at this location 'currLocation' in the medium.
     Absorber * getAbsorber(const boost::shared_ptr<Vector3d> currLocation);
     
+    // Return the shortest distance from 'point' to any absorber in this layer.
+    // Returns -1 if the layer holds no absorbers.
+    double  getDistanceToAbsorber(const coords &point);
+    
 
 	
 private:
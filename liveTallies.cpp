@@ -0,0 +1,313 @@
+//
+//  liveTallies.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "liveTallies.h"
+#include "tallySet.h"
+#include "radialTally.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <boost/scoped_ptr.hpp>
+using std::cout;
+using std::endl;
+
+
+// Identifies the segment and its layout version.
+static const char LIVE_MAGIC[8] = {'M', 'C', 'L', 'I', 'V', 'E', '0', '2'};
+
+// A reader gives up after this many attempts 1 ms apart, e.g. when the writer died
+// while updating the segment.
+static const int MAX_READ_ATTEMPTS = 1000;
+
+
+// Start of the segment, followed by the arrays
+//     double absorber_weight[num_absorbers]
+//     double reflectance[num_radial_bins], reflectance_error[num_radial_bins]
+//     double transmittance[num_radial_bins]
+//     double absorption[num_radial_bins * num_depth_bins]
+// and the same four arrays for every pyramid level, with the grid of level 'l'
+// 2^(l+1) times coarser (rounded up) along both axes.
+struct LiveTallyHeader
+{
+    char magic[8];
+    volatile uint64_t sequence;
+    uint32_t finished;
+    uint32_t num_absorbers;
+    int32_t num_radial_bins;
+    int32_t num_depth_bins;
+    uint32_t num_levels;
+    uint32_t reserved;
+    uint64_t num_photons;
+    uint64_t target_photons;
+    uint64_t num_detected;
+    double elapsed;
+    double steps_per_photon;
+    double detected_weight;
+    double detected_weight_error;
+    double absorber_weight_error;
+    double radial_bin_size;
+    double depth_bin_size;
+};
+
+
+static size_t segmentSize(const uint32_t num_absorbers, const int num_r, const int num_z,
+                          const uint32_t num_levels)
+{
+    size_t values = num_absorbers + 3*num_r + num_r*num_z;
+    for (uint32_t l = 0; l < num_levels; l++)
+    {
+        int factor = RadialTally::getLevelFactor(l);
+        int nr = (num_r + factor - 1) / factor;
+        int nz = (num_z + factor - 1) / factor;
+        values += 3*nr + nr*nz;
+    }
+    return sizeof(LiveTallyHeader) + sizeof(double) * values;
+}
+
+
+// Copy the normalized R(r), its error, T(r) and A(r,z) to 'values'.  Returns the end.
+static double * copyRadialTally(const RadialTally &tally, double *values)
+{
+    std::vector<double> R = tally.getReflectance();
+    std::vector<double> R_error = tally.getReflectanceStdError();
+    std::vector<double> T = tally.getTransmittance();
+    std::vector<double> A = tally.getAbsorption();
+    values = std::copy(R.begin(), R.end(), values);
+    values = std::copy(R_error.begin(), R_error.end(), values);
+    values = std::copy(T.begin(), T.end(), values);
+    return std::copy(A.begin(), A.end(), values);
+}
+
+
+
+LiveTallySnapshot::LiveTallySnapshot()
+{
+    sequence = 0;
+    finished = false;
+    num_photons = target_photons = num_detected = 0;
+    elapsed = steps_per_photon = 0;
+    detected_weight = detected_weight_error = absorber_weight_error = 0;
+    num_radial_bins = num_depth_bins = 0;
+    radial_bin_size = depth_bin_size = 0;
+}
+
+
+
+LiveTallyWriter::LiveTallyWriter(const std::string &name)
+{
+    this->name = name;
+    segment = NULL;
+    size = 0;
+}
+
+
+LiveTallyWriter::~LiveTallyWriter()
+{
+    if (segment)
+    {
+        munmap(segment, size);
+        shm_unlink(("/" + name).c_str());
+    }
+}
+
+
+bool LiveTallyWriter::publish(const TallySet &tallies, const unsigned long target_photons,
+                              const double elapsed, const bool finished)
+{
+    const RadialTally *radial_tally = tallies.getRadialTally();
+    uint32_t num_absorbers = tallies.getAbsorberWeights().size();
+    int num_r = radial_tally ? radial_tally->getNumRadialBins() : 0;
+    int num_z = radial_tally ? radial_tally->getNumDepthBins() : 0;
+    uint32_t num_levels = radial_tally ? radial_tally->getNumPyramidLevels() : 0;
+
+    if (!segment)
+    {
+        size = segmentSize(num_absorbers, num_r, num_z, num_levels);
+        int fd = shm_open(("/" + name).c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0 || ftruncate(fd, size) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            cout << "Error: could not create shared memory segment /" << name << endl;
+            return false;
+        }
+        segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (segment == MAP_FAILED)
+        {
+            segment = NULL;
+            cout << "Error: could not map shared memory segment /" << name << endl;
+            return false;
+        }
+        memset(segment, 0, size);
+    }
+    else if (size != segmentSize(num_absorbers, num_r, num_z, num_levels))
+        return false;
+
+    LiveTallyHeader *header = (LiveTallyHeader *)segment;
+    double *values = (double *)(header + 1);
+
+    // Odd while the segment is being written.
+    header->sequence++;
+    __sync_synchronize();
+
+    double photons = tallies.getNumPhotons() > 0 ? tallies.getNumPhotons() : 1;
+    header->finished = finished;
+    header->num_absorbers = num_absorbers;
+    header->num_radial_bins = num_r;
+    header->num_depth_bins = num_z;
+    header->num_levels = num_levels;
+    header->num_photons = tallies.getNumPhotons();
+    header->target_photons = target_photons;
+    header->num_detected = tallies.getNumDetected();
+    header->elapsed = elapsed;
+    header->steps_per_photon = tallies.getTotalSteps() / photons;
+    header->detected_weight = tallies.getDetectedWeight() / photons;
+    header->detected_weight_error = tallies.getDetectedWeightStdError();
+    header->absorber_weight_error = tallies.getAbsorberWeightStdError();
+    header->radial_bin_size = radial_tally ? radial_tally->getRadialBinSize() : 0;
+    header->depth_bin_size = radial_tally ? radial_tally->getDepthBinSize() : 0;
+
+    for (uint32_t i = 0; i < num_absorbers; i++)
+        *values++ = tallies.getAbsorberWeights()[i] / photons;
+    if (radial_tally)
+    {
+        values = copyRadialTally(*radial_tally, values);
+        for (uint32_t l = 0; l < num_levels; l++)
+        {
+            boost::scoped_ptr<RadialTally> level(radial_tally->getLevel(l));
+            values = copyRadialTally(*level, values);
+        }
+    }
+
+    __sync_synchronize();
+    memcpy(header->magic, LIVE_MAGIC, sizeof(LIVE_MAGIC));
+    header->sequence++;
+
+    return true;
+}
+
+
+
+LiveTallyReader::LiveTallyReader()
+{
+    segment = NULL;
+    size = 0;
+}
+
+
+LiveTallyReader::~LiveTallyReader()
+{
+    if (segment)
+        munmap(segment, size);
+}
+
+
+bool LiveTallyReader::attach(const std::string &name)
+{
+    if (segment)
+    {
+        munmap(segment, size);
+        segment = NULL;
+    }
+
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(LiveTallyHeader))
+    {
+        close(fd);
+        return false;
+    }
+    size = info.st_size;
+    segment = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED)
+    {
+        segment = NULL;
+        return false;
+    }
+    return true;
+}
+
+
+bool LiveTallyReader::read(LiveTallySnapshot &snapshot) const
+{
+    if (!segment)
+        return false;
+
+    const LiveTallyHeader *header = (const LiveTallyHeader *)segment;
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++)
+    {
+        uint64_t sequence = header->sequence;
+        __sync_synchronize();
+        if (sequence == 0)
+            return false;
+        if (sequence & 1)
+        {
+            usleep(1000);
+            continue;
+        }
+
+        // Copy the segment, then check that the writer did not update it meanwhile.
+        LiveTallyHeader h = *header;
+        if (memcmp(h.magic, LIVE_MAGIC, sizeof(LIVE_MAGIC)) != 0 || h.num_radial_bins < 0 ||
+            h.num_depth_bins < 0 || h.num_levels > 32 ||
+            segmentSize(h.num_absorbers, h.num_radial_bins, h.num_depth_bins, h.num_levels) != size)
+            return false;
+        const double *values = (const double *)(header + 1);
+        int num_r = h.num_radial_bins;
+        int num_z = h.num_depth_bins;
+        snapshot.absorber_weight.assign(values, values + h.num_absorbers);
+        values += h.num_absorbers;
+        snapshot.reflectance.assign(values, values + num_r);
+        snapshot.reflectance_error.assign(values + num_r, values + 2*num_r);
+        snapshot.transmittance.assign(values + 2*num_r, values + 3*num_r);
+        snapshot.absorption.assign(values + 3*num_r, values + 3*num_r + num_r*num_z);
+        values += 3*num_r + num_r*num_z;
+
+        snapshot.levels.resize(h.num_levels);
+        for (uint32_t l = 0; l < h.num_levels; l++)
+        {
+            LiveTallyLevel &level = snapshot.levels[l];
+            level.factor = RadialTally::getLevelFactor(l);
+            int nr = level.num_radial_bins = (num_r + level.factor - 1) / level.factor;
+            int nz = level.num_depth_bins = (num_z + level.factor - 1) / level.factor;
+            level.reflectance.assign(values, values + nr);
+            level.reflectance_error.assign(values + nr, values + 2*nr);
+            level.transmittance.assign(values + 2*nr, values + 3*nr);
+            level.absorption.assign(values + 3*nr, values + 3*nr + nr*nz);
+            values += 3*nr + nr*nz;
+        }
+
+        __sync_synchronize();
+        if (header->sequence != sequence)
+            continue;
+
+        snapshot.sequence = sequence / 2;
+        snapshot.finished = h.finished != 0;
+        snapshot.num_photons = h.num_photons;
+        snapshot.target_photons = h.target_photons;
+        snapshot.elapsed = h.elapsed;
+        snapshot.num_detected = h.num_detected;
+        snapshot.steps_per_photon = h.steps_per_photon;
+        snapshot.detected_weight = h.detected_weight;
+        snapshot.detected_weight_error = h.detected_weight_error;
+        snapshot.absorber_weight_error = h.absorber_weight_error;
+        snapshot.num_radial_bins = h.num_radial_bins;
+        snapshot.num_depth_bins = h.num_depth_bins;
+        snapshot.radial_bin_size = h.radial_bin_size;
+        snapshot.depth_bin_size = h.depth_bin_size;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,112 @@
+//
+//  liveTallies.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Snapshots of the tallies of a run in progress, published in a POSIX shared-memory
+// segment so other processes can watch a long run without stopping it.  The run
+// copies its tallies under the same short exclusive lock as a checkpoint and then
+// writes them to the segment; readers never take a lock, so attaching a reader does
+// not affect the workers.
+//
+// The segment is guarded by a sequence counter (a seqlock): the writer makes it odd
+// before and even again after updating the segment, and a reader retries until it
+// copied the data between two reads of the same even sequence.
+#ifndef LIVETALLIES_H
+#define LIVETALLIES_H
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+class TallySet;
+
+
+// A coarser pyramid level of the pencil-beam tallies (see RadialTally::getLevel()).
+struct LiveTallyLevel
+{
+    int factor;
+    int num_radial_bins, num_depth_bins;
+    std::vector<double> reflectance, reflectance_error;
+    std::vector<double> transmittance;
+    std::vector<double> absorption;
+};
+
+
+// A snapshot of the tallies, normalized per propagated photon.
+struct LiveTallySnapshot
+{
+    LiveTallySnapshot();
+
+    // Incremented by every snapshot published.
+    uint64_t sequence;
+
+    // Set by the last snapshot of a run.
+    bool finished;
+
+    unsigned long num_photons;
+    unsigned long target_photons;
+    double elapsed;                 // [s]
+    unsigned long num_detected;
+    double steps_per_photon;
+
+    double detected_weight, detected_weight_error;
+
+    // Weight absorbed in every absorber of the medium, and the error of their total.
+    std::vector<double> absorber_weight;
+    double absorber_weight_error;
+
+    // Pencil-beam tallies R(r), T(r) and A(r,z) with 'z' varying fastest, empty if
+    // the run has none.
+    int num_radial_bins, num_depth_bins;
+    double radial_bin_size, depth_bin_size;
+    std::vector<double> reflectance, reflectance_error;
+    std::vector<double> transmittance;
+    std::vector<double> absorption;
+
+    // The pyramid levels of the pencil-beam tallies, finest first.
+    std::vector<LiveTallyLevel> levels;
+};
+
+
+class LiveTallyWriter
+{
+public:
+    // Publish to the segment '/<name>'.  It is created by the first publish() and
+    // removed when the writer is destroyed; attached readers keep the last snapshot.
+    LiveTallyWriter(const std::string &name);
+    ~LiveTallyWriter();
+
+    // Publish the tallies of a run aiming for 'target_photons' photons.  Returns false
+    // if the segment could not be created or the layout of the tallies changed.
+    bool    publish(const TallySet &tallies, const unsigned long target_photons,
+                    const double elapsed, const bool finished);
+
+    const std::string & getName(void) const {return name;}
+
+private:
+    std::string name;
+    void *segment;
+    size_t size;
+};
+
+
+class LiveTallyReader
+{
+public:
+    LiveTallyReader();
+    ~LiveTallyReader();
+
+    // Attach to the segment '/<name>'.  Returns false if no run publishes it.
+    bool    attach(const std::string &name);
+
+    // Copy a consistent snapshot.  Returns false if not attached.
+    bool    read(LiveTallySnapshot &snapshot) const;
+
+private:
+    void *segment;
+    size_t size;
+};
+
+#endif // LIVETALLIES_H
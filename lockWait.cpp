@@ -0,0 +1,51 @@
+//
+//  lockWait.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "lockWait.h"
+#include "timer.h"
+
+
+// Total wait of every thread.  A plain thread-local double, since it is read and
+// written by its own thread only.
+static __thread double thread_lock_wait = 0;
+
+
+
+double LockWait::getThreadTotal(void)
+{
+    return thread_lock_wait;
+}
+
+
+void LockWait::add(const double seconds)
+{
+    thread_lock_wait += seconds;
+}
+
+
+
+TimedLock::TimedLock(boost::mutex &mutex)
+: lock(mutex, boost::try_to_lock)
+{
+    if (!lock.owns_lock())
+    {
+        double start = getWallTime();
+        lock.lock();
+        LockWait::add(getWallTime() - start);
+    }
+}
+
+
+TimedSharedLock::TimedSharedLock(boost::shared_mutex &mutex)
+: lock(mutex, boost::try_to_lock)
+{
+    if (!lock.owns_lock())
+    {
+        double start = getWallTime();
+        lock.lock();
+        LockWait::add(getWallTime() - start);
+    }
+}
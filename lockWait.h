@@ -0,0 +1,53 @@
+//
+//  lockWait.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Accounting of the time threads spend waiting for the mutexes guarding shared
+// tallies (the medium, absorbers, the Logger and the bookkeeping of a
+// CheckpointedRun), which limits how well a run scales
+// with the number of threads.  A TimedLock first tries to take the mutex, so an
+// uncontended lock costs nothing extra; only when the mutex is held by another thread
+// is the wait timed and added to a total of the calling thread.
+#ifndef LOCKWAIT_H
+#define LOCKWAIT_H
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+
+class LockWait
+{
+public:
+    // Seconds the calling thread has waited for contended locks since it started.
+    static double getThreadTotal(void);
+
+    // Add 'seconds' to the total of the calling thread.
+    static void add(const double seconds);
+};
+
+
+// Drop-in replacement of boost::mutex::scoped_lock that times contended waits.
+class TimedLock
+{
+public:
+    TimedLock(boost::mutex &mutex);
+
+private:
+    boost::unique_lock<boost::mutex> lock;
+};
+
+
+// As TimedLock, for a shared lock of 'mutex'.
+class TimedSharedLock
+{
+public:
+    TimedSharedLock(boost::shared_mutex &mutex);
+
+private:
+    boost::shared_lock<boost::shared_mutex> lock;
+};
+
+#endif // LOCKWAIT_H
@@ -9,6 +9,8 @@
 #include "vector3D.h"
 #include "photon.h"
 #include "logger.h"
+#include "traceRecorder.h"
+#include "lockWait.h"
 
 
 
@@ -69,7 +71,7 @@ void Logger::write(double val)
 {
     // Grab the lock to ensure that the logger doesn't get interrupted by a thread
     // in the middle of a write, causing the output to be corrupted.
-    boost::mutex::scoped_lock lock(m_mutex);
+    TimedLock lock(m_mutex);
 
     exit_data_stream << "val = " << val << endl;
 }
@@ -89,9 +91,11 @@ void Logger::writeMetaData(const double absorberRadius, const double detectorRad
 
 void Logger::writeExitData(const boost::shared_ptr<Vector3d> photonVector)
 {
+    TraceScope trace(TraceRecorder::LOGGER_WRITE);
+    
     // Grab the lock to ensure that the logger doesn't get interrupted by a thread
     // in the middle of a write, causing the output to be corrupted.
-    boost::mutex::scoped_lock lock(m_mutex);   
+    TimedLock lock(m_mutex);
     
     exit_data_stream << photonVector;
     exit_data_stream.flush();
@@ -102,9 +106,11 @@ void Logger::writeExitData(const boost::shared_ptr<Vector3d> photonVector,
                    const double weight,
                    bool tagged)
 {
+    TraceScope trace(TraceRecorder::LOGGER_WRITE);
+    
     // Grab the lock to ensure that the logger doesn't get interrupted by a thread
     // in the middle of a write, causing the output to be corrupted.
-    boost::mutex::scoped_lock lock(m_mutex);
+    TimedLock lock(m_mutex);
     
     // Write out the location (x,y,z), exit angle (theta), weight of photon, and whether it was
     // tagged.
@@ -121,9 +127,11 @@ void Logger::writeExitData(const boost::shared_ptr<Vector3d> photonVector,
 void Logger::writeExitData(const boost::shared_ptr<Vector3d> photonVector,
                            const double weight)
 {
+    TraceScope trace(TraceRecorder::LOGGER_WRITE);
+    
     // Grab the lock to ensure that the logger doesn't get interrupted by a thread
     // in the middle of a write, causing the output to be corrupted.
-    boost::mutex::scoped_lock lock(m_mutex);
+    TimedLock lock(m_mutex);
     
     // Write out the location (x,y,z), exit angle (theta), weight of photon, and whether it was
     // tagged.
@@ -139,9 +147,11 @@ void Logger::writeExitData(const boost::shared_ptr<Vector3d> photonVector,
                            const double weight,
                            const double transmissionAngle)
 {
+    TraceScope trace(TraceRecorder::LOGGER_WRITE);
+    
     // Grab the lock to ensure that the logger doesn't get interrupted by a thread
     // in the middle of a write, causing the output to be corrupted.
-    boost::mutex::scoped_lock lock(m_mutex);
+    TimedLock lock(m_mutex);
     
     // Write out the location (x,y,z), transmission angle (theta), weight of photon
     exit_data_stream << weight << "," 
@@ -158,9 +168,11 @@ void Logger::writeWeightAngleLengthCoords(const double exitWeight,
                                           const double modulatedPathLength,
                                           const boost::shared_ptr<Vector3d> photonVector)
 {
+    TraceScope trace(TraceRecorder::LOGGER_WRITE);
+    
     // Grab the lock to ensure that the logger doesn't get interrupted by a thread
     // in the middle of a write, causing the output to be corrupted.
-    boost::mutex::scoped_lock lock(m_mutex);
+    TimedLock lock(m_mutex);
     
     // Write out the location (x,y,z), transmission angle (theta), weight of photon
     exit_data_stream << exitWeight << "," 
@@ -178,7 +190,7 @@ void Logger::writePhoton(Photon *p)
 {
     // Grab the lock to ensure that the logger doesn't get interrupted by a thread
     // in the middle of a write, causing the output to be corrupted.
-    boost::mutex::scoped_lock lock(m_mutex);
+    TimedLock lock(m_mutex);
     
     cout << "Logger::writePhoton() stub\n";
 }
@@ -186,6 +198,8 @@ void Logger::writePhoton(Photon *p)
 
 void Logger::writeAbsorberData(const double absorbedWeight)
 {
+    TraceScope trace(TraceRecorder::LOGGER_WRITE);
+    
     absorber_data_stream << absorbedWeight << "\n";
     absorber_data_stream.flush();
 }
@@ -0,0 +1,291 @@
+//
+//  lookupTable.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "lookupTable.h"
+#include "workerPool.h"
+#include "photon.h"
+#include "medium.h"
+#include "layer.h"
+#include "radialTally.h"
+#include <boost/bind.hpp>
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// Identifies the binary table file and its layout version.
+static const char TABLE_MAGIC[8] = {'M', 'C', 'L', 'U', 'T', '0', '0', '1'};
+
+
+
+ReflectanceTable::ReflectanceTable()
+{
+    photons_per_point = 0;
+    photons = NULL;
+    source_x = source_y = 0;
+}
+
+
+ReflectanceTable::~ReflectanceTable()
+{
+    // STUB
+}
+
+
+bool ReflectanceTable::generate(const std::vector<double> &mu_a,
+                                const std::vector<double> &mu_s_reduced,
+                                const std::vector<double> &g,
+                                const std::vector<double> &n,
+                                const int num_rho, const double drho,
+                                const int num_photons, WorkerPool &pool)
+{
+    // mu_s = mu_s' / (1 - g) has no value for g = 1.
+    for (size_t i = 0; i < g.size(); i++)
+    {
+        if (g[i] >= 1.0)
+        {
+            cout << "Error: anisotropy " << g[i] << " of the lookup table is not below 1\n";
+            return false;
+        }
+    }
+
+    axes[MU_A] = mu_a;
+    axes[MU_S_REDUCED] = mu_s_reduced;
+    axes[ANISOTROPY] = g;
+    axes[REFRACTIVE_INDEX] = n;
+    axes[RHO].resize(num_rho);
+    for (int i = 0; i < num_rho; i++)
+        axes[RHO][i] = (i + 0.5)*drho;
+    photons_per_point = num_photons;
+
+    int num_points = mu_a.size() * mu_s_reduced.size() * g.size() * n.size();
+    values.assign(num_points * num_rho, 0.0f);
+
+    // All grid points share one geometry, sized from the largest transport mean free
+    // path in the grid, so the medium is effectively semi-infinite for every point.
+    double max_mfp = 1.0 / (*std::min_element(mu_a.begin(), mu_a.end()) +
+                            *std::min_element(mu_s_reduced.begin(), mu_s_reduced.end()));
+    double Z_dim = 20.0 * max_mfp;
+    double X_dim = 2.0 * (num_rho*drho + 20.0*max_mfp);
+    double Y_dim = X_dim;
+    source_x = X_dim/2;
+    source_y = Y_dim/2;
+
+    // Compile one scene per worker.  The extra radial bin collects the weight beyond
+    // the last source-detector distance of the table.
+    int num_workers = pool.getNumThreads();
+    scenes.resize(num_workers);
+    scene_layers.resize(num_workers);
+    photons = new Photon[num_workers];
+    for (int w = 0; w < num_workers; w++)
+    {
+        scenes[w] = new Medium(X_dim, Y_dim, Z_dim);
+        scene_layers[w] = new Layer(mu_a[0], mu_s_reduced[0], n[0], g[0], 0.0f, Z_dim);
+        scenes[w]->addLayer(scene_layers[w]);
+        scenes[w]->enablePencilBeamTallies(num_rho + 1, drho, 1, Z_dim);
+    }
+
+    // Seeds are drawn up front since rand() is not thread-safe.
+    seeds.resize(4 * num_points);
+    for (size_t i = 0; i < seeds.size(); i++)
+        seeds[i] = rand() + 128;
+
+    for (int point = 0; point < num_points; point++)
+    {
+        pool.submit(boost::bind(&ReflectanceTable::simulatePoint, this, point, _1));
+    }
+    pool.wait();
+
+    for (int w = 0; w < num_workers; w++)
+        delete scenes[w];
+    scenes.clear();
+    scene_layers.clear();
+    delete [] photons;
+    photons = NULL;
+    return true;
+}
+
+
+void ReflectanceTable::simulatePoint(const int point, const int worker)
+{
+    // Unravel the grid point into the index along each optical property axis.
+    int index[NUM_AXES];
+    int rest = point;
+    for (int a = REFRACTIVE_INDEX; a >= MU_A; a--)
+    {
+        index[a] = rest % axes[a].size();
+        rest /= axes[a].size();
+    }
+    index[RHO] = 0;
+
+    double mu_a = axes[MU_A][index[MU_A]];
+    double g = axes[ANISOTROPY][index[ANISOTROPY]];
+    double mu_s = axes[MU_S_REDUCED][index[MU_S_REDUCED]] / (1.0 - g);
+
+    // Only the optical properties of the compiled scene change between grid points.
+    Layer *layer = scene_layers[worker];
+    layer->setAbsorpCoeff(mu_a);
+    layer->setScatterCoeff(mu_s);
+    layer->setAnisotropy(g);
+    layer->setRefractiveIndex(axes[REFRACTIVE_INDEX][index[REFRACTIVE_INDEX]]);
+
+    Medium *scene = scenes[worker];
+    scene->getRadialTally()->clear();
+
+    coords injectionCoords;
+    injectionCoords.x = source_x;
+    injectionCoords.y = source_y;
+    injectionCoords.z = 1e-15f;
+    photons[worker].injectPhoton(scene, photons_per_point,
+                                 seeds[4*point], seeds[4*point + 1], seeds[4*point + 2], seeds[4*point + 3],
+                                 injectionCoords);
+
+    std::vector<double> R = scene->getRadialTally()->getReflectance();
+    size_t offset = flatIndex(index);
+    for (size_t i = 0; i < axes[RHO].size(); i++)
+        values[offset + i] = R[i];
+}
+
+
+size_t ReflectanceTable::flatIndex(const int index[NUM_AXES]) const
+{
+    size_t flat = 0;
+    for (int a = MU_A; a < NUM_AXES; a++)
+        flat = flat * axes[a].size() + index[a];
+    return flat;
+}
+
+
+double ReflectanceTable::interpolate(const double mu_a, const double mu_s_reduced, const double g,
+                                     const double n, const double rho) const
+{
+    if (values.empty())
+        return 0.0;
+
+    const double point[NUM_AXES] = {mu_a, mu_s_reduced, g, n, rho};
+
+    // Find the lower grid index and the fractional position along every axis.
+    int lower[NUM_AXES];
+    double t[NUM_AXES];
+    for (int a = MU_A; a < NUM_AXES; a++)
+    {
+        const std::vector<double> &axis = axes[a];
+        if (axis.size() == 1 || point[a] <= axis.front())
+        {
+            lower[a] = 0;
+            t[a] = 0.0;
+        }
+        else if (point[a] >= axis.back())
+        {
+            lower[a] = axis.size() - 2;
+            t[a] = 1.0;
+        }
+        else
+        {
+            lower[a] = std::upper_bound(axis.begin(), axis.end(), point[a]) - axis.begin() - 1;
+            t[a] = (point[a] - axis[lower[a]]) / (axis[lower[a] + 1] - axis[lower[a]]);
+        }
+    }
+
+    // Sum the weighted values at the 2^5 corners of the enclosing cell.
+    double result = 0.0;
+    for (int corner = 0; corner < (1 << NUM_AXES); corner++)
+    {
+        int index[NUM_AXES];
+        double weight = 1.0;
+        for (int a = MU_A; a < NUM_AXES; a++)
+        {
+            int upper = (corner >> a) & 1;
+            if (upper && axes[a].size() == 1)
+            {
+                weight = 0.0;
+                break;
+            }
+            index[a] = lower[a] + upper;
+            weight *= upper ? t[a] : 1.0 - t[a];
+        }
+        if (weight != 0.0)
+            result += weight * values[flatIndex(index)];
+    }
+
+    return result;
+}
+
+
+// Binary layout (native byte order):
+//     char[8]   magic "MCLUT001"
+//     uint64    photons per grid point
+//     for each of the 5 axes: uint32 size, double[size] values
+//     float[]   R(rho) [1/cm^2], with rho varying fastest and mu_a slowest
+bool ReflectanceTable::write(const std::string &filename) const
+{
+    std::ofstream output(filename.c_str(), std::ios::binary);
+    if (!output.is_open())
+        return false;
+
+    uint64_t photons = photons_per_point;
+    output.write(TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    output.write((const char *)&photons, sizeof(photons));
+    for (int a = MU_A; a < NUM_AXES; a++)
+    {
+        uint32_t size = axes[a].size();
+        output.write((const char *)&size, sizeof(size));
+        output.write((const char *)&axes[a][0], size * sizeof(double));
+    }
+    output.write((const char *)&values[0], values.size() * sizeof(float));
+
+    output.close();
+    return !output.fail();
+}
+
+
+bool ReflectanceTable::read(const std::string &filename)
+{
+    std::ifstream input(filename.c_str(), std::ios::binary);
+    if (!input.is_open())
+        return false;
+
+    char magic[sizeof(TABLE_MAGIC)];
+    uint64_t photons = 0;
+    input.read(magic, sizeof(magic));
+    input.read((char *)&photons, sizeof(photons));
+    if (input.fail() || memcmp(magic, TABLE_MAGIC, sizeof(magic)) != 0)
+    {
+        cout << "Error: " << filename << " is not a reflectance lookup table\n";
+        return false;
+    }
+    photons_per_point = photons;
+
+    size_t num_values = 1;
+    for (int a = MU_A; a < NUM_AXES; a++)
+    {
+        uint32_t size = 0;
+        input.read((char *)&size, sizeof(size));
+        if (input.fail() || size == 0)
+        {
+            cout << "Error: corrupt axis in lookup table " << filename << endl;
+            return false;
+        }
+        axes[a].resize(size);
+        input.read((char *)&axes[a][0], size * sizeof(double));
+        num_values *= size;
+    }
+
+    values.resize(num_values);
+    input.read((char *)&values[0], num_values * sizeof(float));
+    if (input.fail())
+    {
+        cout << "Error: truncated lookup table " << filename << endl;
+        values.clear();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,75 @@
+//
+//  lookupTable.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Dense lookup table of spatially resolved reflectance R(rho) [1/cm^2] over a grid of
+// (mu_a, mu_s', g, n, rho), for use as a fast forward model.  Every grid point of the
+// optical properties is a pencil-beam run of a semi-infinite medium; the source-detector
+// distance 'rho' comes for free from the radial tallies of that run.
+#ifndef LOOKUPTABLE_H
+#define LOOKUPTABLE_H
+
+#include <vector>
+#include <string>
+
+class WorkerPool;
+class Medium;
+class Layer;
+class Photon;
+
+
+class ReflectanceTable
+{
+public:
+    // The axes of the table, slowest varying first.
+    enum Axis {MU_A = 0, MU_S_REDUCED, ANISOTROPY, REFRACTIVE_INDEX, RHO, NUM_AXES};
+
+    ReflectanceTable();
+    ~ReflectanceTable();
+
+    // Simulate every combination of the optical properties with 'num_photons' photons,
+    // tallying the reflectance in 'num_rho' radial bins of size 'drho' [cm].  Grid points
+    // are run as separate tasks on 'pool', each worker reusing a single compiled scene
+    // of which only the optical properties change between grid points.  Returns false,
+    // without simulating anything, when an anisotropy is 1 or more since mu_s is then
+    // undefined.
+    bool    generate(const std::vector<double> &mu_a,
+                     const std::vector<double> &mu_s_reduced,
+                     const std::vector<double> &g,
+                     const std::vector<double> &n,
+                     const int num_rho, const double drho,
+                     const int num_photons, WorkerPool &pool);
+
+    // Multilinear interpolation of R(rho) [1/cm^2].  Values outside of the table
+    // are clamped to its edges.
+    double  interpolate(const double mu_a, const double mu_s_reduced, const double g,
+                        const double n, const double rho) const;
+
+    // Write and read the table in its binary file format.  Both return false on error.
+    bool    write(const std::string &filename) const;
+    bool    read(const std::string &filename);
+
+    const std::vector<double> & getAxis(const Axis a) const {return axes[a];}
+
+private:
+    // Run a single grid point of the optical properties on 'worker'.
+    void    simulatePoint(const int point, const int worker);
+
+    // Return the flat index of the table entry from the index along each axis.
+    size_t  flatIndex(const int index[NUM_AXES]) const;
+
+    std::vector<double> axes[NUM_AXES];
+    std::vector<float> values;
+    unsigned long photons_per_point;
+
+    // Per-worker scenes used while generating the table.
+    std::vector<Medium *> scenes;
+    std::vector<Layer *> scene_layers;
+    Photon *photons;
+    std::vector<unsigned int> seeds;
+    double source_x, source_y;
+};
+
+#endif // LOOKUPTABLE_H
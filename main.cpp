@@ -19,8 +19,30 @@
 #include "vectorMath.h"
 #include "logger.h"
 #include "circularDetector.h"
+#include "radialTally.h"
+#include "beamConvolution.h"
+#include "scaledLibrary.h"
+#include "lookupTable.h"
+#include "workerPool.h"
+#include "sweepEngine.h"
+#include "correlatedSampler.h"
+#include "rqmcSampler.h"
+#include "convergenceRunner.h"
+#include "checkpointedRun.h"
+#include "liveTallies.h"
+#include "perfCounters.h"
+#include "traceRecorder.h"
+#include "partialTallies.h"
+#include "cpuTopology.h"
+#include "numaRun.h"
+#include "autoTuner.h"
+#include "scene.h"
+#include "timer.h"
 #include <cmath>
+#include <cstdio>
+#include <algorithm>
 #include <ctime>
+#include <cstdlib>
 #include <vector>
 #include <boost/thread/thread.hpp> 
 #include <boost/lexical_cast.hpp>
@@ -49,20 +71,148 @@ void testVectorMath(void);
 // Simulation routines.
 void runMonteCarlo(void);
 
+// Compares similarity-relation scaled transport against full transport on the same scene.
+void runSimilarityBenchmark(const int num_photons);
 
+// Runs a pencil beam into a laterally uniform medium and writes R(r), T(r) and A(r,z).
+void runPencilBeam(const std::string &tally_file, const int num_photons);
 
-int main()
+// Convolves the tallies of a pencil-beam run with a finite beam profile.
+int convolvePencilBeam(int argc, char *argv[]);
+
+// Builds a scaled Monte Carlo library, or evaluates the reflectance from one.
+void buildScaledLibrary(const std::string &library_file, const int num_photons);
+int queryScaledLibrary(int argc, char *argv[]);
+
+// Generates a reflectance lookup table, or interpolates a value from one.
+void generateLookupTable(const std::string &table_file, const int num_photons);
+int queryLookupTable(int argc, char *argv[]);
+
+// Runs a sweep of absorber variants of the default scene in one process.
+void runSweep(const std::string &prefix, const int num_photons);
+
+// Estimates the absorber contrast of the default scene with correlated sampling.
+void runCorrelated(const std::string &result_file, const int num_photons);
+
+// Compares randomized quasi-Monte Carlo against plain Monte Carlo for the reflectance
+// of a pencil beam near the source.
+void runRQMC(const std::string &result_file, const int num_photons, const int dims);
+
+// Runs the default scene until a precision, detection count, time or photon limit is met.
+int runUntilConverged(int argc, char *argv[]);
+
+// Runs the default scene with periodic checkpoints, optionally resuming a previous run.
+int runCheckpointed(int argc, char *argv[]);
+
+// Runs shard 'k' of 'N' of the default scene and writes its partial tallies.
+int runShard(int argc, char *argv[]);
+
+// Runs the default scene with workers bound to cores and the scene replicated per NUMA node.
+int runNuma(int argc, char *argv[]);
+void writeNumaResults(Scene &scene, const double elapsed);
+
+// Runs the default scene with the thread and chunk configuration picked by the auto-tuner.
+int runTuned(int argc, char *argv[]);
+
+// Returns the description of the default scene used by runMonteCarlo().
+SceneDescription getDefaultScene(void);
+
+
+
+int main(int argc, char *argv[])
 {
 
 	//testVectorMath();
 
-	runMonteCarlo();
+	// mc-boost --trace <file> <arguments> records a timeline of the threads of the run,
+	// written to <file> in the Chrome trace event format when the program exits.
+	if (argc > 2 && std::string(argv[1]) == "--trace")
+	{
+		TraceRecorder::getInstance()->enable(argv[2]);
+		argv += 2;
+		argc -= 2;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--similarity-benchmark")
+	{
+		int num_photons = (argc > 2) ? atoi(argv[2]) : 20000;
+		runSimilarityBenchmark(num_photons);
+	}
+	else if (argc > 2 && std::string(argv[1]) == "--pencil-beam")
+	{
+		int num_photons = (argc > 3) ? atoi(argv[3]) : MAX_PHOTONS;
+		runPencilBeam(argv[2], num_photons);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--convolve")
+	{
+		return convolvePencilBeam(argc, argv);
+	}
+	else if (argc > 2 && std::string(argv[1]) == "--build-library")
+	{
+		int num_photons = (argc > 3) ? atoi(argv[3]) : 100000;
+		buildScaledLibrary(argv[2], num_photons);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--query-library")
+	{
+		return queryScaledLibrary(argc, argv);
+	}
+	else if (argc > 2 && std::string(argv[1]) == "--generate-lut")
+	{
+		int num_photons = (argc > 3) ? atoi(argv[3]) : 100000;
+		generateLookupTable(argv[2], num_photons);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--query-lut")
+	{
+		return queryLookupTable(argc, argv);
+	}
+	else if (argc > 2 && std::string(argv[1]) == "--sweep")
+	{
+		int num_photons = (argc > 3) ? atoi(argv[3]) : MAX_PHOTONS;
+		runSweep(argv[2], num_photons);
+	}
+	else if (argc > 2 && std::string(argv[1]) == "--correlated")
+	{
+		int num_photons = (argc > 3) ? atoi(argv[3]) : 100000;
+		runCorrelated(argv[2], num_photons);
+	}
+	else if (argc > 2 && std::string(argv[1]) == "--rqmc")
+	{
+		int num_photons = (argc > 3) ? atoi(argv[3]) : 16384;
+		int dims = (argc > 4) ? atoi(argv[4]) : 8;
+		runRQMC(argv[2], num_photons, dims);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--converge")
+	{
+		return runUntilConverged(argc, argv);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--checkpointed")
+	{
+		return runCheckpointed(argc, argv);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--shard")
+	{
+		return runShard(argc, argv);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--numa")
+	{
+		return runNuma(argc, argv);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--tuned")
+	{
+		return runTuned(argc, argv);
+	}
+	else
+	{
+		runMonteCarlo();
+	}
 
 
 	return 0;
 }
 
 
+
+
 std::string getCurrTime(void)
 {
 
@@ -160,9 +310,10 @@ void runMonteCarlo(void)
 	//
 	unsigned int s1, s2, s3, s4;
 
-	// Capture the time before launching photons into the medium.
+	// Capture the wall-clock time before launching photons into the medium.  CPU time
+	// (i.e. clock()) adds up over all threads and overstates the run time.
 	//
-	clock_t start, end;
+	double start, end;
 
 
 
@@ -179,7 +330,7 @@ void runMonteCarlo(void)
 	Logger::getInstance()->openExitFile(exit_data_file);
 
 	// Grab the start time before the simulation runs.
-	start = clock();
+	start = getWallTime();
 
 
 	// Create the threads and give them photon objects to run.
@@ -201,17 +352,25 @@ void runMonteCarlo(void)
 	}
 
 	// Join all created threads once they have done their work.
-	for (int i = 0; i < NUM_PHOTON_OBJECTS; i++)
 	{
-		threads[i].join();
+		TraceScope trace(TraceRecorder::JOIN);
+		for (int i = 0; i < NUM_PHOTON_OBJECTS; i++)
+		{
+			threads[i].join();
+		}
 	}
 
 
 
 
-	// Print out the elapsed time it took from beginning to end.
-	end = ((double)clock() - start) / CLOCKS_PER_SEC;
+	// Print out the elapsed time it took from beginning to end, and the event counts.
+	end = getWallTime() - start;
 	cout << "\n\nTotal time elapsed: " << end << endl;
+	tissue->getEventCounters().write(cout, end);
+#ifdef STAGE_PROFILING
+	cout << "\nStage profile (cycles)\n";
+	tissue->getStageProfile().write(cout, tissue->getEventCounters().events[EventCounters::STEPS]);
+#endif
 
 
 	// Print the matrix of the photon absorptions to file.
@@ -227,6 +386,851 @@ void runMonteCarlo(void)
 
 
 
+// Results gathered from a single run of the similarity benchmark scene.
+struct SimilarityResult
+{
+	double elapsed;				// Wall-clock time [s].
+	double steps_per_photon;
+	double detected_weight;		// Weight exiting through the detector, per photon.
+	double absorber_weight;		// Weight absorbed by the absorber, per photon.
+};
+
+
+// Run the benchmark scene with or without similarity scaling.  The scene is a
+// highly forward scattering medium (g = 0.9) with a spherical absorber at its
+// center and a detector centered on the bottom surface, which leaves a large
+// volume of the medium far away from any feature.
+SimilarityResult runSimilarityScene(const int num_photons, const bool scaled)
+{
+	double X_dim = 2.0f;      // [cm]
+	double Y_dim = 2.0f;      // [cm]
+	double Z_dim = 2.0f;      // [cm]
+
+	Medium *tissue = new Medium(X_dim, Y_dim, Z_dim);
+	Layer *tissueLayer1 = new Layer(0.1, 100.0, 1.33, 0.9, 0.0f, Z_dim);
+
+	SphereAbsorber *absorber0 = new SphereAbsorber(0.25, X_dim/2, Y_dim/2, Z_dim/2);
+	absorber0->setAbsorberAbsorptionCoeff(1.0f);
+	absorber0->setAbsorberScatterCoeff(100.0);
+	tissueLayer1->addAbsorber(absorber0);
+
+	CircularDetector detector(0.5f, Vector3d(X_dim/2, Y_dim/2, Z_dim));
+	detector.setDetectorPlaneXY();
+
+	tissue->addLayer(tissueLayer1);
+	tissue->addDetector(&detector);
+
+	// The map is built once the scene is complete.  Photons switch to scaled
+	// transport when they are more than 3 reduced mean free paths from any feature.
+	if (scaled)
+		tissue->enableSimilarityScaling(3.0);
+
+	coords injectionCoords;
+	injectionCoords.x = X_dim/2;
+	injectionCoords.y = Y_dim/2;
+	injectionCoords.z = 1e-15f;
+
+	const int NUM_THREADS = boost::thread::hardware_concurrency();
+	Photon *photons = new Photon[NUM_THREADS];
+	boost::thread *threads = new boost::thread[NUM_THREADS];
+
+	double start = getWallTime();
+	for (int i = 0; i < NUM_THREADS; i++)
+	{
+		threads[i] = boost::thread(&Photon::injectPhoton, &photons[i], tissue, num_photons/NUM_THREADS,
+				rand() + 128, rand() + 128, rand() + 128, rand() + 128, injectionCoords);
+	}
+	for (int i = 0; i < NUM_THREADS; i++)
+	{
+		threads[i].join();
+	}
+
+	SimilarityResult result;
+	result.elapsed = getWallTime() - start;
+
+	// Sum the thread local values from each photon object.
+	double total_steps = 0;
+	double detected_weight = 0;
+	for (int i = 0; i < NUM_THREADS; i++)
+	{
+		total_steps += photons[i].getTotalSteps();
+		detected_weight += photons[i].getDetectedWeight();
+	}
+	int simulated = (num_photons/NUM_THREADS) * NUM_THREADS;
+	result.steps_per_photon = total_steps / simulated;
+	result.detected_weight = detected_weight / simulated;
+	result.absorber_weight = absorber0->getAbsorbedWeight() / simulated;
+
+	delete [] threads;
+	delete [] photons;
+	delete tissue;
+
+	return result;
+}
+
+
+void runSimilarityBenchmark(const int num_photons)
+{
+	srand(time(0));
+
+	// Exit data of both runs end up in the same file.
+	Logger::getInstance()->openExitFile("exit-aperture-similarity-" + getCurrTime() + ".txt");
+
+	cout << "Similarity scaling benchmark, " << num_photons << " photons\n";
+	SimilarityResult full = runSimilarityScene(num_photons, false);
+	SimilarityResult scaled = runSimilarityScene(num_photons, true);
+
+	cout << "\t\t\tfull\t\tscaled\t\trelative difference\n";
+	cout << "time [s]\t\t" << full.elapsed << "\t\t" << scaled.elapsed << "\t\t"
+		 << (scaled.elapsed - full.elapsed) / full.elapsed << endl;
+	cout << "steps/photon\t\t" << full.steps_per_photon << "\t\t" << scaled.steps_per_photon << "\t\t"
+		 << (scaled.steps_per_photon - full.steps_per_photon) / full.steps_per_photon << endl;
+	cout << "detected weight\t\t" << full.detected_weight << "\t\t" << scaled.detected_weight << "\t\t"
+		 << (scaled.detected_weight - full.detected_weight) / full.detected_weight << endl;
+	cout << "absorber weight\t\t" << full.absorber_weight << "\t\t" << scaled.absorber_weight << "\t\t"
+		 << (scaled.absorber_weight - full.absorber_weight) / full.absorber_weight << endl;
+}
+
+
+
+
+
+void runPencilBeam(const std::string &tally_file, const int num_photons)
+{
+	// The medium is made wide enough that few photons leave through the sides,
+	// which approximates a laterally infinite medium.
+	double X_dim = 10.0f;     // [cm]
+	double Y_dim = 10.0f;     // [cm]
+	double Z_dim = 2.0f;      // [cm]
+
+	Medium *tissue = new Medium(X_dim, Y_dim, Z_dim);
+	Layer *tissueLayer1 = new Layer(1.0, 30.0, 1.33, 0.9, 0.0f, Z_dim);
+	tissue->addLayer(tissueLayer1);
+
+	// 100 radial bins of 100 um and 100 depth bins of 200 um, with standard errors
+	// from batches of 1000 photons.
+	tissue->enablePencilBeamTallies(100, 0.01, 100, Z_dim/100);
+	tissue->enableBatchStatistics(1000);
+
+	coords injectionCoords;
+	injectionCoords.x = X_dim/2;
+	injectionCoords.y = Y_dim/2;
+	injectionCoords.z = 1e-15f;
+
+	const int NUM_THREADS = boost::thread::hardware_concurrency();
+	Photon *photons = new Photon[NUM_THREADS];
+	boost::thread *threads = new boost::thread[NUM_THREADS];
+
+	srand(time(0));
+	double start = getWallTime();
+	for (int i = 0; i < NUM_THREADS; i++)
+	{
+		threads[i] = boost::thread(&Photon::injectPhoton, &photons[i], tissue, num_photons/NUM_THREADS,
+				rand() + 128, rand() + 128, rand() + 128, rand() + 128, injectionCoords);
+	}
+	for (int i = 0; i < NUM_THREADS; i++)
+	{
+		threads[i].join();
+	}
+	cout << "Pencil beam: " << tissue->getRadialTally()->getNumPhotons() << " photons in "
+		 << getWallTime() - start << " s\n";
+
+	if (!tissue->getRadialTally()->write(tally_file))
+		cout << "Error: could not write " << tally_file << endl;
+
+	delete [] threads;
+	delete [] photons;
+	delete tissue;
+}
+
+
+// mc-boost --convolve <tally-file> gaussian <1/e^2 radius> <output-file>
+// mc-boost --convolve <tally-file> flat <radius> <output-file>
+// mc-boost --convolve <tally-file> profile <profile-file> <output-file>
+int convolvePencilBeam(int argc, char *argv[])
+{
+	if (argc < 6)
+	{
+		cout << "Usage: mc-boost --convolve <tally-file> gaussian|flat|profile <radius|profile-file> <output-file>\n";
+		return 1;
+	}
+
+	RadialTally *tally = RadialTally::read(argv[2]);
+	if (!tally)
+	{
+		cout << "Error: could not read pencil-beam tally " << argv[2] << endl;
+		return 1;
+	}
+
+	std::string type = argv[3];
+	BeamProfile *beam = NULL;
+	if (type == "gaussian")
+		beam = new GaussianBeam(atof(argv[4]));
+	else if (type == "flat")
+		beam = new FlatTopBeam(atof(argv[4]));
+	else if (type == "profile")
+		beam = TabulatedBeam::read(argv[4]);
+
+	if (!beam)
+	{
+		cout << "Error: unknown or unreadable beam profile " << type << endl;
+		delete tally;
+		return 1;
+	}
+
+	double start = getWallTime();
+	bool written = BeamConvolution::writeConvolved(*tally, *beam, argv[5]);
+	cout << "Convolution took " << getWallTime() - start << " s\n";
+
+	delete beam;
+	delete tally;
+
+	return written ? 0 : 1;
+}
+
+
+
+
+
+void buildScaledLibrary(const std::string &library_file, const int num_photons)
+{
+	// Anisotropies covered by the library, for a medium with a refractive index of 1.33.
+	std::vector<double> g_values;
+	g_values.push_back(0.6);
+	g_values.push_back(0.7);
+	g_values.push_back(0.8);
+	g_values.push_back(0.9);
+
+	srand(time(0));
+	double start = getWallTime();
+
+	ScaledLibrary library;
+	library.build(g_values, 1.33, num_photons);
+	cout << "Library built in " << getWallTime() - start << " s\n";
+
+	if (!library.write(library_file))
+		cout << "Error: could not write " << library_file << endl;
+}
+
+
+// mc-boost --query-library <library-file> <mu_a> <mu_s> <g> <rho_min> <rho_max>
+int queryScaledLibrary(int argc, char *argv[])
+{
+	if (argc < 8)
+	{
+		cout << "Usage: mc-boost --query-library <library-file> <mu_a> <mu_s> <g> <rho_min> <rho_max>\n";
+		return 1;
+	}
+
+	ScaledLibrary library;
+	if (!library.read(argv[2]))
+		return 1;
+
+	double mu_a = atof(argv[3]);
+	double mu_s = atof(argv[4]);
+	double g = atof(argv[5]);
+	double rho_min = atof(argv[6]);
+	double rho_max = atof(argv[7]);
+
+	// Repeat the query to get a meaningful timing.
+	const int NUM_QUERIES = 1000;
+	double R = 0;
+	double start = getWallTime();
+	for (int i = 0; i < NUM_QUERIES; i++)
+		R = library.reflectance(mu_a, mu_s, g, rho_min, rho_max);
+	double elapsed = (getWallTime() - start) / NUM_QUERIES;
+
+	if (R < 0)
+	{
+		cout << "Error: g = " << g << " lies outside of the library\n";
+		return 1;
+	}
+
+	cout << "R(" << rho_min << " <= r < " << rho_max << ") = " << R << " [1/cm^2]\n";
+	cout << "Total diffuse reflectance = " << library.totalReflectance(mu_a, mu_s, g) << endl;
+	cout << "Query time = " << elapsed * 1e6 << " us\n";
+
+	return 0;
+}
+
+
+
+
+
+void generateLookupTable(const std::string &table_file, const int num_photons)
+{
+	// The grid of optical properties covered by the table.
+	double mu_a_values[] = {0.01, 0.1, 1.0};			// [1/cm]
+	double mu_s_reduced_values[] = {5.0, 10.0, 20.0};	// [1/cm]
+	double g_values[] = {0.8, 0.9};
+	double n_values[] = {1.33, 1.4};
+	std::vector<double> mu_a(mu_a_values, mu_a_values + 3);
+	std::vector<double> mu_s_reduced(mu_s_reduced_values, mu_s_reduced_values + 3);
+	std::vector<double> g(g_values, g_values + 2);
+	std::vector<double> n(n_values, n_values + 2);
+
+	srand(time(0));
+	double start = getWallTime();
+
+	// One pool serves every grid point of the table.
+	WorkerPool pool(0);
+	ReflectanceTable table;
+	if (!table.generate(mu_a, mu_s_reduced, g, n, 20, 0.05, num_photons, pool))
+		return;
+	cout << "Lookup table generated in " << getWallTime() - start << " s\n";
+
+	if (!table.write(table_file))
+		cout << "Error: could not write " << table_file << endl;
+}
+
+
+// mc-boost --query-lut <table-file> <mu_a> <mu_s'> <g> <n> <rho>
+int queryLookupTable(int argc, char *argv[])
+{
+	if (argc < 8)
+	{
+		cout << "Usage: mc-boost --query-lut <table-file> <mu_a> <mu_s'> <g> <n> <rho>\n";
+		return 1;
+	}
+
+	ReflectanceTable table;
+	if (!table.read(argv[2]))
+		return 1;
+
+	double R = table.interpolate(atof(argv[3]), atof(argv[4]), atof(argv[5]),
+								 atof(argv[6]), atof(argv[7]));
+	cout << "R = " << R << " [1/cm^2]\n";
+
+	return 0;
+}
+
+
+
+
+
+SceneDescription getDefaultScene(void)
+{
+	SceneDescription scene;
+	scene.x_dim = 2.0;
+	scene.y_dim = 2.0;
+	scene.z_dim = 2.0;
+	scene.addLayer(1.0, 30.0, 1.33, 0.9, 0.0, scene.z_dim);
+	scene.addSphereAbsorber(0.1, 1.0, 1.0, 1.0, 2.0, 30.0);
+	scene.addDetector(0.15, scene.x_dim/2, scene.y_dim/2, scene.z_dim);
+	scene.source.x = scene.x_dim/2;
+	scene.source.y = scene.y_dim/2;
+	scene.source.z = 1e-15;
+
+	return scene;
+}
+
+
+void runSweep(const std::string &prefix, const int num_photons)
+{
+	WorkerPool pool(0);
+	SweepEngine sweep(pool, 1000);
+
+	// The reference without absorber gets more photons than the absorber variants,
+	// which the scheduler balances against the smaller ones.
+	// Every chunk is one batch of the error estimates.
+	SceneDescription reference = getDefaultScene();
+	reference.absorbers.clear();
+	reference.batch_size = 1000;
+	sweep.addVariant("no-absorber", reference, 4*num_photons, 1);
+
+	double absorber_mu_a[] = {2.0, 4.0, 8.0};
+	for (int i = 0; i < 3; i++)
+	{
+		SceneDescription variant = getDefaultScene();
+		variant.absorbers[0].mu_a = absorber_mu_a[i];
+		variant.batch_size = 1000;
+		sweep.addVariant("absorber-mua-" + boost::lexical_cast<std::string>(absorber_mu_a[i]),
+						 variant, num_photons, i + 2);
+	}
+
+	double start = getWallTime();
+	sweep.run();
+	cout << "Sweep of " << sweep.getNumVariants() << " variants took " << getWallTime() - start << " s\n";
+
+	for (int v = 0; v < sweep.getNumVariants(); v++)
+	{
+		cout << sweep.getName(v) << ": " << sweep.getElapsed(v) << " s\n";
+	}
+
+	sweep.writeResults(prefix);
+}
+
+
+void runCorrelated(const std::string &result_file, const int num_photons)
+{
+	WorkerPool pool(0);
+	CorrelatedSampler sampler(pool, 1000);
+
+	// The reference holds a background absorber, so the absorber weight contrast
+	// is defined for every variant.
+	SceneDescription reference = getDefaultScene();
+	reference.absorbers[0].mu_a = 1.0;
+	sampler.addVariant("absorber-mua-1", reference);
+
+	const char *absorber_mu_a[] = {"1.1", "2", "4"};
+	for (int i = 0; i < 3; i++)
+	{
+		SceneDescription variant = getDefaultScene();
+		variant.absorbers[0].mu_a = atof(absorber_mu_a[i]);
+		sampler.addVariant(std::string("absorber-mua-") + absorber_mu_a[i], variant);
+	}
+
+	double start = getWallTime();
+	sampler.run(num_photons, 1);
+	cout << "Correlated run of " << sampler.getNumVariants() << " variants took "
+		 << getWallTime() - start << " s\n";
+
+	for (int v = 1; v < sampler.getNumVariants(); v++)
+	{
+		CorrelatedSampler::Observable obs = CorrelatedSampler::DETECTED_WEIGHT;
+		cout << sampler.getName(v) << " - " << sampler.getName(0) << ": detected weight difference "
+			 << sampler.getDifference(v, obs) << " +/- " << sampler.getDifferenceStdError(v, obs)
+			 << " (independent runs +/- " << sampler.getIndependentStdError(v, obs) << ")\n";
+	}
+
+	if (!sampler.writeResults(result_file))
+		cout << "Error: could not write " << result_file << endl;
+}
+
+
+void runRQMC(const std::string &result_file, const int num_photons, const int dims)
+{
+	const int NUM_RANDOMIZATIONS = 16;
+
+	SceneDescription scene;
+	scene.x_dim = 10.0;
+	scene.y_dim = 10.0;
+	scene.z_dim = 2.0;
+	scene.addLayer(1.0, 30.0, 1.33, 0.9, 0.0, scene.z_dim);
+	scene.source.x = scene.x_dim/2;
+	scene.source.y = scene.y_dim/2;
+	scene.source.z = 1e-15;
+
+	// 50 radial bins of 100 um close to the source.
+	scene.num_radial_bins = 50;
+	scene.radial_bin_size = 0.01;
+	scene.num_depth_bins = 1;
+	scene.depth_bin_size = scene.z_dim;
+
+	WorkerPool pool(0);
+	RQMCSampler mc(pool, 1024);
+	RQMCSampler rqmc(pool, 1024);
+
+	double start = getWallTime();
+	mc.run(scene, num_photons, NUM_RANDOMIZATIONS, 0, 1);
+	cout << "MC:   " << NUM_RANDOMIZATIONS << " x " << num_photons << " photons in "
+		 << getWallTime() - start << " s\n";
+
+	start = getWallTime();
+	rqmc.run(scene, num_photons, NUM_RANDOMIZATIONS, dims, 1);
+	cout << "RQMC: " << NUM_RANDOMIZATIONS << " x " << num_photons << " photons in "
+		 << getWallTime() - start << " s, " << dims << " quasi-random dimensions\n";
+
+	// Compare the variances over the first millimeter from the source.
+	std::vector<double> R = rqmc.getReflectance();
+	std::vector<double> mc_error = mc.getReflectanceStdError();
+	std::vector<double> rqmc_error = rqmc.getReflectanceStdError();
+	cout << "r [cm]\tR [1/cm^2]\tMC error\tRQMC error\n";
+	for (int i = 0; i < 10; i++)
+	{
+		cout << (i + 0.5)*scene.radial_bin_size << "\t" << R[i] << "\t"
+			 << mc_error[i] << "\t" << rqmc_error[i] << "\n";
+	}
+
+	if (!rqmc.writeResults(result_file))
+		cout << "Error: could not write " << result_file << endl;
+}
+
+
+// mc-boost --converge <result-file> [--rel-error <e>] [--tally detector|absorber]
+//          [--min-detected <n>] [--time <seconds>] [--max-photons <n>] [--batch <n>]
+int runUntilConverged(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		cout << "Usage: mc-boost --converge <result-file> [--rel-error <e>] [--tally detector|absorber]\n"
+			 << "       [--min-detected <n>] [--time <seconds>] [--max-photons <n>] [--batch <n>]\n";
+		return 1;
+	}
+
+	double rel_error = 0;
+	ConvergenceRunner::Tally tally = ConvergenceRunner::DETECTED_WEIGHT;
+	unsigned long min_detected = 0;
+	double time_budget = 0;
+	unsigned long max_photons = 0;
+	unsigned long batch_size = 1000;
+
+	for (int i = 3; i + 1 < argc; i += 2)
+	{
+		std::string option = argv[i];
+		if (option == "--rel-error")
+			rel_error = atof(argv[i + 1]);
+		else if (option == "--tally")
+			tally = std::string(argv[i + 1]) == "absorber" ? ConvergenceRunner::ABSORBER_WEIGHT
+														   : ConvergenceRunner::DETECTED_WEIGHT;
+		else if (option == "--min-detected")
+			min_detected = strtoul(argv[i + 1], NULL, 10);
+		else if (option == "--time")
+			time_budget = atof(argv[i + 1]);
+		else if (option == "--max-photons")
+			max_photons = strtoul(argv[i + 1], NULL, 10);
+		else if (option == "--batch")
+			batch_size = strtoul(argv[i + 1], NULL, 10);
+		else
+		{
+			cout << "Error: unknown option " << option << endl;
+			return 1;
+		}
+	}
+
+	WorkerPool pool(0);
+	ConvergenceRunner runner(pool, batch_size);
+	runner.setTargetRelativeError(rel_error, tally);
+	runner.setMinDetected(min_detected);
+	runner.setTimeBudget(time_budget);
+	runner.setMaxPhotons(max_photons);
+
+	Scene scene(getDefaultScene());
+	if (!runner.run(&scene, 1))
+		return 1;
+
+	cout << "Stopped by " << runner.getStopReasonName() << " after " << runner.getNumPhotons()
+		 << " photons in " << runner.getElapsed() << " s\n";
+	cout << "Detected weight/photon " << runner.getMean(ConvergenceRunner::DETECTED_WEIGHT)
+		 << " (relative error " << runner.getRelativeError(ConvergenceRunner::DETECTED_WEIGHT) << ")\n";
+	cout << "Absorber weight/photon " << runner.getMean(ConvergenceRunner::ABSORBER_WEIGHT)
+		 << " (relative error " << runner.getRelativeError(ConvergenceRunner::ABSORBER_WEIGHT) << ")\n";
+
+	if (!runner.writeResults(argv[2]))
+	{
+		cout << "Error: could not write " << argv[2] << endl;
+		return 1;
+	}
+	return 0;
+}
+
+
+// mc-boost --checkpointed <checkpoint-file> <num-photons> [--resume] [--interval <seconds>]
+//                         [--live <name>] [--live-interval <seconds>] [--report <seconds>]
+//                         [--perf]
+//
+// With --live the tallies are published to the shared-memory segment /<name> every
+// live interval, for mc-boost-watch to show while the run continues.  With --report
+// the photon rate and energy imbalance are printed every report interval, and with
+// --perf the hardware performance counters of the workers at the end.
+int runCheckpointed(int argc, char *argv[])
+{
+	if (argc < 4)
+	{
+		cout << "Usage: mc-boost --checkpointed <checkpoint-file> <num-photons> [--resume] [--interval <seconds>]\n"
+			 << "                [--live <name>] [--live-interval <seconds>] [--report <seconds>] [--perf]\n";
+		return 1;
+	}
+
+	unsigned long num_photons = strtoul(argv[3], NULL, 10);
+	bool resume = false;
+	double interval = 60;
+	std::string live_name;
+	double live_interval = 1;
+	double report_interval = 0;
+	bool perf = false;
+	for (int i = 4; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--resume")
+			resume = true;
+		else if (option == "--interval" && i + 1 < argc)
+			interval = atof(argv[++i]);
+		else if (option == "--live" && i + 1 < argc)
+			live_name = argv[++i];
+		else if (option == "--live-interval" && i + 1 < argc)
+			live_interval = atof(argv[++i]);
+		else if (option == "--report" && i + 1 < argc)
+			report_interval = atof(argv[++i]);
+		else if (option == "--perf")
+			perf = true;
+		else
+		{
+			cout << "Error: unknown option " << option << endl;
+			return 1;
+		}
+	}
+
+	SceneDescription description = getDefaultScene();
+	description.batch_size = 1000;
+	Scene scene(description);
+
+	WorkerPool pool(0);
+	CheckpointedRun run(pool, &scene, 1000, 1);
+	run.setCheckpoint(argv[2], interval);
+
+	// Watch the run with mc-boost-watch <name>.
+	LiveTallyWriter live_writer(live_name);
+	if (!live_name.empty())
+		run.setLiveTallies(&live_writer, live_interval);
+	run.setProgressReport(report_interval);
+	if (perf)
+		run.enablePerfCounters();
+
+	if (resume)
+	{
+		if (!run.resume())
+			return 1;
+		cout << "Resuming with " << run.getNumCompleted() << " photons completed\n";
+	}
+
+	double start = getWallTime();
+	run.run(num_photons);
+	double elapsed = getWallTime() - start;
+
+	Medium *medium = scene.getMedium();
+	double photons_run = medium->getNumPhotons();
+	cout << run.getNumCompleted() << " photons completed, " << elapsed << " s this session\n";
+	cout << "Detected weight/photon " << medium->getDetectedWeight() / photons_run
+		 << " +/- " << medium->getDetectedWeightStdError() << "\n";
+	cout << "Steps/photon " << medium->getTotalSteps() / photons_run << "\n";
+	const std::vector<SphereAbsorber *> &absorbers = scene.getAbsorbers();
+	for (size_t i = 0; i < absorbers.size(); i++)
+	{
+		cout << "Absorber " << i << " weight/photon " << absorbers[i]->getAbsorbedWeight() / photons_run
+			 << " +/- " << medium->getAbsorberWeightStdError(absorbers[i]) << "\n";
+	}
+
+	// The event counters only cover the photons propagated this session.
+	cout << "\nEvents this session\n";
+	EventCounters events = medium->getEventCounters();
+	events.write(cout, elapsed);
+	if (perf)
+	{
+		cout << "\nHardware counters\n";
+		run.getPerfCounts().write(cout, events.events[EventCounters::PHOTONS_LAUNCHED],
+								  events.events[EventCounters::STEPS]);
+	}
+#ifdef STAGE_PROFILING
+	cout << "\nStage profile (cycles)\n";
+	medium->getStageProfile().write(cout, events.events[EventCounters::STEPS]);
+#endif
+
+	return 0;
+}
+
+
+
+
+
+// mc-boost --shard <k>/<N> <partial-file> [num-photons]
+//
+// The photons of the full run are divided over the N shards in whole chunks, and
+// every chunk is seeded from its first photon index, so the merged shards (see
+// mc-boost-merge) hold exactly the photons of an unsharded run.
+int runShard(int argc, char *argv[])
+{
+	int k = 0, N = 0;
+	if (argc < 4 || sscanf(argv[2], "%d/%d", &k, &N) != 2 || N <= 0 || k < 0 || k >= N)
+	{
+		cout << "Usage: mc-boost --shard <k>/<N> <partial-file> [num-photons]   (0 <= k < N)\n";
+		return 1;
+	}
+	unsigned long num_photons = (argc > 4) ? strtoul(argv[4], NULL, 10) : MAX_PHOTONS;
+
+	const unsigned long CHUNK_SIZE = 1000;
+	const uint64_t SEED = 1;
+	unsigned long num_chunks = (num_photons + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	unsigned long first = std::min(num_photons, num_chunks * k / N * CHUNK_SIZE);
+	unsigned long end = std::min(num_photons, num_chunks * (k + 1) / N * CHUNK_SIZE);
+
+	SceneDescription description = getDefaultScene();
+	description.batch_size = CHUNK_SIZE;
+	Scene scene(description);
+
+	WorkerPool pool(0);
+	CheckpointedRun run(pool, &scene, CHUNK_SIZE, SEED);
+	double start = getWallTime();
+	run.run(first, end);
+	cout << "Shard " << k << "/" << N << ": photons " << first << " to " << end << " in "
+		 << getWallTime() - start << " s\n";
+
+	PartialTallies partial;
+	partial.setRun(description.hash(), SEED, CHUNK_SIZE, num_photons);
+	partial.setRanges(run.getCompleted());
+	partial.getTallies().capture(scene.getMedium());
+	if (!partial.write(argv[3]))
+	{
+		cout << "Error: could not write " << argv[3] << endl;
+		return 1;
+	}
+	return 0;
+}
+
+
+
+// mc-boost --numa <num-photons> [--threads <n>] [--smt] [--shared-scene]
+//
+// Binds one worker to every physical core (every logical CPU with --smt), alternating
+// over the NUMA nodes, and propagates the default scene on a replica per node (one
+// shared copy with --shared-scene, for comparison).  The node tallies are added into
+// one medium at the end; they match those of --checkpointed for the same photons.
+int runNuma(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		cout << "Usage: mc-boost --numa <num-photons> [--threads <n>] [--smt] [--shared-scene]\n";
+		return 1;
+	}
+
+	unsigned long num_photons = strtoul(argv[2], NULL, 10);
+	int num_threads = 0;
+	bool use_smt = false, replicate = true;
+	for (int i = 3; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--threads" && i + 1 < argc)
+			num_threads = atoi(argv[++i]);
+		else if (option == "--smt")
+			use_smt = true;
+		else if (option == "--shared-scene")
+			replicate = false;
+		else
+		{
+			cout << "Error: unknown option " << option << endl;
+			return 1;
+		}
+	}
+
+	CpuTopology topology = CpuTopology::detect();
+	cout << topology.getNumCpus() << " CPUs, " << topology.getNumCores() << " cores, "
+		 << topology.getNumNodes() << " NUMA nodes\n";
+	topology.write(cout);
+
+	SceneDescription description = getDefaultScene();
+	description.batch_size = 1000;
+	Scene scene(description);
+
+	std::vector<int> cpus = topology.place(num_threads, use_smt);
+	WorkerPool pool(cpus);
+	NumaRun run(pool, description, 1000, 1, replicate);
+	cout << "Workers on CPUs";
+	for (int i = 0; i < pool.getNumThreads(); i++)
+		cout << " " << pool.getWorkerCpu(i);
+	cout << ", " << run.getNumReplicas() << " scene replica" << (run.getNumReplicas() > 1 ? "s" : "") << "\n";
+
+	double start = getWallTime();
+	run.run(num_photons);
+	double elapsed = getWallTime() - start;
+	if (!run.reduce(scene.getMedium()))
+	{
+		cout << "Error: the node tallies do not match the scene\n";
+		return 1;
+	}
+
+	writeNumaResults(scene, elapsed);
+	return 0;
+}
+
+
+// Print the tallies of the default scene after a NUMA run, and its event counts.
+void writeNumaResults(Scene &scene, const double elapsed)
+{
+	Medium *medium = scene.getMedium();
+	double photons_run = medium->getNumPhotons();
+	cout << medium->getNumPhotons() << " photons in " << elapsed << " s\n";
+	cout << "Detected weight/photon " << medium->getDetectedWeight() / photons_run
+		 << " +/- " << medium->getDetectedWeightStdError() << "\n";
+	cout << "Steps/photon " << medium->getTotalSteps() / photons_run << "\n";
+	const std::vector<SphereAbsorber *> &absorbers = scene.getAbsorbers();
+	for (size_t i = 0; i < absorbers.size(); i++)
+	{
+		cout << "Absorber " << i << " weight/photon " << absorbers[i]->getAbsorbedWeight() / photons_run
+			 << " +/- " << medium->getAbsorberWeightStdError(absorbers[i]) << "\n";
+	}
+
+	cout << "\nEvents\n";
+	medium->getEventCounters().write(cout, elapsed);
+}
+
+
+
+// mc-boost --tuned <num-photons> [--retune] [--tuning-cache <file>] [--calibration-photons <n>]
+//
+// Calibrates the thread count, SMT use, CPU binding and chunk size for the default
+// scene on this machine (see autoTuner.h), or reuses the choice cached for this scene
+// and CPU model, and then runs the photons with it.  The cache defaults to
+// $HOME/.mc-boost-tuning.
+int runTuned(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		cout << "Usage: mc-boost --tuned <num-photons> [--retune] [--tuning-cache <file>]\n"
+			 << "                [--calibration-photons <n>]\n";
+		return 1;
+	}
+
+	unsigned long num_photons = strtoul(argv[2], NULL, 10);
+	bool retune = false;
+	const char *home = getenv("HOME");
+	std::string cache_file = home ? std::string(home) + "/.mc-boost-tuning" : "mc-boost-tuning";
+	unsigned long calibration_photons = 4000;
+	for (int i = 3; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--retune")
+			retune = true;
+		else if (option == "--tuning-cache" && i + 1 < argc)
+			cache_file = argv[++i];
+		else if (option == "--calibration-photons" && i + 1 < argc)
+			calibration_photons = strtoul(argv[++i], NULL, 10);
+		else
+		{
+			cout << "Error: unknown option " << option << endl;
+			return 1;
+		}
+	}
+
+	SceneDescription description = getDefaultScene();
+	description.batch_size = 1000;
+
+	AutoTuner tuner(description, cache_file);
+	tuner.setCalibrationPhotons(calibration_photons);
+	tuner.setVerbose(true);
+	double start = getWallTime();
+	AutoTuner::Choice choice = tuner.tune(retune);
+	if (tuner.fromCache())
+		cout << "Cached configuration for " << AutoTuner::getCpuModel() << ": ";
+	else
+		cout << "Calibrated in " << getWallTime() - start << " s: ";
+	AutoTuner::writeChoice(cout, choice);
+	cout << "\n";
+
+	Scene scene(description);
+	WorkerPool *pool = AutoTuner::createPool(choice);
+	double elapsed;
+	{
+		NumaRun run(*pool, description, choice.chunk_size, 1, choice.pinned);
+		start = getWallTime();
+		run.run(num_photons);
+		elapsed = getWallTime() - start;
+		if (!run.reduce(scene.getMedium()))
+		{
+			cout << "Error: the node tallies do not match the scene\n";
+			delete pool;
+			return 1;
+		}
+	}
+	delete pool;
+
+	writeNumaResults(scene, elapsed);
+	return 0;
+}
+
+
+
+
+
 // Simple routine to test the vectorMath library.
 void testVectorMath(void)
 {
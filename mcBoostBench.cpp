@@ -0,0 +1,621 @@
+/*
+ * Copyright BMPI 2011
+ *
+ * mc-boost-bench: microbenchmarks of the components of the propagation loop.
+ *
+ */
+
+#include "photon.h"
+#include "medium.h"
+#include "layer.h"
+#include "scene.h"
+#include "vector3D.h"
+#include "vectorMath.h"
+#include "logger.h"
+#include "radialTally.h"
+#include "eventCounters.h"
+#include <boost/random/mersenne_twister.hpp>
+#include <time.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// Results are summed into 'sink', so the compiler cannot drop the work being timed.
+static volatile double sink = 0;
+
+// Number of precomputed photon states the benchmarks cycle through.
+static const int NUM_STATES = 1024;
+
+
+// Sets up photon states directly, so a single stage can be timed in isolation.
+class PhotonBench
+{
+public:
+	// Find the layer at 'location' and the attenuation a step sampled there uses.
+	// Done once per state, outside the timed loops.
+	static void locate(Photon &photon, const coords &location, Layer *&layer, double &mu_t)
+	{
+		photon.currLocation->location = location;
+		layer = photon.m_medium->getLayerFromDepth(location.z);
+		mu_t = layer->getAbsorpCoeff(photon.currLocation) + layer->getScatterCoeff(photon.currLocation);
+	}
+
+	// Put the photon at 'location', moving along 'direction' with a step of 'step',
+	// in 'layer' with attenuation 'mu_t' (see locate()).
+	static void place(Photon &photon, const coords &location, const directionCos &direction,
+					  const double step, Layer *layer, const double mu_t)
+	{
+		photon.currLocation->location = location;
+		photon.currLocation->setDirX(direction.x);
+		photon.currLocation->setDirY(direction.y);
+		photon.currLocation->setDirZ(direction.z);
+		photon.step = step;
+		photon.step_remainder = 0;
+		photon.status = ALIVE;
+		photon.scaled_step = false;
+		photon.hit_x_bound = photon.hit_y_bound = photon.hit_z_bound = false;
+		photon.currLayer = layer;
+		photon.step_mu_t = mu_t;
+	}
+
+	static double getStep(Photon &photon)
+	{
+		return photon.step;
+	}
+
+	static double setStepSize(Photon &photon)
+	{
+		photon.setStepSize();
+		return photon.step;
+	}
+
+	static double spin(Photon &photon)
+	{
+		photon.spin();
+		return photon.currLocation->getDirZ();
+	}
+
+	static bool hitMediumBoundary(Photon &photon)
+	{
+		photon.hit_x_bound = photon.hit_y_bound = photon.hit_z_bound = false;
+		return photon.hitMediumBoundary();
+	}
+
+	// Fresnel reflectance of a photon reaching the top or bottom of the medium with
+	// direction cosine 'uz'.
+	static double fresnel(Photon &photon, const double uz)
+	{
+		photon.hit_x_bound = photon.hit_y_bound = false;
+		photon.hit_z_bound = true;
+		photon.currLocation->setDirZ(uz);
+		return photon.getMediumReflectance();
+	}
+};
+
+
+
+// Random states spread over the medium of 'scene', with steps of the order of the
+// mean free path, so about one in ten crosses a boundary.
+struct PhotonState
+{
+	coords location;
+	directionCos direction;
+	double step;
+	Layer *layer;
+	double mu_t;
+};
+
+
+static std::vector<PhotonState> makeStates(const SceneDescription &scene)
+{
+	std::vector<PhotonState> states(NUM_STATES);
+	srand(1);
+	for (int i = 0; i < NUM_STATES; i++)
+	{
+		PhotonState &s = states[i];
+		s.location.x = scene.x_dim * (rand() + 1.0) / (RAND_MAX + 2.0);
+		s.location.y = scene.y_dim * (rand() + 1.0) / (RAND_MAX + 2.0);
+		s.location.z = scene.z_dim * (rand() + 1.0) / (RAND_MAX + 2.0);
+		double cos_theta = 2.0 * rand() / RAND_MAX - 1.0;
+		double sin_theta = sqrt(1.0 - cos_theta*cos_theta);
+		double psi = 2.0 * PI * rand() / RAND_MAX;
+		s.direction.x = sin_theta * cos(psi);
+		s.direction.y = sin_theta * sin(psi);
+		s.direction.z = cos_theta;
+		s.step = -log((rand() + 1.0) / (RAND_MAX + 2.0)) * 0.1;
+		s.layer = NULL;
+		s.mu_t = 0;
+	}
+	return states;
+}
+
+
+static SceneDescription makeScene(const double g, const int num_absorbers)
+{
+	SceneDescription scene;
+	scene.x_dim = scene.y_dim = scene.z_dim = 2.0;
+	scene.addLayer(1.0, 30.0, 1.33, g, 0.0, scene.z_dim);
+
+	// Absorbers on a regular grid filling the medium.
+	int n = 1;
+	while (n*n*n < num_absorbers)
+		n++;
+	double spacing = scene.x_dim / n;
+	for (int i = 0; i < num_absorbers; i++)
+	{
+		scene.addSphereAbsorber(0.4 * spacing, (i % n + 0.5) * spacing, (i / n % n + 0.5) * spacing,
+								(i / (n*n) + 0.5) * spacing, 2.0, 30.0);
+	}
+
+	scene.addDetector(0.15, scene.x_dim/2, scene.y_dim/2, scene.z_dim);
+	scene.source.x = scene.x_dim/2;
+	scene.source.y = scene.y_dim/2;
+	scene.source.z = 1e-15;
+	return scene;
+}
+
+
+// A compiled scene with a photon bound to it.
+struct Fixture
+{
+	Fixture(const SceneDescription &description)
+	: scene(description), states(makeStates(description))
+	{
+		photon.initRNG(128 + 1, 128 + 2, 128 + 3, 128 + 4);
+		photon.beginInjection(scene.getMedium(), scene.getSource());
+		for (int i = 0; i < NUM_STATES; i++)
+			PhotonBench::locate(photon, states[i].location, states[i].layer, states[i].mu_t);
+		place(0);
+	}
+
+	// Only writes the precomputed state, so it adds little to the stage being timed.
+	void place(const int i)
+	{
+		const PhotonState &s = states[i & (NUM_STATES - 1)];
+		PhotonBench::place(photon, s.location, s.direction, s.step, s.layer, s.mu_t);
+	}
+
+	Scene scene;
+	std::vector<PhotonState> states;
+	Photon photon;
+};
+
+
+static Fixture & getFixture(void)
+{
+	static Fixture fixture(makeScene(0.9, 1));
+	return fixture;
+}
+
+
+
+// Every benchmark runs 'n' operations and returns a value depending on all of them.
+
+static double benchHybridTaus(const unsigned long n)
+{
+	Photon &photon = getFixture().photon;
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+		sum += photon.HybridTaus();
+	return sum;
+}
+
+
+static double benchRandR(const unsigned long n)
+{
+	unsigned int state = 1;
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+		sum += rand_r(&state) * (1.0 / RAND_MAX);
+	return sum;
+}
+
+
+static double benchMersenneTwister(const unsigned long n)
+{
+	static boost::mt19937 generator(1);
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+		sum += generator() * 2.3283064365386963e-10;
+	return sum;
+}
+
+
+static double benchXorshift(const unsigned long n)
+{
+	static uint64_t state = 88172645463325252ULL;
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		sum += (state * 2685821657736338717ULL >> 11) * (1.0 / 9007199254740992.0);
+	}
+	return sum;
+}
+
+
+static double benchStepSize(const unsigned long n)
+{
+	Fixture &fixture = getFixture();
+	fixture.place(0);
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+		sum += PhotonBench::setStepSize(fixture.photon);
+	return sum;
+}
+
+
+static double benchStepSizeScaled(const unsigned long n)
+{
+	static Fixture *fixture = NULL;
+	if (!fixture)
+	{
+		SceneDescription description = makeScene(0.9, 1);
+		description.similarity_mfp = 3;
+		fixture = new Fixture(description);
+	}
+
+	// The feature map lookup depends on the location, so the photon is moved for
+	// every step; subtract boundary/place-baseline for the cost of the step alone.
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		fixture->place(i);
+		sum += PhotonBench::setStepSize(fixture->photon);
+	}
+	return sum;
+}
+
+
+static double benchSpin(const unsigned long n)
+{
+	Fixture &fixture = getFixture();
+	fixture.place(1);
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+		sum += PhotonBench::spin(fixture.photon);
+	return sum;
+}
+
+
+static double benchSpinIsotropic(const unsigned long n)
+{
+	static Fixture fixture(makeScene(0.0, 1));
+	fixture.place(1);
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+		sum += PhotonBench::spin(fixture.photon);
+	return sum;
+}
+
+
+static double benchSpinNormal(const unsigned long n)
+{
+	// Photons travelling along the z-axis take the other branch of spin().
+	Fixture &fixture = getFixture();
+	Vector3d &location = *fixture.photon.getPhotonCoords();
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		location.setDirX(0.0);
+		location.setDirY(0.0);
+		location.setDirZ(1.0);
+		sum += PhotonBench::spin(fixture.photon);
+	}
+	return sum;
+}
+
+
+static double benchFresnel(const unsigned long n)
+{
+	Fixture &fixture = getFixture();
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+		sum += PhotonBench::fresnel(fixture.photon, fixture.states[i & (NUM_STATES - 1)].direction.z);
+	return sum;
+}
+
+
+// Includes moving the photon to a new state, see boundary/place-baseline.
+static double benchHitMediumBoundary(const unsigned long n)
+{
+	Fixture &fixture = getFixture();
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		fixture.place(i);
+		sum += PhotonBench::hitMediumBoundary(fixture.photon);
+	}
+	return sum;
+}
+
+
+static double benchPlace(const unsigned long n)
+{
+	// Baseline of the benchmarks that set a photon state for every operation.  The
+	// step is read directly, since getPhotonCoords() copies a shared pointer.
+	Fixture &fixture = getFixture();
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		fixture.place(i);
+		sum += PhotonBench::getStep(fixture.photon);
+	}
+	return sum;
+}
+
+
+static double benchAbsorberLookup(const int num_absorbers, const unsigned long n)
+{
+	static std::vector<Fixture *> fixtures(1001, (Fixture *)NULL);
+	if (!fixtures[num_absorbers])
+		fixtures[num_absorbers] = new Fixture(makeScene(0.9, num_absorbers));
+	Fixture &fixture = *fixtures[num_absorbers];
+
+	Layer *layer = fixture.scene.getMedium()->getLayerFromDepth(1.0);
+	boost::shared_ptr<Vector3d> point(new Vector3d);
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		point->location = fixture.states[i & (NUM_STATES - 1)].location;
+		sum += layer->getAbsorber(point) != NULL;
+	}
+	return sum;
+}
+
+
+static double benchAbsorberLookup1(const unsigned long n) {return benchAbsorberLookup(1, n);}
+static double benchAbsorberLookup10(const unsigned long n) {return benchAbsorberLookup(10, n);}
+static double benchAbsorberLookup1000(const unsigned long n) {return benchAbsorberLookup(1000, n);}
+
+
+static double benchDetector(const unsigned long n)
+{
+	Fixture &fixture = getFixture();
+	Medium *medium = fixture.scene.getMedium();
+	boost::shared_ptr<Vector3d> point(new Vector3d);
+	point->withDirection();
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		// Exits through the bottom of the medium, near the detector.
+		const PhotonState &s = fixture.states[i & (NUM_STATES - 1)];
+		point->location.x = 0.5 + s.location.x / 2;
+		point->location.y = 0.5 + s.location.y / 2;
+		point->location.z = 2.0;
+		point->setDirZ(s.direction.z);
+		sum += medium->photonHitDetectorPlane(point);
+	}
+	return sum;
+}
+
+
+static double benchVectorOps(const unsigned long n)
+{
+	Fixture &fixture = getFixture();
+	double sum = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		const coords &a = fixture.states[i & (NUM_STATES - 1)].location;
+		const coords &b = fixture.states[(i + 1) & (NUM_STATES - 1)].location;
+		Vector3d A(a.x, a.y, a.z), B(b.x, b.y, b.z);
+		Vector3d C = VectorMath::crossProduct(A, B);
+		sum += VectorMath::dotProduct(A, C) + VectorMath::Distance(A, B);
+	}
+	return sum;
+}
+
+
+static double benchLoggerWrite(const unsigned long n)
+{
+	static bool opened = false;
+	if (!opened)
+	{
+		Logger::getInstance()->openExitFile("/dev/null");
+		opened = true;
+	}
+
+	Fixture &fixture = getFixture();
+	boost::shared_ptr<Vector3d> point = fixture.photon.getPhotonCoords();
+	for (unsigned long i = 0; i < n; i++)
+		Logger::getInstance()->writeExitData(point, 0.5, 0.1);
+	return n;
+}
+
+
+static double benchRadialTallyMerge(const unsigned long n)
+{
+	static RadialTally total(100, 0.01, 100, 0.01);
+	static RadialTally local(100, 0.01, 100, 0.01);
+	local.scoreReflectance(0.05, 1.0);
+	for (unsigned long i = 0; i < n; i++)
+		total.merge(local);
+	return total.getNumRadialBins();
+}
+
+
+static double benchEventCounterMerge(const unsigned long n)
+{
+	static EventCounters total;
+	EventCounters local;
+	local.count(EventCounters::STEPS);
+	for (unsigned long i = 0; i < n; i++)
+		total.merge(local);
+	return total.events[EventCounters::STEPS];
+}
+
+
+
+struct Benchmark
+{
+	const char *name;
+	double (*function)(const unsigned long n);
+	unsigned long ops;		// Operations per repetition.
+};
+
+
+static const Benchmark BENCHMARKS[] =
+{
+	{"rng/HybridTaus",				benchHybridTaus,			10000000},
+	{"rng/rand_r",					benchRandR,					10000000},
+	{"rng/mt19937",					benchMersenneTwister,		10000000},
+	{"rng/xorshift64*",				benchXorshift,				10000000},
+	{"step/setStepSize",			benchStepSize,				2000000},
+	{"step/setStepSize-similarity",	benchStepSizeScaled,		1000000},
+	{"spin/g=0.9",					benchSpin,					2000000},
+	{"spin/g=0",					benchSpinIsotropic,			2000000},
+	{"spin/normal-incidence",		benchSpinNormal,			2000000},
+	{"fresnel/medium-reflectance",	benchFresnel,				2000000},
+	{"boundary/place-baseline",		benchPlace,					2000000},
+	{"boundary/hitMediumBoundary",	benchHitMediumBoundary,		2000000},
+	{"absorber/lookup-1",			benchAbsorberLookup1,		2000000},
+	{"absorber/lookup-10",			benchAbsorberLookup10,		1000000},
+	{"absorber/lookup-1000",		benchAbsorberLookup1000,	20000},
+	{"detector/hit-test",			benchDetector,				2000000},
+	{"vector/cross-dot-distance",	benchVectorOps,				2000000},
+	{"logger/writeExitData",		benchLoggerWrite,			20000},
+	{"tally/radial-merge-100x100",	benchRadialTallyMerge,		2000},
+	{"tally/event-counter-merge",	benchEventCounterMerge,		200000},
+};
+
+
+struct BenchResult
+{
+	std::string name;
+	unsigned long ops;
+	int repetitions;
+	double mean, variance, min;		// [ns/op]
+};
+
+
+static double getNanoseconds(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+
+static BenchResult runBenchmark(const Benchmark &benchmark, const int repetitions)
+{
+	// One untimed repetition warms up the caches and sets up the fixtures.
+	sink += benchmark.function(benchmark.ops);
+
+	std::vector<double> times(repetitions);
+	for (int r = 0; r < repetitions; r++)
+	{
+		double start = getNanoseconds();
+		sink += benchmark.function(benchmark.ops);
+		times[r] = (getNanoseconds() - start) / benchmark.ops;
+	}
+
+	BenchResult result;
+	result.name = benchmark.name;
+	result.ops = benchmark.ops;
+	result.repetitions = repetitions;
+	result.mean = result.variance = 0;
+	result.min = times[0];
+	for (int r = 0; r < repetitions; r++)
+	{
+		result.mean += times[r] / repetitions;
+		result.min = std::min(result.min, times[r]);
+	}
+	for (int r = 0; r < repetitions && repetitions > 1; r++)
+		result.variance += (times[r] - result.mean) * (times[r] - result.mean) / (repetitions - 1);
+	return result;
+}
+
+
+static bool writeJson(const std::string &filename, const std::vector<BenchResult> &results)
+{
+	std::ofstream output(filename.c_str());
+	if (!output.is_open())
+	{
+		cout << "Error: could not write " << filename << endl;
+		return false;
+	}
+
+	output << std::setprecision(6);
+	output << "{\"unit\": \"ns/op\", \"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &r = results[i];
+		output << "  {\"name\": \"" << r.name << "\", \"ops\": " << r.ops
+			   << ", \"repetitions\": " << r.repetitions << ", \"mean\": " << r.mean
+			   << ", \"stddev\": " << sqrt(r.variance) << ", \"variance\": " << r.variance
+			   << ", \"min\": " << r.min << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	output << "]}\n";
+	output.close();
+	return !output.fail();
+}
+
+
+
+// mc-boost-bench [--filter <text>] [--repetitions N] [--json <file>] [--list]
+//
+// Times every benchmark whose name contains the filter text and prints the mean,
+// standard deviation and minimum in ns per operation over the repetitions.  With
+// --json the results are also written to <file>, to compare builds.
+int main(int argc, char *argv[])
+{
+	std::string filter, json_file;
+	int repetitions = 10;
+	bool list = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--filter" && i + 1 < argc)
+			filter = argv[++i];
+		else if (option == "--repetitions" && i + 1 < argc)
+			repetitions = atoi(argv[++i]);
+		else if (option == "--json" && i + 1 < argc)
+			json_file = argv[++i];
+		else if (option == "--list")
+			list = true;
+		else
+		{
+			cout << "Usage: mc-boost-bench [--filter <text>] [--repetitions N] [--json <file>] [--list]\n";
+			return 1;
+		}
+	}
+	if (repetitions < 1)
+		repetitions = 1;
+
+	std::vector<BenchResult> results;
+	cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(12) << "ns/op"
+		 << std::setw(12) << "stddev" << std::setw(12) << "min" << "\n";
+	for (size_t i = 0; i < sizeof(BENCHMARKS)/sizeof(BENCHMARKS[0]); i++)
+	{
+		const Benchmark &benchmark = BENCHMARKS[i];
+		if (!filter.empty() && std::string(benchmark.name).find(filter) == std::string::npos)
+			continue;
+		if (list)
+		{
+			cout << benchmark.name << "\n";
+			continue;
+		}
+
+		BenchResult result = runBenchmark(benchmark, repetitions);
+		results.push_back(result);
+		cout << std::left << std::setw(32) << result.name << std::right << std::fixed
+			 << std::setprecision(2) << std::setw(12) << result.mean << std::setw(12)
+			 << sqrt(result.variance) << std::setw(12) << result.min << endl;
+	}
+
+	if (!json_file.empty() && !writeJson(json_file, results))
+		return 1;
+
+	return 0;
+}
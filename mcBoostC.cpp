@@ -0,0 +1,267 @@
+//
+//  mcBoostC.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "mcBoostC.h"
+#include "simulator.h"
+#include <algorithm>
+#include <exception>
+
+
+struct mcb_simulator
+{
+    mcb_simulator(const int num_threads) : simulator(num_threads) {}
+    Simulator simulator;
+};
+
+
+// The description is compiled on the first run after it changed.
+struct mcb_scene
+{
+    mcb_scene() : compiled(NULL) {}
+    ~mcb_scene() {delete compiled;}
+
+    void changed(void)
+    {
+        delete compiled;
+        compiled = NULL;
+    }
+
+    SceneDescription description;
+    Scene *compiled;
+};
+
+
+
+// Compile the scene if needed and run it.
+static bool runScene(mcb_simulator *simulator, mcb_scene *scene, const mcb_options *options,
+                     RunResults &results)
+{
+    if (!simulator || !scene || !options || scene->description.layers.empty())
+        return false;
+
+    try
+    {
+        if (options->batch_size != scene->description.batch_size)
+        {
+            scene->description.batch_size = options->batch_size;
+            scene->changed();
+        }
+        if (!scene->compiled)
+            scene->compiled = new Scene(scene->description);
+
+        RunOptions run_options;
+        run_options.num_photons = options->num_photons;
+        run_options.seed = options->seed;
+        run_options.chunk_size = options->chunk_size;
+        if (options->cache_dir)
+            run_options.cache_dir = options->cache_dir;
+        results = simulator->simulator.run(*scene->compiled, run_options);
+    }
+    catch (std::exception &)
+    {
+        return false;
+    }
+    return true;
+}
+
+
+extern "C" {
+
+mcb_simulator * mcb_simulator_create(int num_threads)
+{
+    try
+    {
+        return new mcb_simulator(num_threads);
+    }
+    catch (std::exception &)
+    {
+        return NULL;
+    }
+}
+
+
+void mcb_simulator_destroy(mcb_simulator *simulator)
+{
+    delete simulator;
+}
+
+
+mcb_scene * mcb_scene_create(double x_dim, double y_dim, double z_dim)
+{
+    if (x_dim <= 0 || y_dim <= 0 || z_dim <= 0)
+        return NULL;
+
+    mcb_scene *scene = new mcb_scene;
+    scene->description.x_dim = x_dim;
+    scene->description.y_dim = y_dim;
+    scene->description.z_dim = z_dim;
+    scene->description.source.x = x_dim/2;
+    scene->description.source.y = y_dim/2;
+    scene->description.source.z = 1e-15;
+    return scene;
+}
+
+
+void mcb_scene_destroy(mcb_scene *scene)
+{
+    delete scene;
+}
+
+
+int mcb_scene_add_layer(mcb_scene *scene, double mu_a, double mu_s, double n, double g,
+                        double depth_start, double depth_end)
+{
+    if (!scene || depth_end <= depth_start)
+        return -1;
+    scene->description.addLayer(mu_a, mu_s, n, g, depth_start, depth_end);
+    scene->changed();
+    return 0;
+}
+
+
+int mcb_scene_add_sphere_absorber(mcb_scene *scene, double radius, double x, double y, double z,
+                                  double mu_a, double mu_s)
+{
+    if (!scene || radius <= 0)
+        return -1;
+    scene->description.addSphereAbsorber(radius, x, y, z, mu_a, mu_s);
+    scene->changed();
+    return 0;
+}
+
+
+int mcb_scene_add_detector(mcb_scene *scene, double radius, double x, double y, double z)
+{
+    if (!scene || radius <= 0)
+        return -1;
+    scene->description.addDetector(radius, x, y, z);
+    scene->changed();
+    return 0;
+}
+
+
+int mcb_scene_set_source(mcb_scene *scene, double x, double y, double z)
+{
+    if (!scene)
+        return -1;
+    scene->description.source.x = x;
+    scene->description.source.y = y;
+    scene->description.source.z = z;
+    scene->changed();
+    return 0;
+}
+
+
+int mcb_scene_set_layer_properties(mcb_scene *scene, int layer, double mu_a, double mu_s, double g)
+{
+    if (!scene || layer < 0 || layer >= (int)scene->description.layers.size())
+        return -1;
+    LayerDescription &l = scene->description.layers[layer];
+    l.mu_a = mu_a;
+    l.mu_s = mu_s;
+    l.anisotropy = g;
+    scene->changed();
+    return 0;
+}
+
+
+int mcb_scene_set_absorber_properties(mcb_scene *scene, int absorber, double mu_a, double mu_s)
+{
+    if (!scene || absorber < 0 || absorber >= (int)scene->description.absorbers.size())
+        return -1;
+    scene->description.absorbers[absorber].mu_a = mu_a;
+    scene->description.absorbers[absorber].mu_s = mu_s;
+    scene->changed();
+    return 0;
+}
+
+
+int mcb_scene_set_pencil_beam_tallies(mcb_scene *scene, int num_r, double dr, int num_z, double dz)
+{
+    if (!scene || num_r <= 0 || dr <= 0 || num_z <= 0 || dz <= 0)
+        return -1;
+    scene->description.num_radial_bins = num_r;
+    scene->description.radial_bin_size = dr;
+    scene->description.num_depth_bins = num_z;
+    scene->description.depth_bin_size = dz;
+    scene->changed();
+    return 0;
+}
+
+
+void mcb_default_options(mcb_options *options)
+{
+    RunOptions defaults;
+    options->num_photons = defaults.num_photons;
+    options->seed = defaults.seed;
+    options->chunk_size = defaults.chunk_size;
+    options->batch_size = 0;
+    options->cache_dir = NULL;
+}
+
+
+int mcb_run(mcb_simulator *simulator, mcb_scene *scene, const mcb_options *options,
+            mcb_totals *totals, double *reflectance, double *reflectance_error, int num_r)
+{
+    RunResults results;
+    if (!runScene(simulator, scene, options, results))
+        return -1;
+
+    if (totals)
+    {
+        totals->num_photons = results.num_photons;
+        totals->num_detected = results.num_detected;
+        totals->steps_per_photon = results.steps_per_photon;
+        totals->detected_weight = results.detected_weight;
+        totals->detected_weight_error = results.detected_weight_error;
+        totals->absorber_weight = results.total_absorber_weight;
+        totals->absorber_weight_error = results.total_absorber_weight_error;
+    }
+
+    if (reflectance && num_r > 0)
+    {
+        int n = std::min(num_r, (int)results.reflectance.size());
+        for (int i = 0; i < num_r; i++)
+        {
+            reflectance[i] = i < n ? results.reflectance[i] : 0.0;
+            if (reflectance_error)
+                reflectance_error[i] = i < n ? results.reflectance_error[i] : 0.0;
+        }
+    }
+
+    return 0;
+}
+
+
+int mcb_run_callback(mcb_simulator *simulator, mcb_scene *scene, const mcb_options *options,
+                     mcb_tally_callback callback, void *user_data)
+{
+    RunResults results;
+    if (!callback || !runScene(simulator, scene, options, results))
+        return -1;
+
+    callback("detected_weight", &results.detected_weight, &results.detected_weight_error, 1, user_data);
+
+    if (!results.absorber_weight.empty())
+    {
+        callback("absorber_weight", &results.absorber_weight[0], &results.absorber_weight_error[0],
+                 results.absorber_weight.size(), user_data);
+    }
+
+    if (!results.reflectance.empty())
+    {
+        callback("reflectance", &results.reflectance[0], &results.reflectance_error[0],
+                 results.reflectance.size(), user_data);
+        callback("transmittance", &results.transmittance[0], &results.transmittance_error[0],
+                 results.transmittance.size(), user_data);
+        callback("absorption", &results.absorption[0], &results.absorption_error[0],
+                 results.absorption.size(), user_data);
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ *  mcBoostC.h
+ *
+ *  Copyright 2011 BMPI. All rights reserved.
+ *
+ *  Thin C interface of libmcboost.  A simulator keeps its worker threads between
+ *  runs, and scenes are compiled once and only recompiled after they change, so
+ *  callers can run the forward model many times at little more than the cost of
+ *  the photons.  Results are written to caller provided buffers or handed to a
+ *  callback.  All functions returning int return 0 on success and -1 on failure.
+ */
+#ifndef MCBOOSTC_H
+#define MCBOOSTC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mcb_simulator mcb_simulator;
+typedef struct mcb_scene mcb_scene;
+
+/* Options of a run, initialize with mcb_default_options(). */
+typedef struct
+{
+    unsigned long num_photons;
+    unsigned long long seed;
+    unsigned long chunk_size;   /* photons handed to a worker at a time */
+    unsigned long batch_size;   /* photons per batch of the standard errors, 0 = none */
+    const char *cache_dir;      /* directory of the on-disk result cache, NULL = none */
+} mcb_options;
+
+/* Totals of a run, normalized per launched photon. */
+typedef struct
+{
+    unsigned long num_photons;
+    unsigned long num_detected;
+    double steps_per_photon;
+    double detected_weight;
+    double detected_weight_error;
+    double absorber_weight;         /* summed over all absorbers */
+    double absorber_weight_error;
+} mcb_totals;
+
+/* Receives the tallies of a run one at a time: "detected_weight", "absorber_weight"
+ * (one value per absorber), "reflectance", "transmittance" and "absorption".  The
+ * arrays are only valid during the call.  'errors' holds the standard errors, which
+ * are zero when 'batch_size' is 0. */
+typedef void (*mcb_tally_callback)(const char *name, const double *values, const double *errors,
+                                   int count, void *user_data);
+
+/* A simulator with 'num_threads' workers, <= 0 uses one per core. */
+mcb_simulator * mcb_simulator_create(int num_threads);
+void            mcb_simulator_destroy(mcb_simulator *simulator);
+
+/* A scene of the given dimensions [cm].  The source defaults to the center of the top surface. */
+mcb_scene * mcb_scene_create(double x_dim, double y_dim, double z_dim);
+void        mcb_scene_destroy(mcb_scene *scene);
+
+int mcb_scene_add_layer(mcb_scene *scene, double mu_a, double mu_s, double n, double g,
+                        double depth_start, double depth_end);
+int mcb_scene_add_sphere_absorber(mcb_scene *scene, double radius, double x, double y, double z,
+                                  double mu_a, double mu_s);
+int mcb_scene_add_detector(mcb_scene *scene, double radius, double x, double y, double z);
+int mcb_scene_set_source(mcb_scene *scene, double x, double y, double z);
+
+/* Change the optical properties of a layer or absorber (index in order of addition). */
+int mcb_scene_set_layer_properties(mcb_scene *scene, int layer, double mu_a, double mu_s, double g);
+int mcb_scene_set_absorber_properties(mcb_scene *scene, int absorber, double mu_a, double mu_s);
+
+/* Launch a pencil beam and tally R(r), T(r) and A(r,z). */
+int mcb_scene_set_pencil_beam_tallies(mcb_scene *scene, int num_r, double dr, int num_z, double dz);
+
+void mcb_default_options(mcb_options *options);
+
+/* Run 'scene'.  'totals' may be NULL.  When 'reflectance' is not NULL it receives
+ * 'num_r' values of R(r), and 'reflectance_error' (may be NULL) their errors. */
+int mcb_run(mcb_simulator *simulator, mcb_scene *scene, const mcb_options *options,
+            mcb_totals *totals, double *reflectance, double *reflectance_error, int num_r);
+
+/* Run 'scene' and hand every tally to 'callback'. */
+int mcb_run_callback(mcb_simulator *simulator, mcb_scene *scene, const mcb_options *options,
+                     mcb_tally_callback callback, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCBOOSTC_H */
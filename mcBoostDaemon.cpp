@@ -0,0 +1,85 @@
+/*
+ * Copyright BMPI 2011
+ *
+ * mc-boost-daemon: runs simulation jobs from a spool directory on a warm worker pool.
+ *
+ */
+
+#include "jobDaemon.h"
+#include <csignal>
+#include <cstdlib>
+#include <string>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+static void handleSignal(int signal)
+{
+	JobDaemon::stop();
+}
+
+
+
+// mc-boost-daemon <spool-dir> [--threads N] [--cache N] [--result-cache dir]
+//                              [--live <seconds>] [--perf]
+//
+// See jobDaemon.h for the layout of the spool directory and the job files.  '--cache'
+// sets the number of compiled scenes kept in memory, and '--result-cache' a directory
+// where the tallies of every job are stored and reused by identical later jobs.
+// '--live' publishes the tallies of the running job as '/mc-boost-job-<id>' for
+// mc-boost-watch.  '--perf' logs the hardware performance counters of every job.  The
+// daemon stops on SIGINT or SIGTERM; a job interrupted that way is run again when
+// the daemon is restarted.
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		cout << "Usage: mc-boost-daemon <spool-dir> [--threads N] [--cache N] [--result-cache dir]\n"
+			 << "                       [--live <seconds>] [--perf]\n";
+		return 1;
+	}
+
+	int num_threads = 0;
+	size_t max_cached_scenes = 16;
+	std::string cache_dir;
+	double live_interval = 0;
+	bool perf = false;
+	for (int i = 2; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--perf")
+			perf = true;
+		else if (option == "--threads" && i + 1 < argc)
+			num_threads = atoi(argv[++i]);
+		else if (option == "--cache" && i + 1 < argc)
+			max_cached_scenes = strtoul(argv[++i], NULL, 10);
+		else if (option == "--result-cache" && i + 1 < argc)
+			cache_dir = argv[++i];
+		else if (option == "--live" && i + 1 < argc)
+			live_interval = atof(argv[++i]);
+		else
+		{
+			cout << "Error: unknown option " << option << endl;
+			return 1;
+		}
+	}
+
+	signal(SIGINT, handleSignal);
+	signal(SIGTERM, handleSignal);
+
+	JobDaemon daemon(argv[1], num_threads, max_cached_scenes);
+	if (!cache_dir.empty())
+		daemon.setResultCache(cache_dir);
+	daemon.setLiveTallies(live_interval);
+	if (perf)
+		daemon.enablePerfCounters();
+	if (!daemon.initialize())
+		return 1;
+
+	cout << "Serving jobs from " << argv[1] << endl;
+	daemon.run();
+	cout << "Stopped\n";
+
+	return 0;
+}
@@ -0,0 +1,457 @@
+/*
+ * Copyright BMPI 2011
+ *
+ * mc-boost-reference: accuracy and efficiency of canonical scenes with known answers.
+ *
+ */
+
+#include "scene.h"
+#include "medium.h"
+#include "radialTally.h"
+#include "workerPool.h"
+#include "checkpointedRun.h"
+#include "timer.h"
+#include <boost/thread/thread.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+
+// A reference quantity of a scene: the weight per launched photon leaving through the
+// top (reflectance) or bottom (transmittance) surface between radii [r_min, r_max).
+struct Quantity
+{
+	std::string name;
+	bool reflectance;
+	double r_min, r_max;        // [cm], r_max < 0 for everything beyond r_min
+	double value;               // reference value
+	double tolerance;           // relative uncertainty of the reference itself
+	std::string source;
+};
+
+
+struct Reference
+{
+	std::string name;
+	std::string description;
+	SceneDescription scene;
+	std::vector<Quantity> quantities;
+};
+
+
+static Quantity makeQuantity(const std::string &name, const bool reflectance,
+							 const double r_min, const double r_max, const double value,
+							 const double tolerance, const std::string &source)
+{
+	Quantity q;
+	q.name = name;
+	q.reflectance = reflectance;
+	q.r_min = r_min;
+	q.r_max = r_max;
+	q.value = value;
+	q.tolerance = tolerance;
+	q.source = source;
+	return q;
+}
+
+
+// A laterally wide slab of 'thickness' [cm] lit by a pencil beam at the center of its
+// top surface, tallied in 'num_r' rings of 'dr' [cm] (the last collects everything
+// beyond).
+static SceneDescription makeSlab(const double thickness, const int num_r, const double dr)
+{
+	SceneDescription scene;
+	scene.x_dim = scene.y_dim = 20.0;
+	scene.z_dim = thickness;
+	scene.source.x = scene.x_dim/2;
+	scene.source.y = scene.y_dim/2;
+	scene.source.z = 1e-15;
+	scene.num_radial_bins = num_r;
+	scene.radial_bin_size = dr;
+	scene.num_depth_bins = 1;
+	scene.depth_bin_size = thickness;
+	return scene;
+}
+
+
+// Steady-state diffuse reflectance R(r) [1/cm^2] of a semi-infinite, index-matched
+// medium from the dipole model with an extrapolated boundary (Farrell, Patterson &
+// Wilson 1992).
+static double diffusionReflectance(const double r, const double mu_a, const double mu_s_reduced)
+{
+	double mu_t = mu_a + mu_s_reduced;
+	double albedo = mu_s_reduced / mu_t;
+	double mu_eff = sqrt(3.0 * mu_a * mu_t);
+	double D = 1.0 / (3.0 * mu_t);
+	double z0 = 1.0 / mu_t;
+	double zb = 2.0 * D;        // A = 1 for a matched boundary
+	double r1 = sqrt(z0*z0 + r*r);
+	double r2 = sqrt((z0 + 2*zb)*(z0 + 2*zb) + r*r);
+	return albedo / (4*PI) * (z0 * (mu_eff + 1/r1) * exp(-mu_eff*r1) / (r1*r1)
+							  + (z0 + 2*zb) * (mu_eff + 1/r2) * exp(-mu_eff*r2) / (r2*r2));
+}
+
+
+// Total diffuse reflectance of a semi-infinite, index-matched medium with isotropic
+// scattering of 'albedo' for a normally incident beam: 1 - H(1) sqrt(1 - albedo),
+// with Chandrasekhar's H-function solved by iterating its integral equation on a
+// midpoint grid of directions.
+static double semiInfiniteReflectance(const double albedo)
+{
+	const int N = 400;
+	std::vector<double> H(N, 1.0), next(N);
+	for (int iteration = 0; iteration < 1000; iteration++)
+	{
+		double change = 0;
+		for (int i = 0; i < N; i++)
+		{
+			double mu = (i + 0.5) / N, sum = 0;
+			for (int k = 0; k < N; k++)
+				sum += H[k] / (mu + (k + 0.5) / N);
+			next[i] = 1.0 / (1.0 - mu * albedo / 2 * sum / N);
+			change = std::max(change, fabs(next[i] - H[i]));
+		}
+		H.swap(next);
+		if (change < 1e-12)
+			break;
+	}
+
+	double sum = 0;
+	for (int k = 0; k < N; k++)
+		sum += H[k] / (1.0 + (k + 0.5) / N);
+	double H1 = 1.0 / (1.0 - albedo / 2 * sum / N);
+	return 1.0 - H1 * sqrt(1.0 - albedo);
+}
+
+
+// Integral of the diffusion reflectance over the ring [r_min, r_max).
+static double diffusionRing(const double r_min, const double r_max, const double mu_a,
+							const double mu_s_reduced)
+{
+	const int steps = 1000;
+	double dr = (r_max - r_min) / steps;
+	double sum = 0;
+	for (int i = 0; i < steps; i++)
+	{
+		double r = r_min + (i + 0.5) * dr;
+		sum += diffusionReflectance(r, mu_a, mu_s_reduced) * 2*PI * r * dr;
+	}
+	return sum;
+}
+
+
+// The reference scenes.  All boundaries are index matched (n = 1), so neither
+// specular reflection nor internal reflection enters the comparison.
+static std::vector<Reference> makeReferences(void)
+{
+	std::vector<Reference> references;
+
+	// Slab of optical thickness 2, albedo 0.9 and g = 0.75 (van de Hulst 1980, as
+	// tabulated by Wang, Jacques & Zheng 1995 to validate MCML).
+	Reference slab;
+	slab.name = "mcml-slab";
+	slab.description = "slab d=0.02 cm, mu_a=10, mu_s=90, g=0.75, n=1";
+	slab.scene = makeSlab(0.02, 1, 1.0);
+	slab.scene.addLayer(10.0, 90.0, 1.0, 0.75, 0.0, 0.02);
+	slab.quantities.push_back(makeQuantity("Rd", true, 0, -1, 0.09739, 0.001, "van de Hulst 1980"));
+	slab.quantities.push_back(makeQuantity("Tt", false, 0, -1, 0.66096, 0.001, "van de Hulst 1980"));
+	references.push_back(slab);
+
+	// The same slab described as two layers, which must not change the answer.
+	Reference layered = slab;
+	layered.name = "mcml-two-layer";
+	layered.description = "mcml-slab split into two identical layers";
+	layered.scene.layers.clear();
+	layered.scene.addLayer(10.0, 90.0, 1.0, 0.75, 0.0, 0.01);
+	layered.scene.addLayer(10.0, 90.0, 1.0, 0.75, 0.01, 0.02);
+	references.push_back(layered);
+
+	// Semi-infinite medium with isotropic scattering and albedo 0.9, 100 mean free
+	// paths deep, against the exact transport solution.
+	Reference semi_infinite;
+	semi_infinite.name = "semi-infinite";
+	semi_infinite.description = "semi-infinite, mu_a=10, mu_s=90, g=0, n=1";
+	semi_infinite.scene = makeSlab(1.0, 1, 1.0);
+	semi_infinite.scene.addLayer(10.0, 90.0, 1.0, 0.0, 0.0, 1.0);
+	semi_infinite.quantities.push_back(makeQuantity("Rd", true, 0, -1, semiInfiniteReflectance(0.9),
+													0.001, "Chandrasekhar H"));
+	references.push_back(semi_infinite);
+
+	// Highly scattering semi-infinite medium.  The total reflectance is exact; the
+	// diffusion dipole only holds far from the source, and still underestimates the
+	// reflectance by about 10% at 5-10 transport mean free paths (here 0.1 cm), so
+	// it is compared at 10-20.
+	const double mu_a = 0.1, mu_s = 10.0;
+	Reference diffusion;
+	diffusion.name = "diffusion";
+	diffusion.description = "semi-infinite, mu_a=0.1, mu_s=10, g=0, n=1";
+	diffusion.scene = makeSlab(5.0, 50, 0.05);
+	diffusion.scene.addLayer(mu_a, mu_s, 1.0, 0.0, 0.0, 5.0);
+	diffusion.quantities.push_back(makeQuantity("Rd", true, 0, -1, semiInfiniteReflectance(mu_s / (mu_a + mu_s)),
+												0.001, "Chandrasekhar H"));
+	diffusion.quantities.push_back(makeQuantity("R(1-2 cm)", true, 1.0, 2.0,
+												diffusionRing(1.0, 2.0, mu_a, mu_s), 0.05,
+												"diffusion dipole"));
+	references.push_back(diffusion);
+
+	// Purely absorbing, index-matched slab: every photon crosses unscattered or is
+	// absorbed, so T = exp(-mu_a d).
+	Reference beer_lambert;
+	beer_lambert.name = "beer-lambert";
+	beer_lambert.description = "slab d=1 cm, mu_a=1, mu_s=0, n=1";
+	beer_lambert.scene = makeSlab(1.0, 1, 1.0);
+	beer_lambert.scene.addLayer(1.0, 0.0, 1.0, 0.0, 0.0, 1.0);
+	beer_lambert.quantities.push_back(makeQuantity("Tt", false, 0, -1, exp(-1.0), 0, "Beer-Lambert"));
+	references.push_back(beer_lambert);
+
+	return references;
+}
+
+
+// Weight per launched photon of 'q' in the pencil-beam tally, undoing the ring area
+// normalization of RadialTally.
+static double measure(const RadialTally &tally, const Quantity &q)
+{
+	std::vector<double> values = q.reflectance ? tally.getReflectance() : tally.getTransmittance();
+	double sum = 0;
+	for (int ir = 0; ir < tally.getNumRadialBins(); ir++)
+	{
+		double r = tally.getRadius(ir);
+		if (r < q.r_min || (q.r_max >= 0 && r >= q.r_max))
+			continue;
+		sum += values[ir] * 2.0 * PI * r * tally.getRadialBinSize();
+	}
+	return sum;
+}
+
+
+struct QuantityResult
+{
+	std::string scene, quantity, source;
+	double value, std_error;    // per photon
+	double reference, tolerance;
+	double elapsed;             // [s]
+	unsigned long photons;
+
+	// Deviation from the reference in combined standard errors.
+	double deviation(void) const
+	{
+		double sigma = sqrt(std_error*std_error + (tolerance*reference)*(tolerance*reference));
+		return sigma > 0 ? (value - reference) / sigma : 0;
+	}
+
+	// Figure of merit 1/(R^2 T) with R the relative standard error, so efficiencies of
+	// different quantities compare directly.
+	double figureOfMerit(void) const
+	{
+		double rel_error = value != 0 ? std_error / fabs(value) : 0;
+		return rel_error > 0 ? 1.0 / (rel_error*rel_error * elapsed) : 0;
+	}
+};
+
+
+// Run 'reference' in 'batches' equal batches of the run and return one result per
+// quantity.  The standard errors are batch means: every batch is a photon range of
+// one checkpointed run, and the difference of the cumulative tallies before and after
+// it gives its totals.
+static std::vector<QuantityResult> runReference(WorkerPool &pool, const Reference &reference,
+												const unsigned long photons, const int batches,
+												const unsigned long chunk_size)
+{
+	Scene scene(reference.scene);
+	RadialTally *tally = scene.getMedium()->getRadialTally();
+	size_t num_quantities = reference.quantities.size();
+	std::vector<double> previous(num_quantities, 0.0), sum(num_quantities, 0.0),
+						sum_sq(num_quantities, 0.0);
+
+	unsigned long batch_photons = photons / batches;
+	CheckpointedRun run(pool, &scene, chunk_size, 1);
+	double start = getWallTime();
+	for (int b = 0; b < batches; b++)
+	{
+		run.run(b * batch_photons, (b + 1) * batch_photons);
+		for (size_t i = 0; i < num_quantities; i++)
+		{
+			double total = measure(*tally, reference.quantities[i]) * tally->getNumPhotons();
+			double batch_mean = (total - previous[i]) / batch_photons;
+			previous[i] = total;
+			sum[i] += batch_mean;
+			sum_sq[i] += batch_mean * batch_mean;
+		}
+	}
+	double elapsed = getWallTime() - start;
+
+	std::vector<QuantityResult> results;
+	for (size_t i = 0; i < num_quantities; i++)
+	{
+		const Quantity &q = reference.quantities[i];
+		QuantityResult result;
+		result.scene = reference.name;
+		result.quantity = q.name;
+		result.source = q.source;
+		result.value = sum[i] / batches;
+		double variance = (sum_sq[i] / batches - result.value * result.value) * batches / (batches - 1);
+		result.std_error = variance > 0 ? sqrt(variance / batches) : 0;
+		result.reference = q.value;
+		result.tolerance = q.tolerance;
+		result.elapsed = elapsed;
+		result.photons = batch_photons * batches;
+		results.push_back(result);
+	}
+	return results;
+}
+
+
+static void printHeader(void)
+{
+	cout << std::left << std::setw(20) << "scene" << std::setw(13) << "quantity" << std::right
+		 << std::setw(11) << "MC" << std::setw(10) << "std err" << std::setw(11) << "reference"
+		 << std::setw(9) << "rel dev" << std::setw(8) << "sigmas" << std::setw(10) << "time [s]"
+		 << std::setw(12) << "FOM [1/s]" << "  " << std::left << "reference source" << std::right << "\n";
+}
+
+
+static void printResult(const QuantityResult &r, const bool pass)
+{
+	cout << std::left << std::setw(20) << r.scene << std::setw(13) << r.quantity << std::right
+		 << std::fixed << std::setprecision(5) << std::setw(11) << r.value << std::setw(10) << r.std_error
+		 << std::setw(11) << r.reference << std::setprecision(2) << std::setw(8)
+		 << 100 * (r.value - r.reference) / r.reference << "%" << std::setw(8) << r.deviation()
+		 << std::setprecision(3) << std::setw(10) << r.elapsed << std::setprecision(0)
+		 << std::setw(12) << r.figureOfMerit() << "  " << r.source << (pass ? "" : "  FAIL") << endl;
+}
+
+
+static bool writeJson(const std::string &filename, const std::vector<QuantityResult> &results,
+					  const double max_sigmas)
+{
+	std::ofstream output(filename.c_str());
+	if (!output.is_open())
+	{
+		cout << "Error: could not write " << filename << endl;
+		return false;
+	}
+
+	output << std::setprecision(8);
+	output << "{\"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const QuantityResult &r = results[i];
+		output << "  {\"scene\": \"" << r.scene << "\", \"quantity\": \"" << r.quantity
+			   << "\", \"source\": \"" << r.source << "\", \"photons\": " << r.photons
+			   << ", \"value\": " << r.value << ", \"std_error\": " << r.std_error
+			   << ", \"reference\": " << r.reference << ", \"tolerance\": " << r.tolerance
+			   << ", \"sigmas\": " << r.deviation() << ", \"elapsed\": " << r.elapsed
+			   << ", \"figure_of_merit\": " << r.figureOfMerit() << ", \"pass\": "
+			   << (fabs(r.deviation()) <= max_sigmas ? "true" : "false") << "}"
+			   << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	output << "]}\n";
+	output.close();
+	return !output.fail();
+}
+
+
+
+// mc-boost-reference [--scene <name>|all] [--photons N] [--batches N] [--threads N]
+//                    [--chunk-size N] [--max-sigmas S] [--json <file>] [--list]
+//
+// Runs canonical scenes whose answers are known from theory or published tables
+// and reports, per quantity, the Monte Carlo estimate with its batch-means standard
+// error, the deviation from the reference, and the figure of merit 1/(R^2 T) with 'R'
+// the relative standard error and 'T' the wall time.  The figure of merit is what
+// a faster kernel or a variance reduction has to improve: halving the time per
+// photon while doubling the variance leaves it unchanged.  A quantity fails when it
+// deviates more than --max-sigmas (default 3) standard errors, combining that of the
+// estimate with the uncertainty of the reference; the exit status is 1 if any fails.
+int main(int argc, char *argv[])
+{
+	std::string scene_name = "all", json_file;
+	unsigned long photons = 200000, chunk_size = 1000;
+	int batches = 20;
+	int num_threads = boost::thread::hardware_concurrency();
+	double max_sigmas = 3.0;
+	bool list = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--scene" && i + 1 < argc)
+			scene_name = argv[++i];
+		else if (option == "--photons" && i + 1 < argc)
+			photons = strtoul(argv[++i], NULL, 10);
+		else if (option == "--batches" && i + 1 < argc)
+			batches = atoi(argv[++i]);
+		else if (option == "--threads" && i + 1 < argc)
+			num_threads = atoi(argv[++i]);
+		else if (option == "--chunk-size" && i + 1 < argc)
+			chunk_size = strtoul(argv[++i], NULL, 10);
+		else if (option == "--max-sigmas" && i + 1 < argc)
+			max_sigmas = atof(argv[++i]);
+		else if (option == "--json" && i + 1 < argc)
+			json_file = argv[++i];
+		else if (option == "--list")
+			list = true;
+		else
+		{
+			cout << "Usage: mc-boost-reference [--scene <name>|all] [--photons N] [--batches N] [--threads N]\n"
+				 << "                          [--chunk-size N] [--max-sigmas S] [--json <file>] [--list]\n";
+			return 1;
+		}
+	}
+	if (num_threads < 1)
+		num_threads = 1;
+	if (batches < 2)
+		batches = 2;
+	if (photons < (unsigned long)batches)
+		photons = batches;
+
+	std::vector<Reference> references = makeReferences();
+	if (list)
+	{
+		for (size_t i = 0; i < references.size(); i++)
+			cout << std::left << std::setw(20) << references[i].name << references[i].description << "\n";
+		return 0;
+	}
+
+	WorkerPool pool(num_threads);
+	std::vector<QuantityResult> results;
+	bool found = false, all_pass = true;
+	printHeader();
+	for (size_t i = 0; i < references.size(); i++)
+	{
+		if (scene_name != "all" && scene_name != references[i].name)
+			continue;
+		found = true;
+
+		std::vector<QuantityResult> scene_results = runReference(pool, references[i], photons,
+																 batches, chunk_size);
+		for (size_t j = 0; j < scene_results.size(); j++)
+		{
+			bool pass = fabs(scene_results[j].deviation()) <= max_sigmas;
+			all_pass = all_pass && pass;
+			printResult(scene_results[j], pass);
+			results.push_back(scene_results[j]);
+		}
+	}
+	if (!found)
+	{
+		cout << "Error: unknown scene " << scene_name << endl;
+		return 1;
+	}
+
+	if (!json_file.empty() && !writeJson(json_file, results, max_sigmas))
+		return 1;
+
+	return all_pass ? 0 : 1;
+}
@@ -0,0 +1,318 @@
+/*
+ * Copyright BMPI 2011
+ *
+ * mc-boost-scale: strong and weak scaling of canonical scenes over the number of threads.
+ *
+ */
+
+#include "scene.h"
+#include "medium.h"
+#include "workerPool.h"
+#include "checkpointedRun.h"
+#include "logger.h"
+#include "timer.h"
+#include <boost/thread/thread.hpp>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// The canonical scenes.  'default' is the scene of mc-boost, whose detected photons
+// are written through the Logger; 'pencil-beam' adds large R(r), T(r), A(r,z) tallies
+// merged at the end of every chunk, and 'absorbers' spreads the weight over 27
+// absorbers, each with its own lock.
+static bool makeScene(const std::string &name, SceneDescription &scene)
+{
+	scene.x_dim = scene.y_dim = scene.z_dim = 2.0;
+	scene.addLayer(1.0, 30.0, 1.33, 0.9, 0.0, scene.z_dim);
+	scene.source.x = scene.x_dim/2;
+	scene.source.y = scene.y_dim/2;
+	scene.source.z = 1e-15;
+
+	if (name == "default")
+	{
+		scene.addSphereAbsorber(0.1, 1.0, 1.0, 1.0, 2.0, 30.0);
+		scene.addDetector(0.15, scene.x_dim/2, scene.y_dim/2, scene.z_dim);
+	}
+	else if (name == "pencil-beam")
+	{
+		scene.num_radial_bins = 200;
+		scene.radial_bin_size = 0.005;
+		scene.num_depth_bins = 100;
+		scene.depth_bin_size = 0.02;
+		scene.batch_size = 1000;
+	}
+	else if (name == "absorbers")
+	{
+		for (int i = 0; i < 27; i++)
+			scene.addSphereAbsorber(0.1, 0.5 + 0.5 * (i % 3), 0.5 + 0.5 * (i / 3 % 3),
+									0.5 + 0.5 * (i / 9), 2.0, 30.0);
+	}
+	else
+		return false;
+
+	return true;
+}
+
+
+struct ScaleResult
+{
+	std::string scene, mode;
+	int threads;
+	unsigned long photons;
+	double elapsed;						// [s]
+	double speedup, efficiency;
+	std::vector<double> busy, idle, lock_wait;	// per thread [s]
+};
+
+
+// Run 'photons' photons of 'scene' on 'num_threads' workers and keep the fastest of
+// 'repetitions' runs.  The pool is created before the clock starts.
+static ScaleResult runScene(Scene &scene, const int num_threads, const unsigned long photons,
+							const unsigned long chunk_size, const int repetitions)
+{
+	WorkerPool pool(num_threads);
+	ScaleResult best;
+	best.elapsed = -1;
+	for (int r = 0; r < repetitions; r++)
+	{
+		scene.getMedium()->clearTallies();
+		pool.resetStats();
+		CheckpointedRun run(pool, &scene, chunk_size, 1);
+		double start = getWallTime();
+		run.run(photons);
+		double elapsed = getWallTime() - start;
+		if (best.elapsed >= 0 && elapsed >= best.elapsed)
+			continue;
+
+		best.threads = num_threads;
+		best.photons = photons;
+		best.elapsed = elapsed;
+		best.busy.resize(num_threads);
+		best.idle.resize(num_threads);
+		best.lock_wait.resize(num_threads);
+		for (int w = 0; w < num_threads; w++)
+		{
+			WorkerPool::WorkerStats stats = pool.getWorkerStats(w);
+			best.busy[w] = stats.busy;
+			best.idle[w] = std::max(elapsed - stats.busy, 0.0);
+			best.lock_wait[w] = stats.lock_wait;
+		}
+	}
+	return best;
+}
+
+
+static void printHeader(void)
+{
+	cout << std::left << std::setw(14) << "scene" << std::setw(8) << "mode" << std::right
+		 << std::setw(8) << "threads" << std::setw(11) << "photons" << std::setw(10) << "time [s]"
+		 << std::setw(12) << "photons/s" << std::setw(9) << "speedup" << std::setw(11) << "efficiency"
+		 << std::setw(10) << "idle %" << std::setw(13) << "max idle %" << std::setw(13) << "lock wait %" << "\n";
+}
+
+
+static void printResult(const ScaleResult &r, const bool per_thread)
+{
+	double idle = 0, max_idle = 0, lock_wait = 0, busy = 0;
+	for (int w = 0; w < r.threads; w++)
+	{
+		idle += r.idle[w];
+		max_idle = std::max(max_idle, r.idle[w]);
+		lock_wait += r.lock_wait[w];
+		busy += r.busy[w];
+	}
+
+	cout << std::left << std::setw(14) << r.scene << std::setw(8) << r.mode << std::right << std::fixed
+		 << std::setw(8) << r.threads << std::setw(11) << r.photons << std::setprecision(3)
+		 << std::setw(10) << r.elapsed << std::setprecision(0) << std::setw(12) << r.photons / r.elapsed
+		 << std::setprecision(2) << std::setw(9) << r.speedup << std::setw(11) << r.efficiency
+		 << std::setprecision(1) << std::setw(10) << 100 * idle / (r.threads * r.elapsed)
+		 << std::setw(13) << 100 * max_idle / r.elapsed
+		 << std::setprecision(2) << std::setw(13) << (busy > 0 ? 100 * lock_wait / busy : 0.0) << endl;
+
+	if (per_thread)
+	{
+		for (int w = 0; w < r.threads; w++)
+		{
+			cout << std::setprecision(4) << "    worker " << w << ": busy " << r.busy[w] << " s, idle "
+				 << r.idle[w] << " s, lock wait " << 1000 * r.lock_wait[w] << " ms\n";
+		}
+	}
+}
+
+
+static void writeArray(std::ostream &output, const std::vector<double> &values)
+{
+	output << "[";
+	for (size_t i = 0; i < values.size(); i++)
+		output << (i ? ", " : "") << values[i];
+	output << "]";
+}
+
+
+static bool writeJson(const std::string &filename, const std::vector<ScaleResult> &results)
+{
+	std::ofstream output(filename.c_str());
+	if (!output.is_open())
+	{
+		cout << "Error: could not write " << filename << endl;
+		return false;
+	}
+
+	output << std::setprecision(6);
+	output << "{\"runs\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const ScaleResult &r = results[i];
+		output << "  {\"scene\": \"" << r.scene << "\", \"mode\": \"" << r.mode << "\", \"threads\": "
+			   << r.threads << ", \"photons\": " << r.photons << ", \"elapsed\": " << r.elapsed
+			   << ", \"speedup\": " << r.speedup << ", \"efficiency\": " << r.efficiency
+			   << ",\n   \"busy\": ";
+		writeArray(output, r.busy);
+		output << ", \"idle\": ";
+		writeArray(output, r.idle);
+		output << ", \"lock_wait\": ";
+		writeArray(output, r.lock_wait);
+		output << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	output << "]}\n";
+	output.close();
+	return !output.fail();
+}
+
+
+
+// mc-boost-scale [--scene default|pencil-beam|absorbers|all] [--mode strong|weak|both]
+//                [--photons N] [--photons-per-thread N] [--max-threads N]
+//                [--chunk-size N] [--repetitions N] [--per-thread] [--json <file>]
+//
+// Runs every scene on 1, 2, 4, ... threads up to the number of cores (or
+// --max-threads).  Strong scaling keeps the total number of photons fixed, so the
+// speedup is T(1)/T(n) and the efficiency speedup/n; weak scaling keeps the photons per
+// thread fixed, so the efficiency is T(1)/T(n) and the speedup n times that.  The
+// idle time of a worker is the part of the run it had no chunk to work on (the tail
+// of the run), and the lock wait the time it waited for a tally lock held by another
+// worker.  Detected photons are written through the Logger to /dev/null.
+int main(int argc, char *argv[])
+{
+	std::string scene_name = "all", mode = "both", json_file;
+	unsigned long photons = 200000, photons_per_thread = 50000, chunk_size = 1000;
+	int max_threads = boost::thread::hardware_concurrency();
+	int repetitions = 3;
+	bool per_thread = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--scene" && i + 1 < argc)
+			scene_name = argv[++i];
+		else if (option == "--mode" && i + 1 < argc)
+			mode = argv[++i];
+		else if (option == "--photons" && i + 1 < argc)
+			photons = strtoul(argv[++i], NULL, 10);
+		else if (option == "--photons-per-thread" && i + 1 < argc)
+			photons_per_thread = strtoul(argv[++i], NULL, 10);
+		else if (option == "--max-threads" && i + 1 < argc)
+			max_threads = atoi(argv[++i]);
+		else if (option == "--chunk-size" && i + 1 < argc)
+			chunk_size = strtoul(argv[++i], NULL, 10);
+		else if (option == "--repetitions" && i + 1 < argc)
+			repetitions = atoi(argv[++i]);
+		else if (option == "--per-thread")
+			per_thread = true;
+		else if (option == "--json" && i + 1 < argc)
+			json_file = argv[++i];
+		else
+		{
+			cout << "Usage: mc-boost-scale [--scene default|pencil-beam|absorbers|all] [--mode strong|weak|both]\n"
+				 << "                      [--photons N] [--photons-per-thread N] [--max-threads N]\n"
+				 << "                      [--chunk-size N] [--repetitions N] [--per-thread] [--json <file>]\n";
+			return 1;
+		}
+	}
+	if (max_threads < 1)
+		max_threads = 1;
+	if (repetitions < 1)
+		repetitions = 1;
+
+	std::vector<std::string> scenes;
+	if (scene_name == "all")
+	{
+		scenes.push_back("default");
+		scenes.push_back("pencil-beam");
+		scenes.push_back("absorbers");
+	}
+	else
+		scenes.push_back(scene_name);
+
+	std::vector<std::string> modes;
+	if (mode == "strong" || mode == "both")
+		modes.push_back("strong");
+	if (mode == "weak" || mode == "both")
+		modes.push_back("weak");
+	if (modes.empty())
+	{
+		cout << "Error: unknown mode " << mode << endl;
+		return 1;
+	}
+
+	// Powers of two, and the maximum itself.
+	std::vector<int> thread_counts;
+	for (int n = 1; n < max_threads; n *= 2)
+		thread_counts.push_back(n);
+	thread_counts.push_back(max_threads);
+
+	Logger::getInstance()->openExitFile("/dev/null");
+
+	std::vector<ScaleResult> results;
+	printHeader();
+	for (size_t s = 0; s < scenes.size(); s++)
+	{
+		SceneDescription description;
+		if (!makeScene(scenes[s], description))
+		{
+			cout << "Error: unknown scene " << scenes[s] << endl;
+			return 1;
+		}
+		Scene scene(description);
+
+		for (size_t m = 0; m < modes.size(); m++)
+		{
+			bool strong = modes[m] == "strong";
+			double single_thread_time = 0;
+			for (size_t t = 0; t < thread_counts.size(); t++)
+			{
+				int n = thread_counts[t];
+				ScaleResult result = runScene(scene, n, strong ? photons : photons_per_thread * n,
+											  chunk_size, repetitions);
+				result.scene = scenes[s];
+				result.mode = modes[m];
+				if (n == 1)
+					single_thread_time = result.elapsed;
+				if (strong)
+				{
+					result.speedup = single_thread_time / result.elapsed;
+					result.efficiency = result.speedup / n;
+				}
+				else
+				{
+					result.efficiency = single_thread_time / result.elapsed;
+					result.speedup = n * result.efficiency;
+				}
+				printResult(result, per_thread);
+				results.push_back(result);
+			}
+		}
+	}
+
+	if (!json_file.empty() && !writeJson(json_file, results))
+		return 1;
+
+	return 0;
+}
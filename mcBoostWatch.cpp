@@ -0,0 +1,124 @@
+/*
+ * Copyright BMPI 2011
+ *
+ * mc-boost-watch: shows the live tallies of a running simulation.
+ *
+ */
+
+#include "liveTallies.h"
+#include <unistd.h>
+#include <cstdlib>
+#include <string>
+#include <fstream>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// Write R(r) and T(r) of a snapshot, or of one of its pyramid levels (level > 0), as text.
+static bool writeRadial(const LiveTallySnapshot &snapshot, const int level, const std::string &filename)
+{
+	std::ofstream output(filename.c_str());
+	if (!output.is_open())
+		return false;
+
+	const std::vector<double> *R = &snapshot.reflectance;
+	const std::vector<double> *R_error = &snapshot.reflectance_error;
+	const std::vector<double> *T = &snapshot.transmittance;
+	double dr = snapshot.radial_bin_size;
+	if (level > 0)
+	{
+		const LiveTallyLevel &l = snapshot.levels[level - 1];
+		R = &l.reflectance;
+		R_error = &l.reflectance_error;
+		T = &l.transmittance;
+		dr *= l.factor;
+	}
+
+	output << "# photons " << snapshot.num_photons << "\n";
+	output << "# r [cm]\tR [1/cm^2]\tR error\tT [1/cm^2]\n";
+	for (size_t i = 0; i < R->size(); i++)
+		output << (i + 0.5) * dr << "\t" << (*R)[i] << "\t" << (*R_error)[i] << "\t" << (*T)[i] << "\n";
+	output.close();
+	return !output.fail();
+}
+
+
+
+// mc-boost-watch <name> [--interval <seconds>] [--once] [--radial <file>] [--level <l>]
+//
+// Attaches to the live tallies published as '/<name>' (see mc-boost --checkpointed
+// --live and mc-boost-daemon --live) and prints every new snapshot until the run
+// finishes.  '--radial' also writes R(r) and T(r) of the latest snapshot to a file,
+// from pyramid level 'l' if given (1 = bins twice as large, 2 = four times, ...),
+// which gives a usable preview much earlier in the run.
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		cout << "Usage: mc-boost-watch <name> [--interval <seconds>] [--once] [--radial <file>] [--level <l>]\n";
+		return 1;
+	}
+
+	double interval = 1.0;
+	bool once = false;
+	std::string radial_file;
+	int level = 0;
+	for (int i = 2; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--interval" && i + 1 < argc)
+			interval = atof(argv[++i]);
+		else if (option == "--once")
+			once = true;
+		else if (option == "--radial" && i + 1 < argc)
+			radial_file = argv[++i];
+		else if (option == "--level" && i + 1 < argc)
+			level = atoi(argv[++i]);
+		else
+		{
+			cout << "Error: unknown option " << option << endl;
+			return 1;
+		}
+	}
+
+	LiveTallyReader reader;
+	if (!reader.attach(argv[1]))
+	{
+		cout << "Error: no live tallies published as /" << argv[1] << endl;
+		return 1;
+	}
+
+	uint64_t last_sequence = 0;
+	LiveTallySnapshot snapshot;
+	while (true)
+	{
+		if (reader.read(snapshot) && snapshot.sequence != last_sequence)
+		{
+			last_sequence = snapshot.sequence;
+			cout << snapshot.elapsed << " s\t" << snapshot.num_photons << "/" << snapshot.target_photons
+				 << " photons\tdetected " << snapshot.detected_weight << " +/- " << snapshot.detected_weight_error;
+			double absorbed = 0;
+			for (size_t i = 0; i < snapshot.absorber_weight.size(); i++)
+				absorbed += snapshot.absorber_weight[i];
+			if (!snapshot.absorber_weight.empty())
+				cout << "\tabsorbed " << absorbed << " +/- " << snapshot.absorber_weight_error;
+			cout << endl;
+
+			if (level < 0 || level > (int)snapshot.levels.size())
+			{
+				cout << "Error: the run has " << snapshot.levels.size() << " pyramid levels\n";
+				return 1;
+			}
+			if (!radial_file.empty() && snapshot.num_radial_bins > 0 &&
+				!writeRadial(snapshot, level, radial_file))
+				cout << "Error: could not write " << radial_file << endl;
+		}
+
+		if (once || snapshot.finished)
+			break;
+		usleep((useconds_t)(interval * 1e6));
+	}
+
+	return 0;
+}
@@ -5,9 +5,13 @@
 #include "layer.h"
 #include "medium.h"
 #include "detector.h"
+#include "radialTally.h"
+#include "absorber.h"
+#include "lockWait.h"
 #include <cmath>
 #include <cassert>
 #include <cstdlib>
+#include <algorithm>
 
 #undef DEBUG
 
@@ -34,6 +38,9 @@ Medium::~Medium()
         (*it)->writeAbsorberData();
         delete *it;
     }
+    
+    if (radial_tally)
+        delete radial_tally;
 }
 
 
@@ -44,6 +51,21 @@ void Medium::initCommon(void)
 	radial_bin_size = radial_size / num_radial_pos;
 	
     Cplanar = NULL;  // Planar detector array.
+    radial_tally = NULL;  // Pencil-beam tallies.
+    pencil_beam = false;
+    exit_records_enabled = false;
+    
+    num_photons = 0;
+    num_detected = 0;
+    detected_weight = 0;
+    total_steps = 0;
+    batch_size = 0;
+    
+    // Similarity scaling is off until the feature map has been built.
+    similarity_scaling = false;
+    similarity_mfp = 0;
+    map_voxel_size = 0;
+    map_nx = map_ny = map_nz = 0;
 }
 
 
@@ -57,6 +79,139 @@ void Medium::setPlanarArray(double *array)
 	}
 }
 
+void Medium::enablePencilBeamTallies(const int num_r, const double dr,
+                                     const int num_z, const double dz)
+{
+    if (radial_tally)
+        delete radial_tally;
+    
+    radial_tally = new RadialTally(num_r, dr, num_z, dz);
+    if (batch_size > 0)
+        radial_tally->enableBatchStatistics();
+    
+    // The tallies are only meaningful for a normally incident beam.
+    pencil_beam = true;
+}
+
+
+void Medium::enableBatchStatistics(const unsigned long batch_size)
+{
+    this->batch_size = batch_size;
+    batch_stats.resize(NUM_BATCH_TALLIES + getAbsorbers().size());
+    if (radial_tally && batch_size > 0)
+        radial_tally->enableBatchStatistics();
+}
+
+
+double Medium::getAbsorberWeightStdError(const Absorber *absorber)
+{
+    std::vector<Absorber *> absorbers = getAbsorbers();
+    for (size_t i = 0; i < absorbers.size(); i++)
+    {
+        if (absorbers[i] == absorber)
+            return batch_stats.getStdError(NUM_BATCH_TALLIES + i);
+    }
+    return 0.0;
+}
+
+
+void Medium::mergeBatchStatistics(const BatchStatistics &local)
+{
+    TimedLock lock(m_sensor_mutex);
+    batch_stats.merge(local);
+}
+
+
+void Medium::clearTallies(void)
+{
+    TimedLock lock(m_sensor_mutex);
+    num_photons = 0;
+    num_detected = 0;
+    detected_weight = 0;
+    total_steps = 0;
+    event_counters.clear();
+#ifdef STAGE_PROFILING
+    stage_profile.clear();
+#endif
+    batch_stats.clear();
+    exit_records.clear();
+    if (radial_tally)
+        radial_tally->clear();
+    
+    std::vector<Absorber *> absorbers = getAbsorbers();
+    for (size_t i = 0; i < absorbers.size(); i++)
+        absorbers[i]->setAbsorbedWeight(0.0);
+}
+
+
+std::vector<Absorber *> Medium::getAbsorbers(void)
+{
+    std::vector<Absorber *> absorbers;
+    for (size_t i = 0; i < p_layers.size(); i++)
+    {
+        const std::vector<Absorber *> &layer_absorbers = p_layers[i]->getAbsorbers();
+        absorbers.insert(absorbers.end(), layer_absorbers.begin(), layer_absorbers.end());
+    }
+    return absorbers;
+}
+
+
+void Medium::mergeRadialTally(const RadialTally &local)
+{
+    // Grab the lock to serialize threads when updating the tallies of the medium.
+    TimedLock lock(m_sensor_mutex);
+    radial_tally->merge(local);
+}
+
+
+void Medium::addPhotonTotals(const unsigned long photons, const unsigned long detected,
+                             const double detected_weight, const unsigned long steps)
+{
+    TimedLock lock(m_sensor_mutex);
+    this->num_photons += photons;
+    this->num_detected += detected;
+    this->detected_weight += detected_weight;
+    this->total_steps += steps;
+}
+
+
+void Medium::addEventCounters(const EventCounters &local)
+{
+    TimedLock lock(m_sensor_mutex);
+    event_counters.merge(local);
+}
+
+
+EventCounters Medium::getEventCounters(void)
+{
+    TimedLock lock(m_sensor_mutex);
+    return event_counters;
+}
+
+
+#ifdef STAGE_PROFILING
+void Medium::addStageProfile(const StageProfile &local)
+{
+    TimedLock lock(m_sensor_mutex);
+    stage_profile.merge(local);
+}
+
+
+StageProfile Medium::getStageProfile(void)
+{
+    TimedLock lock(m_sensor_mutex);
+    return stage_profile;
+}
+#endif
+
+
+void Medium::mergeExitRecords(const std::vector<float> &local)
+{
+    TimedLock lock(m_sensor_mutex);
+    exit_records.insert(exit_records.end(), local.begin(), local.end());
+}
+
+
 // Add the layer to the medium by pushing it onto the vector container.
 void Medium::addLayer(Layer *layer)
 {
@@ -76,7 +231,7 @@ void Medium::absorbEnergy(const double z, const double energy)
 	cout << "Updating bin...\n";
 #endif
 
-    boost::mutex::scoped_lock lock(m_sensor_mutex);
+    TimedLock lock(m_sensor_mutex);
 	double r = fabs(z);
 	int ir = (r/radial_size);
     Cplanar[ir] += energy;
@@ -89,7 +244,7 @@ void Medium::absorbEnergy(const double *energy_array)
 	int i;
 	// Grab the lock to ensure a single thread has access
 	// to update the global array.
-	boost::mutex::scoped_lock lock(m_sensor_mutex);
+	TimedLock lock(m_sensor_mutex);
 	for (i = 0; i < MAX_BINS; i++) {
 		// Grab the lock to serialize threads when updating
 		// the global planar detection array in the Medium.
@@ -101,7 +256,7 @@ void Medium::absorbEnergy(const double *energy_array)
 // See if photon has crossed the detector plane.
 int Medium::photonHitDetectorPlane(const boost::shared_ptr<Vector3d> p0)
 {
-    bool hitDetectorNumTimes = 0;
+    int hitDetectorNumTimes = 0;
     // Free the memory for layers that were added to the medium.
 	for (vector<Detector *>::iterator it = p_detectors.begin(); it != p_detectors.end(); it++)
     {
@@ -112,6 +267,102 @@ int Medium::photonHitDetectorPlane(const boost::shared_ptr<Vector3d> p0)
     return hitDetectorNumTimes;
 }
 
+void Medium::enableSimilarityScaling(const double num_mfp)
+{
+    // The size of the voxels in the map is taken as half of the smallest reduced
+    // mean free path found in the layers, which keeps the conservative distance
+    // bound tight relative to the switching distance.
+    double min_mfp = x_bound + y_bound + z_bound;
+    for (vector<Layer *>::iterator it = p_layers.begin(); it != p_layers.end(); it++)
+    {
+        double mu_t_reduced = (*it)->getAbsorpCoeff() +
+                              (*it)->getScatterCoeff()*(1.0 - (*it)->getAnisotropy());
+        if (1.0/mu_t_reduced < min_mfp)
+            min_mfp = 1.0/mu_t_reduced;
+    }
+    map_voxel_size = min_mfp / 2.0;
+    
+    // Limit the number of voxels along each axis to keep the map small.
+    const int MAX_MAP_VOXELS = 128;
+    double max_bound = max(x_bound, max(y_bound, z_bound));
+    if (max_bound / map_voxel_size > MAX_MAP_VOXELS)
+        map_voxel_size = max_bound / MAX_MAP_VOXELS;
+    
+    map_nx = (int)ceil(x_bound / map_voxel_size);
+    map_ny = (int)ceil(y_bound / map_voxel_size);
+    map_nz = (int)ceil(z_bound / map_voxel_size);
+    feature_map.resize(map_nx * map_ny * map_nz);
+    
+    // Every point within a voxel lies within half the voxel diagonal from its center,
+    // so subtracting it from the distance at the center yields a lower bound for the voxel.
+    double half_diagonal = sqrt(3.0) * map_voxel_size / 2.0;
+    coords voxel_center;
+    for (int i = 0; i < map_nx; i++)
+    {
+        voxel_center.x = (i + 0.5) * map_voxel_size;
+        for (int j = 0; j < map_ny; j++)
+        {
+            voxel_center.y = (j + 0.5) * map_voxel_size;
+            for (int k = 0; k < map_nz; k++)
+            {
+                voxel_center.z = (k + 0.5) * map_voxel_size;
+                double dist = calcDistanceToFeature(voxel_center) - half_diagonal;
+                feature_map[(i*map_ny + j)*map_nz + k] = dist > 0.0 ? dist : 0.0;
+            }
+        }
+    }
+    
+    similarity_mfp = num_mfp;
+    similarity_scaling = true;
+}
+
+
+double Medium::getDistanceToFeature(const coords &point)
+{
+    // Without a map every location is treated as being on a feature.
+    if (feature_map.empty())
+        return 0.0;
+    
+    int i = (int)(point.x / map_voxel_size);
+    int j = (int)(point.y / map_voxel_size);
+    int k = (int)(point.z / map_voxel_size);
+    
+    // Photons sitting on the medium boundary can index one past the grid.
+    if (i < 0 || j < 0 || k < 0 || i >= map_nx || j >= map_ny || k >= map_nz)
+        return 0.0;
+    
+    return feature_map[(i*map_ny + j)*map_nz + k];
+}
+
+
+double Medium::calcDistanceToFeature(const coords &point)
+{
+    // Distance to the faces of the medium.
+    double dist = min(min(point.x, x_bound - point.x),
+                      min(min(point.y, y_bound - point.y),
+                          min(point.z, z_bound - point.z)));
+    
+    // Distance to the layer interfaces and the absorbers within each layer.
+    for (vector<Layer *>::iterator it = p_layers.begin(); it != p_layers.end(); it++)
+    {
+        dist = min(dist, fabs(point.z - (*it)->getDepthStart()));
+        dist = min(dist, fabs(point.z - (*it)->getDepthEnd()));
+        
+        double absorber_dist = (*it)->getDistanceToAbsorber(point);
+        if (absorber_dist >= 0)
+            dist = min(dist, absorber_dist);
+    }
+    
+    // Distance to the detectors.
+    for (vector<Detector *>::iterator it = p_detectors.begin(); it != p_detectors.end(); it++)
+    {
+        dist = min(dist, (*it)->distanceToDetector(point));
+    }
+    
+    return dist;
+}
+
+
 Layer * Medium::getLayerAboveCurrent(Layer *currentLayer)
 {
 	// Ensure that the photon's z-axis coordinate is sane.  That is,
@@ -2,6 +2,10 @@
 #define MEDIUM_H
 
 #include "photon.h" // Photon class is a friend of the Medium class.
+#include "coordinates.h"
+#include "batchStatistics.h"
+#include "eventCounters.h"
+#include "stageProfiler.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -20,6 +24,8 @@ const int MAX_BINS = 101;
 class Detector;
 class Layer;
 class Vector3d;
+class RadialTally;
+class Absorber;
 
 
 
@@ -35,6 +41,7 @@ class Medium
 public:
 
 	friend class Photon;
+	friend class TallySet;
 
 
 	// Constructor.
@@ -55,6 +62,84 @@ public:
 	// Print the grid for this medium.
 	void	printGrid(const int num_photons);
 	
+	// Turn on the pencil-beam run mode.  Photons are launched at normal incidence and
+	// R(r), T(r) and A(r,z) are tallied with respect to the injection point.
+	void	enablePencilBeamTallies(const int num_r, const double dr,
+									const int num_z, const double dz);
+	
+	// Return the pencil-beam tallies, or NULL if the mode is not enabled.
+	RadialTally * getRadialTally(void) {return radial_tally;}
+	
+	// Add the thread local pencil-beam tallies of a photon object to the medium.
+	void	mergeRadialTally(const RadialTally &local);
+	
+	// Add the totals of a photon object (i.e. thread) to the medium once it has
+	// propagated its photons.
+	void	addPhotonTotals(const unsigned long photons, const unsigned long detected,
+							const double detected_weight, const unsigned long steps);
+	
+	// Totals over all photons propagated through this medium.
+	unsigned long	getNumPhotons(void) {return num_photons;}
+	unsigned long	getNumDetected(void) {return num_detected;}
+	double	getDetectedWeight(void) {return detected_weight;}
+	unsigned long	getTotalSteps(void) {return total_steps;}
+	
+	// Add the event counters of a photon object (i.e. thread) to the medium, and
+	// return a copy of the counters over all photons so far.
+	void	addEventCounters(const EventCounters &local);
+	EventCounters	getEventCounters(void);
+	
+#ifdef STAGE_PROFILING
+	// As above for the stage cycle counts.
+	void	addStageProfile(const StageProfile &local);
+	StageProfile	getStageProfile(void);
+#endif
+	
+	// Tallies of the medium that carry batch statistics.  They are followed by one bin
+	// per absorber, in the order of getAbsorbers().
+	enum BatchTally {BATCH_DETECTED_WEIGHT, BATCH_ABSORBER_WEIGHT, NUM_BATCH_TALLIES};
+	
+	// Keep batch-means statistics of the detected weight, the weight absorbed in
+	// each absorber and in all of them, and the pencil-beam tallies, so they carry
+	// standard errors.  Every thread closes a batch each 'batch_size' photons.  Call
+	// after the absorbers have been added.
+	void	enableBatchStatistics(const unsigned long batch_size);
+	unsigned long	getBatchSize(void) {return batch_size;}
+	
+	// Add the batch statistics of a photon object (i.e. thread) to the medium.
+	void	mergeBatchStatistics(const BatchStatistics &local);
+	
+	// Per photon standard errors of the detected weight and absorber weight.
+	double	getDetectedWeightStdError(void) {return batch_stats.getStdError(BATCH_DETECTED_WEIGHT);}
+	double	getAbsorberWeightStdError(void) {return batch_stats.getStdError(BATCH_ABSORBER_WEIGHT);}
+	
+	// As above for the weight absorbed in 'absorber', zero if it is not in the medium.
+	double	getAbsorberWeightStdError(const Absorber *absorber);
+	
+	// Zero all tallies (photon totals, batch statistics, absorber weights, pencil-beam
+	// tallies and exit records) so the medium can be run again.
+	void	clearTallies(void);
+	
+	// Return the absorbers of all layers, top layer first.
+	std::vector<Absorber *> getAbsorbers(void);
+	
+	// Launch photons at normal incidence (i.e. a pencil beam) instead of the default
+	// anisotropic source.
+	void	setPencilBeam(const bool pencil) {pencil_beam = pencil;}
+	bool	isPencilBeam(void) {return pencil_beam;}
+	
+	// Record the exit radius and total path length of every photon leaving the
+	// medium through the top surface.  Used to build scaled Monte Carlo libraries.
+	void	enableExitRecords(void) {exit_records_enabled = true;}
+	bool	useExitRecords(void) {return exit_records_enabled;}
+	
+	// Add the thread local exit records (pairs of exit radius and path length) of a
+	// photon object to the medium.
+	void	mergeExitRecords(const std::vector<float> &local);
+	
+	// Return the exit records gathered so far, stored as pairs of exit radius and path length.
+	std::vector<float> & getExitRecords(void) {return exit_records;}
+	
 	// Add a layer to the medium.
 	void	addLayer(Layer *layer);
     
@@ -111,8 +196,30 @@ public:
     double getXbound(void) {return x_bound;}
     double getYbound(void) {return y_bound;}
     double getZbound(void) {return z_bound;}
+    
+    // Build the feature distance map and turn on similarity-relation scaling.
+    // Photons that are further than 'num_mfp' reduced mean free paths
+    // (i.e. 1/(mu_a + mu_s(1-g))) from any boundary, absorber or detector are
+    // propagated with the reduced scattering coefficient and isotropic scattering.
+    // NOTE: Must be called after all layers, absorbers and detectors were added.
+    void    enableSimilarityScaling(const double num_mfp);
+    
+    // Returns true if similarity-relation scaling was enabled for this medium.
+    bool    useSimilarityScaling(void) {return similarity_scaling;}
+    
+    // Return the number of reduced mean free paths a photon must be away from
+    // any feature before similarity scaling is applied.
+    double  getSimilarityDistance(void) {return similarity_mfp;}
+    
+    // Return a (conservative) lower bound of the distance from 'point' to the
+    // closest boundary, absorber or detector in the medium.
+    double  getDistanceToFeature(const coords &point);
 	
 private:
+    // Calculate the exact distance from 'point' to the closest feature in the medium.
+    // Used when filling in the feature distance map.
+    double  calcDistanceToFeature(const coords &point);
+    
     // Ensure the medium is defined with specific attributes, so we make the
     // default constructor private.
     Medium(void);
@@ -139,6 +246,28 @@ private:
     // Create a STL vector to hold the detectors in the medium.
     std::vector<Detector *> p_detectors;
     
+	// Pencil-beam tallies of R(r), T(r) and A(r,z).
+	RadialTally *radial_tally;
+	bool pencil_beam;
+	
+	// Totals of the photons propagated through the medium.
+	unsigned long num_photons;
+	unsigned long num_detected;
+	double detected_weight;
+	unsigned long total_steps;
+	EventCounters event_counters;
+#ifdef STAGE_PROFILING
+	StageProfile stage_profile;
+#endif
+	
+	// Batch size of the batch statistics, zero when disabled.
+	unsigned long batch_size;
+	BatchStatistics batch_stats;
+	
+	// Exit radius and path length of photons leaving through the top surface.
+	bool exit_records_enabled;
+	std::vector<float> exit_records;
+	
 	// Mutex to serialize access to the sensor array.
 	boost::mutex m_sensor_mutex;
 
@@ -149,6 +278,15 @@ private:
     // The refrective index outside of the medium.  We assume air.
     double refractive_index;
     
+    // Similarity-relation scaling state.  The feature map is a regular grid of voxels
+    // spanning the medium, where each voxel holds the smallest distance from any point
+    // in the voxel to a boundary, absorber or detector.
+    bool    similarity_scaling;
+    double  similarity_mfp;
+    double  map_voxel_size;
+    int     map_nx, map_ny, map_nz;
+    std::vector<double> feature_map;
+    
 };
 
 #endif	// MEDIUM_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright BMPI 2011
+ *
+ * mc-boost-merge: combines the partial tallies of a sharded run.
+ *
+ */
+
+#include "partialTallies.h"
+#include <cstdlib>
+#include <string>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+
+// mc-boost-merge <output-prefix> <partial-file> [<partial-file> ...]
+//
+// Writes the merged partial tallies to '<output-prefix>.bin', which can be merged
+// again, and the normalized tallies with their standard errors to
+// '<output-prefix>.txt' (and '<output-prefix>-radial.txt' for pencil-beam runs).
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		cout << "Usage: mc-boost-merge <output-prefix> <partial-file> [<partial-file> ...]\n";
+		return 1;
+	}
+
+	std::string prefix = argv[1];
+
+	PartialTallies merged;
+	if (!merged.read(argv[2]))
+		return 1;
+
+	for (int i = 3; i < argc; i++)
+	{
+		PartialTallies shard;
+		if (!shard.read(argv[i]))
+			return 1;
+		if (!merged.merge(shard))
+		{
+			cout << "Error: could not merge " << argv[i] << endl;
+			return 1;
+		}
+	}
+
+	// Normalization is per photon actually propagated, so an incomplete set of shards
+	// still gives correct (if noisier) estimates.
+	unsigned long covered = merged.getNumCovered();
+	if (covered != merged.getTotalPhotons())
+	{
+		cout << "Warning: shards cover " << covered << " of " << merged.getTotalPhotons()
+			 << " photons\n";
+	}
+
+	if (!merged.write(prefix + ".bin"))
+	{
+		cout << "Error: could not write " << prefix << ".bin\n";
+		return 1;
+	}
+	if (!merged.getTallies().writeSummary(prefix))
+	{
+		cout << "Error: could not write " << prefix << ".txt\n";
+		return 1;
+	}
+
+	cout << "Merged " << argc - 2 << " files, " << merged.getTallies().getNumPhotons() << " photons\n";
+	return 0;
+}
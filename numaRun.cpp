@@ -0,0 +1,130 @@
+//
+//  numaRun.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "numaRun.h"
+#include "cpuTopology.h"
+#include "workerPool.h"
+#include "photon.h"
+#include "medium.h"
+#include "tallySet.h"
+#include "eventCounters.h"
+#include "traceRecorder.h"
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+
+
+NumaRun::NumaRun(WorkerPool &pool, const SceneDescription &description, const unsigned long chunk_size,
+                 const uint64_t seed, const bool replicate)
+: pool(pool), description(description)
+{
+    this->chunk_size = chunk_size > 0 ? chunk_size : 1;
+    this->seed = seed;
+    photons.resize(pool.getNumThreads(), NULL);
+    worker_replica.resize(pool.getNumThreads(), 0);
+
+    // One replica per node of the workers, with the CPU of its first worker to
+    // compile it on.
+    CpuTopology topology = CpuTopology::detect();
+    std::vector<int> replica_cpus;
+    for (int worker = 0; worker < pool.getNumThreads(); worker++)
+    {
+        int cpu = pool.getWorkerCpu(worker);
+        if (!replicate || cpu < 0)
+            break;
+
+        int node = topology.getNode(cpu);
+        size_t replica = std::find(replica_nodes.begin(), replica_nodes.end(), node) - replica_nodes.begin();
+        if (replica == replica_nodes.size())
+        {
+            replica_nodes.push_back(node);
+            replica_cpus.push_back(cpu);
+        }
+        worker_replica[worker] = replica;
+    }
+    if (replica_nodes.empty())
+    {
+        replica_nodes.push_back(0);
+        replica_cpus.push_back(-1);
+    }
+
+    replicas.resize(replica_nodes.size(), NULL);
+    for (size_t replica = 0; replica < replicas.size(); replica++)
+    {
+        if (replica_cpus[replica] < 0)
+            compileReplica(replica, -1);
+        else
+            boost::thread(&NumaRun::compileReplica, this, replica, replica_cpus[replica]).join();
+    }
+}
+
+
+NumaRun::~NumaRun()
+{
+    for (size_t i = 0; i < photons.size(); i++)
+        delete photons[i];
+    for (size_t i = 0; i < replicas.size(); i++)
+        delete replicas[i];
+}
+
+
+void NumaRun::compileReplica(const int replica, const int cpu)
+{
+    if (cpu >= 0)
+        CpuTopology::pinCurrentThread(cpu);
+    replicas[replica] = new Scene(description);
+}
+
+
+void NumaRun::runChunk(const unsigned long first_photon, const unsigned long count, const int worker)
+{
+    TraceScope trace(TraceRecorder::CHUNK);
+    if (!photons[worker])
+        photons[worker] = new Photon;
+
+    Scene *scene = replicas[worker_replica[worker]];
+    Photon &photon = *photons[worker];
+    photon.beginInjection(scene->getMedium(), scene->getSource());
+    photon.propagateSeeded(seed, first_photon, count);
+    photon.endInjection(count);
+}
+
+
+void NumaRun::run(const unsigned long num_photons)
+{
+    for (unsigned long first = 0; first < num_photons; first += chunk_size)
+    {
+        unsigned long count = std::min(chunk_size, num_photons - first);
+        pool.submit(boost::bind(&NumaRun::runChunk, this, first, count, _1));
+    }
+    pool.wait();
+}
+
+
+bool NumaRun::reduce(Medium *medium)
+{
+    TallySet total;
+    total.capture(medium);
+    for (size_t i = 0; i < replicas.size(); i++)
+    {
+        TallySet node;
+        node.capture(replicas[i]->getMedium());
+        if (!total.merge(node))
+            return false;
+    }
+    if (!total.restore(medium))
+        return false;
+
+    for (size_t i = 0; i < replicas.size(); i++)
+    {
+        medium->addEventCounters(replicas[i]->getMedium()->getEventCounters());
+#ifdef STAGE_PROFILING
+        medium->addStageProfile(replicas[i]->getMedium()->getStageProfile());
+#endif
+    }
+    return true;
+}
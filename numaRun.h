@@ -0,0 +1,74 @@
+//
+//  numaRun.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Runs photons on a pool of workers bound to CPUs (see cpuTopology.h) with the scene
+// replicated per NUMA node.  Each replica is compiled by a thread bound to its node,
+// so with the first-touch policy of the kernel its layers, absorbers and tallies live
+// in the memory of that node, and every worker reads and tallies into the replica of
+// its own node only.  The tallies are reduced hierarchically: each worker adds its
+// chunks to the replica of its node (as Photon::endInjection() does for any medium),
+// and the replicas are added into the medium of the caller once the run is done.
+//
+// Chunks are seeded like those of CheckpointedRun, in blocks of Photon::SEED_BLOCK
+// photons, so both give the same tallies for the same seed with any chunk size that is
+// a multiple of the block.
+#ifndef NUMARUN_H
+#define NUMARUN_H
+
+#include "scene.h"
+#include <stdint.h>
+#include <vector>
+
+class WorkerPool;
+class Photon;
+class Medium;
+
+
+class NumaRun
+{
+public:
+    // Compile the replicas of 'description' for the nodes of the workers of 'pool'.
+    // Without 'replicate', or when the workers are not bound, a single copy is shared.
+    NumaRun(WorkerPool &pool, const SceneDescription &description, const unsigned long chunk_size,
+            const uint64_t seed, const bool replicate);
+    ~NumaRun();
+
+    // Propagate the photons [0, num_photons).
+    void    run(const unsigned long num_photons);
+
+    // Add the tallies and event counters of all replicas to 'medium', which must be
+    // compiled from the same description.  Returns false if they do not match.
+    bool    reduce(Medium *medium);
+
+    int     getNumReplicas(void) const {return (int)replicas.size();}
+
+    // Replica used by worker 'worker'.
+    int     getWorkerReplica(const int worker) const {return worker_replica[worker];}
+
+    // NUMA node of replica 'replica'.
+    int     getReplicaNode(const int replica) const {return replica_nodes[replica];}
+
+private:
+    // Task run on the pool.
+    void    runChunk(const unsigned long first_photon, const unsigned long count, const int worker);
+
+    // Compile replica 'replica' on a thread bound to 'cpu'.
+    void    compileReplica(const int replica, const int cpu);
+
+    WorkerPool &pool;
+    SceneDescription description;
+    unsigned long chunk_size;
+    uint64_t seed;
+
+    std::vector<Scene *> replicas;
+    std::vector<int> replica_nodes;
+    std::vector<int> worker_replica;
+
+    // One photon per worker, allocated by the worker itself on first use.
+    std::vector<Photon *> photons;
+};
+
+#endif // NUMARUN_H
@@ -0,0 +1,186 @@
+//
+//  partialTallies.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "partialTallies.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// Identifies the binary partial tally file and its layout version.
+static const char PARTIAL_MAGIC[8] = {'M', 'C', 'P', 'A', 'R', 'T', '0', '2'};
+
+
+
+PartialTallies::PartialTallies()
+{
+    scene_hash = 0;
+    seed = 0;
+    chunk_size = 0;
+    total_photons = 0;
+}
+
+
+void PartialTallies::setRun(const uint64_t scene_hash, const uint64_t seed,
+                            const unsigned long chunk_size, const unsigned long total_photons)
+{
+    this->scene_hash = scene_hash;
+    this->seed = seed;
+    this->chunk_size = chunk_size;
+    this->total_photons = total_photons;
+}
+
+
+unsigned long PartialTallies::getNumCovered(void) const
+{
+    unsigned long covered = 0;
+    std::map<unsigned long, unsigned long>::const_iterator it;
+    for (it = ranges.begin(); it != ranges.end(); it++)
+        covered += it->second;
+    return covered;
+}
+
+
+bool PartialTallies::merge(const PartialTallies &other)
+{
+    // Tallies of different scenes may have the same shapes, and a different chunk
+    // size gives different photons.
+    if (scene_hash != other.scene_hash)
+    {
+        cout << "Error: partial tallies were produced by different scenes\n";
+        return false;
+    }
+    if (seed != other.seed || chunk_size != other.chunk_size || total_photons != other.total_photons)
+    {
+        cout << "Error: partial tallies belong to different runs\n";
+        return false;
+    }
+
+    // Ranges of both sets are sorted, so an overlap shows up between neighbours.
+    std::map<unsigned long, unsigned long> combined = ranges;
+    combined.insert(other.ranges.begin(), other.ranges.end());
+    if (combined.size() != ranges.size() + other.ranges.size())
+    {
+        cout << "Error: partial tallies cover the same photons\n";
+        return false;
+    }
+    unsigned long end = 0;
+    std::map<unsigned long, unsigned long>::const_iterator it;
+    for (it = combined.begin(); it != combined.end(); it++)
+    {
+        if (it->first < end)
+        {
+            cout << "Error: partial tallies cover the same photons\n";
+            return false;
+        }
+        end = it->first + it->second;
+    }
+
+    if (!tallies.merge(other.tallies))
+    {
+        cout << "Error: partial tallies were produced by different scenes\n";
+        return false;
+    }
+
+    // Store the union with adjacent ranges joined.
+    ranges.clear();
+    for (it = combined.begin(); it != combined.end(); it++)
+    {
+        if (!ranges.empty())
+        {
+            std::map<unsigned long, unsigned long>::iterator last = ranges.end();
+            last--;
+            if (last->first + last->second == it->first)
+            {
+                last->second += it->second;
+                continue;
+            }
+        }
+        ranges[it->first] = it->second;
+    }
+
+    return true;
+}
+
+
+// Binary layout (native byte order):
+//     char[8]   magic "MCPART02"
+//     uint64    scene hash, uint64 seed, uint64 chunk size
+//     uint64    photons of the full run, uint32 number of ranges
+//     uint64[2] first photon and number of photons of every range
+//     tallies (see TallySet::writeBinary)
+bool PartialTallies::write(const std::string &filename) const
+{
+    std::ofstream output(filename.c_str(), std::ios::binary);
+    if (!output.is_open())
+        return false;
+
+    uint64_t chunk = chunk_size;
+    uint64_t total = total_photons;
+    uint32_t num_ranges = ranges.size();
+    output.write(PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC));
+    output.write((const char *)&scene_hash, sizeof(scene_hash));
+    output.write((const char *)&seed, sizeof(seed));
+    output.write((const char *)&chunk, sizeof(chunk));
+    output.write((const char *)&total, sizeof(total));
+    output.write((const char *)&num_ranges, sizeof(num_ranges));
+    std::map<unsigned long, unsigned long>::const_iterator it;
+    for (it = ranges.begin(); it != ranges.end(); it++)
+    {
+        uint64_t range[2] = {it->first, it->second};
+        output.write((const char *)range, sizeof(range));
+    }
+    tallies.writeBinary(output);
+
+    output.close();
+    return !output.fail();
+}
+
+
+bool PartialTallies::read(const std::string &filename)
+{
+    std::ifstream input(filename.c_str(), std::ios::binary);
+    if (!input.is_open())
+    {
+        cout << "Error: could not open " << filename << endl;
+        return false;
+    }
+
+    char magic[sizeof(PARTIAL_MAGIC)];
+    uint64_t chunk = 0, total = 0;
+    uint32_t num_ranges = 0;
+    input.read(magic, sizeof(magic));
+    input.read((char *)&scene_hash, sizeof(scene_hash));
+    input.read((char *)&seed, sizeof(seed));
+    input.read((char *)&chunk, sizeof(chunk));
+    input.read((char *)&total, sizeof(total));
+    input.read((char *)&num_ranges, sizeof(num_ranges));
+    if (input.fail() || memcmp(magic, PARTIAL_MAGIC, sizeof(magic)) != 0)
+    {
+        cout << "Error: " << filename << " is not a partial tally file\n";
+        return false;
+    }
+    chunk_size = chunk;
+    total_photons = total;
+
+    ranges.clear();
+    for (uint32_t i = 0; i < num_ranges; i++)
+    {
+        uint64_t range[2];
+        input.read((char *)range, sizeof(range));
+        ranges[range[0]] = range[1];
+    }
+
+    if (input.fail() || !tallies.readBinary(input))
+    {
+        cout << "Error: truncated partial tally file " << filename << endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,62 @@
+//
+//  partialTallies.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// The tallies of part of a run, e.g. one shard of a run split over several processes
+// or nodes.  Besides the tallies the file records the scene hash, the seed and chunk
+// size, the size of the full run and the photon ranges that were propagated, so
+// shards can be checked to be disjoint parts of the same run before they are merged.  Merged files have the same
+// format and can be merged again.
+#ifndef PARTIALTALLIES_H
+#define PARTIALTALLIES_H
+
+#include "tallySet.h"
+#include <stdint.h>
+#include <map>
+#include <string>
+
+
+class PartialTallies
+{
+public:
+    PartialTallies();
+
+    // Set the description of the run the tallies belong to: the hash of its scene
+    // (see SceneDescription::hash), its seed and chunk size, and its number of photons.
+    void    setRun(const uint64_t scene_hash, const uint64_t seed, const unsigned long chunk_size,
+                   const unsigned long total_photons);
+
+    // Set the photon ranges covered by the tallies, first photon -> number of photons.
+    void    setRanges(const std::map<unsigned long, unsigned long> &ranges) {this->ranges = ranges;}
+
+    TallySet & getTallies(void) {return tallies;}
+    const TallySet & getTallies(void) const {return tallies;}
+
+    uint64_t        getSceneHash(void) const {return scene_hash;}
+    uint64_t        getSeed(void) const {return seed;}
+    unsigned long   getChunkSize(void) const {return chunk_size;}
+    unsigned long   getTotalPhotons(void) const {return total_photons;}
+
+    // Number of photons covered by the ranges.
+    unsigned long   getNumCovered(void) const;
+
+    // Add the tallies and ranges of 'other'.  Fails with a message if the two belong
+    // to different runs or their photon ranges overlap.
+    bool    merge(const PartialTallies &other);
+
+    // Binary file.  read() returns false with a message if the file is not usable.
+    bool    write(const std::string &filename) const;
+    bool    read(const std::string &filename);
+
+private:
+    uint64_t scene_hash;
+    uint64_t seed;
+    unsigned long chunk_size;
+    unsigned long total_photons;
+    std::map<unsigned long, unsigned long> ranges;
+    TallySet tallies;
+};
+
+#endif // PARTIALTALLIES_H
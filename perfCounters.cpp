@@ -0,0 +1,175 @@
+//
+//  perfCounters.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "perfCounters.h"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+
+
+
+PerfCounts::PerfCounts()
+{
+    clear();
+}
+
+
+void PerfCounts::clear(void)
+{
+    std::fill(values, values + NUM_COUNTERS, 0);
+    std::fill(available, available + NUM_COUNTERS, false);
+}
+
+
+void PerfCounts::merge(const PerfCounts &other)
+{
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        values[i] += other.values[i];
+        available[i] = available[i] || other.available[i];
+    }
+}
+
+
+const char * PerfCounts::getCounterName(const Counter counter)
+{
+    static const char *names[NUM_COUNTERS] = {"cycles", "instructions", "L1D misses",
+                                              "LLC misses", "branch misses"};
+    return names[counter];
+}
+
+
+void PerfCounts::write(std::ostream &output, const unsigned long photons,
+                       const unsigned long steps) const
+{
+    if (std::find(available, available + NUM_COUNTERS, true) == available + NUM_COUNTERS)
+    {
+        output << "hardware counters not available (see /proc/sys/kernel/perf_event_paranoid)\n";
+        return;
+    }
+
+    output << "counter\ttotal\t/photon\t/step\n";
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        if (!available[i])
+            continue;
+        output << getCounterName((Counter)i) << "\t" << values[i] << "\t"
+               << (photons > 0 ? (double)values[i] / photons : 0.0) << "\t"
+               << (steps > 0 ? (double)values[i] / steps : 0.0) << "\n";
+    }
+    if (available[CYCLES] && available[INSTRUCTIONS] && values[CYCLES] > 0)
+        output << "instructions/cycle\t" << (double)values[INSTRUCTIONS] / values[CYCLES] << "\n";
+}
+
+
+
+PerfCounters::PerfCounters()
+{
+    std::fill(fds, fds + PerfCounts::NUM_COUNTERS, -1);
+    memset(start_readings, 0, sizeof(start_readings));
+    num_open = 0;
+    attempted = false;
+}
+
+
+PerfCounters::~PerfCounters()
+{
+    for (int i = 0; i < PerfCounts::NUM_COUNTERS; i++)
+    {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+}
+
+
+bool PerfCounters::open(void)
+{
+    // Unavailable events are not retried for every region.
+    if (attempted)
+        return num_open > 0;
+    attempted = true;
+
+    const uint32_t types[PerfCounts::NUM_COUNTERS] =
+        {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+         PERF_TYPE_HARDWARE};
+    const uint64_t configs[PerfCounts::NUM_COUNTERS] =
+        {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+         PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+         PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+    for (int i = 0; i < PerfCounts::NUM_COUNTERS; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // This thread on any CPU.
+        fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] >= 0)
+            num_open++;
+    }
+
+    return num_open > 0;
+}
+
+
+bool PerfCounters::read(const int counter, Reading &reading) const
+{
+    if (fds[counter] < 0)
+        return false;
+
+    // value, time enabled, time running
+    uint64_t data[3];
+    if (::read(fds[counter], data, sizeof(data)) != (ssize_t)sizeof(data))
+        return false;
+    reading.value = data[0];
+    reading.enabled = data[1];
+    reading.running = data[2];
+    return true;
+}
+
+
+void PerfCounters::start(void)
+{
+    for (int i = 0; i < PerfCounts::NUM_COUNTERS; i++)
+    {
+        if (!read(i, start_readings[i]))
+            memset(&start_readings[i], 0, sizeof(start_readings[i]));
+    }
+}
+
+
+void PerfCounters::stop(PerfCounts &counts)
+{
+    for (int i = 0; i < PerfCounts::NUM_COUNTERS; i++)
+    {
+        Reading reading;
+        if (!read(i, reading))
+            continue;
+        counts.available[i] = true;
+
+        // A multiplexed counter only counted for part of the region, so its count is
+        // scaled by the share of the region it was running.  The differences are scaled
+        // rather than the cumulative readings, whose ratio changes between the two reads.
+        const Reading &first = start_readings[i];
+        uint64_t value = reading.value - first.value;
+        uint64_t enabled = reading.enabled - first.enabled;
+        uint64_t running = reading.running - first.running;
+        if (running == 0)
+            continue;
+        if (running < enabled)
+            value = (uint64_t)((double)value * enabled / running);
+        counts.values[i] += value;
+    }
+}
@@ -0,0 +1,85 @@
+//
+//  perfCounters.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Hardware performance counters of the calling thread, read through the Linux
+// perf_event_open() system call, so no external profiler is needed.  Counting is
+// limited to user space, which perf_event_paranoid <= 2 allows for the own process.
+// Events the processor (or a virtual machine) does not provide are left out, and
+// counters multiplexed by the kernel are scaled to the full running time.
+//
+// Cycles and instructions per step tell how heavy the kernel is, while the cache
+// misses per step show whether a scene is bound by memory (e.g. a large feature map
+// or pencil-beam grid) rather than by arithmetic.
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdint.h>
+#include <iostream>
+
+
+// Counts summed over the measured regions of one or more threads.
+struct PerfCounts
+{
+    enum Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        NUM_COUNTERS
+    };
+
+    PerfCounts();
+
+    void    clear(void);
+    void    merge(const PerfCounts &other);
+
+    // Counts normalized per photon and per step, or a note if no counter was available.
+    void    write(std::ostream &output, const unsigned long photons, const unsigned long steps) const;
+
+    static const char * getCounterName(const Counter counter);
+
+    uint64_t values[NUM_COUNTERS];
+    bool available[NUM_COUNTERS];
+};
+
+
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    // Open the counters for the calling thread.  Returns false if none could be opened,
+    // e.g. when perf_event_paranoid forbids it.  Only the first call tries.
+    bool    open(void);
+    bool    isOpen(void) const {return num_open > 0;}
+
+    // Bracket a region of the thread that opened the counters; stop() adds the counts
+    // of the region to 'counts'.
+    void    start(void);
+    void    stop(PerfCounts &counts);
+
+private:
+    // Raw reading of a counter: the count and the times it was enabled and running.
+    struct Reading
+    {
+        uint64_t value;
+        uint64_t enabled;
+        uint64_t running;
+    };
+
+    // Read 'counter' into 'reading'.  Returns false if it is not open or the read failed.
+    bool    read(const int counter, Reading &reading) const;
+
+    int fds[PerfCounts::NUM_COUNTERS];
+    Reading start_readings[PerfCounts::NUM_COUNTERS];
+    int num_open;
+    bool attempted;
+};
+
+#endif // PERFCOUNTERS_H
@@ -6,6 +6,9 @@
 #include "layer.h"
 #include "medium.h"
 #include "photon.h"
+#include "radialTally.h"
+#include "traceRecorder.h"
+#include <algorithm>
 
 
 
@@ -82,10 +85,23 @@ void Photon::initCommon(void)
 	r = 0;
 	step = 0;
 	step_remainder = 0;
+	path_length = 0;
     
 	// Set the number of interactions back to zero.
 	num_steps = 0;
     
+    total_steps = 0;
+    num_detected = 0;
+    detected_weight = 0;
+    
+    scaled_step = false;
+    step_mu_t = 0;
+    
+    qmc_point = NULL;
+    qmc_dims = qmc_next = 0;
+    
+    batch_size = batch_photons = 0;
+    last_absorber = NULL;
     
     // Set the flags for hitting a layer boundary.
 	hit_x_bound = hit_y_bound = hit_z_bound = false;
@@ -104,6 +120,15 @@ void Photon::setIterations(const int num)
 
 void Photon::initTrajectory(void)
 {
+	// A pencil beam is normally incident on the medium.
+	if (m_medium->isPencilBeam())
+	{
+		currLocation->setDirX(0.0f);
+		currLocation->setDirY(0.0f);
+		currLocation->setDirZ(1.0f);
+		return;
+	}
+	
 	// Randomly set photon trajectory to yield anisotropic source.
 	cos_theta = (2.0 * getRandNum()) - 1;
 	sin_theta = sqrt(1.0 - cos_theta*cos_theta);
@@ -151,14 +176,65 @@ void Photon::injectPhoton(Medium *medium, const int iterations, unsigned int sta
 	// Seed the Boost RNG (Random Number Generator).
 	//gen.seed(time(0) + thread_id);
     
+	TraceScope trace(TraceRecorder::INJECT_PHOTONS);
+    
 	// Initialize the photon's properties before propagation begins.
-	initTrajectory();
-	initAbsorptionArray();
 	initRNG(state1, state2, state3, state4);
+	beginInjection(medium, laser);
     
+    // Move the photon through the medium. 'iterations' represents the number of photons this
+    // object (which is a thread) will execute.
+    propagatePhoton(iterations);
+    
+    endInjection(iterations);
+	
+}
+
+
+void Photon::beginInjection(Medium *medium, coords &laser)
+{
 	// Before propagation we set the medium which will be used by the photon.
 	this->m_medium = medium;
     
+	// In pencil-beam mode each thread tallies into its own copy of the grid.
+	RadialTally *radial_tally = m_medium->getRadialTally();
+	if (radial_tally)
+		local_radial_tally.reset(new RadialTally(radial_tally->getNumRadialBins(),
+												 radial_tally->getRadialBinSize(),
+												 radial_tally->getNumDepthBins(),
+												 radial_tally->getDepthBinSize()));
+	else
+		local_radial_tally.reset();
+	if (local_radial_tally)
+		local_radial_tally->setPyramidLevels(radial_tally->getNumPyramidLevels());
+	local_exit_records.clear();
+    
+	total_steps = 0;
+	num_detected = 0;
+	detected_weight = 0;
+	absorber_weight = 0;
+	local_absorbers.clear();
+	local_absorbed.clear();
+    
+	batch_size = m_medium->getBatchSize();
+	batch_photons = 0;
+	batch_absorbers.clear();
+	if (batch_size > 0)
+		batch_absorbers = m_medium->getAbsorbers();
+	local_absorber_bins.clear();
+	batch_start.assign(Medium::NUM_BATCH_TALLIES + batch_absorbers.size(), 0.0);
+	batch_values.resize(batch_start.size());
+	local_batch_stats.resize(batch_start.size());
+	counters.clear();
+#ifdef STAGE_PROFILING
+	profile.clear();
+#endif
+	if (local_radial_tally && batch_size > 0)
+		local_radial_tally->enableBatchStatistics();
+    
+	initTrajectory();
+	initAbsorptionArray();
+    
 	// Assign local values of the detection grid from the Medium.
 	radial_bin_size = m_medium->getRadialBinSize();
 	num_radial_pos = m_medium->getNumRadialPos();
@@ -172,11 +248,86 @@ void Photon::injectPhoton(Medium *medium, const int iterations, unsigned int sta
     // Set the current layer the photon starts propagating through.  This will
     // be updated as the photon moves through layers by checking 'hitLayerBoundary'.
     currLayer = m_medium->getLayerFromDepth(currLocation->location.z);
+}
+
+
+void Photon::injectSeededPhoton(const uint64_t seed, const uint64_t index)
+{
+	injectQuasiRandomPhoton(seed, index, NULL, 0);
+}
+
+
+void Photon::injectQuasiRandomPhoton(const uint64_t seed, const uint64_t index,
+                                     const double *point, const int dims)
+{
+	// Restart the RNG on the photon's own stream and redraw the launch direction,
+	// since the one drawn by reset() came from the previous photon's stream.
+	unsigned int state[4];
+	counterSeeds(seed, index, state);
+	initRNG(state[0], state[1], state[2], state[3]);
+    
+	qmc_point = point;
+	qmc_dims = dims;
+	qmc_next = 0;
+	initTrajectory();
     
-    // Move the photon through the medium. 'iterations' represents the number of photons this
-    // object (which is a thread) will execute.
-    propagatePhoton(iterations);
-	
+	propagatePhoton(1);
+}
+
+
+void Photon::propagateSeeded(const uint64_t seed, const unsigned long first_photon,
+                             const unsigned long count)
+{
+	unsigned long index = first_photon;
+	unsigned long end = first_photon + count;
+	while (index < end)
+	{
+		unsigned long block_end = std::min(end, (index / SEED_BLOCK + 1) * SEED_BLOCK);
+		
+		// Redraw the launch direction on the new stream, as beginInjection() does for
+		// the first photon of a chunk.
+		unsigned int state[4];
+		counterSeeds(seed, index, state);
+		initRNG(state[0], state[1], state[2], state[3]);
+		initTrajectory();
+		
+		propagatePhoton(block_end - index);
+		index = block_end;
+	}
+}
+
+
+void Photon::endInjection(const int iterations)
+{
+    TraceScope trace(TraceRecorder::TALLY_MERGE);
+    
+    // The remaining photons form a last, smaller, batch.
+    if (batch_photons > 0)
+    	endBatch();
+    if (batch_size > 0)
+    	m_medium->mergeBatchStatistics(local_batch_stats);
+    
+    // Add the pencil-beam tallies of this thread to the medium.
+    if (local_radial_tally)
+    {
+    	local_radial_tally->addPhotons(iterations);
+    	m_medium->mergeRadialTally(*local_radial_tally);
+    }
+    
+    if (m_medium->useExitRecords())
+    	m_medium->mergeExitRecords(local_exit_records);
+    
+    for (size_t i = 0; i < local_absorbers.size(); i++)
+    	local_absorbers[i]->updateAbsorbedWeight(local_absorbed[i]);
+    local_absorbers.clear();
+    local_absorbed.clear();
+    local_absorber_bins.clear();
+    
+    m_medium->addPhotonTotals(iterations, num_detected, detected_weight, total_steps);
+    m_medium->addEventCounters(counters);
+#ifdef STAGE_PROFILING
+    m_medium->addStageProfile(profile);
+#endif
 }
 
 
@@ -187,6 +338,10 @@ void Photon::propagatePhoton(const int iterations)
 	int i;
 	for (i = 0; i < iterations; i++) 
 	{
+		counters.count(EventCounters::PHOTONS_LAUNCHED);
+		counters.addWeight(EventCounters::LAUNCHED_WEIGHT, weight);
+		PROFILE_START(profile);
+        
 		// While the photon has not been terminated by absorption or leaving
 		// the medium we propagate it through he medium.
 		while (isAlive()) 
@@ -194,6 +349,7 @@ void Photon::propagatePhoton(const int iterations)
             
 			// Calculate and set the step size for the photon.
 			setStepSize();
+			PROFILE_STAGE(profile, SET_STEP_SIZE);
             
             
 			// Make various checks on the photon to see if layer or medium boundaries
@@ -203,6 +359,7 @@ void Photon::propagatePhoton(const int iterations)
             // or medium boundary.
 			//bool hitLayer = checkLayerBoundary();
             bool hitMedium = checkMediumBoundary();
+            PROFILE_STAGE(profile, BOUNDARY_CHECK);
             
             
             
@@ -214,16 +371,20 @@ void Photon::propagatePhoton(const int iterations)
                 
 				// Move the photon in the medium.
 				hop();
+				PROFILE_STAGE(profile, HOP);
                 
 				// Drop weight of the photon due to an interaction with the medium.
 				drop();
+				PROFILE_STAGE(profile, DROP);
                 
 				// Calculate the new coordinates of photon propagation.
 				spin();
+				PROFILE_STAGE(profile, SPIN);
                 
 				// Test whether the photon should continue propagation from the
 				// Roulette rule.
 				performRoulette();
+				PROFILE_STAGE(profile, ROULETTE);
                 
 			}
             
@@ -238,8 +399,12 @@ void Photon::propagatePhoton(const int iterations)
         
         
 		// Reset the photon and start propogation over from the beginning.
+		counters.countPhoton(num_steps);
 		reset();
         
+		if (batch_size > 0 && ++batch_photons == batch_size)
+			endBatch();
+        
 	} // end for() loop
     
     
@@ -251,6 +416,59 @@ void Photon::propagatePhoton(const int iterations)
 
 
 
+void Photon::addAbsorberWeight(Absorber *absorber, const double absorbed)
+{
+	absorber_weight += absorbed;
+    
+	// Scenes hold few absorbers, so a linear search is cheap.
+	for (size_t i = 0; i < local_absorbers.size(); i++)
+	{
+		if (local_absorbers[i] == absorber)
+		{
+			local_absorbed[i] += absorbed;
+			return;
+		}
+	}
+	local_absorbers.push_back(absorber);
+	local_absorbed.push_back(absorbed);
+}
+
+
+void Photon::endBatch(void)
+{
+	std::fill(batch_values.begin(), batch_values.end(), 0.0);
+	batch_values[Medium::BATCH_DETECTED_WEIGHT] = detected_weight - batch_start[Medium::BATCH_DETECTED_WEIGHT];
+	batch_values[Medium::BATCH_ABSORBER_WEIGHT] = absorber_weight - batch_start[Medium::BATCH_ABSORBER_WEIGHT];
+	batch_start[Medium::BATCH_DETECTED_WEIGHT] = detected_weight;
+	batch_start[Medium::BATCH_ABSORBER_WEIGHT] = absorber_weight;
+	
+	// Absorbers first hit since the last batch get their bin now.
+	while (local_absorber_bins.size() < local_absorbers.size())
+	{
+		Absorber *absorber = local_absorbers[local_absorber_bins.size()];
+		size_t index = std::find(batch_absorbers.begin(), batch_absorbers.end(), absorber) -
+					   batch_absorbers.begin();
+		local_absorber_bins.push_back(index < batch_absorbers.size() ?
+									  Medium::NUM_BATCH_TALLIES + (int)index : -1);
+	}
+	for (size_t i = 0; i < local_absorbers.size(); i++)
+	{
+		int bin = local_absorber_bins[i];
+		if (bin < 0)
+			continue;
+		batch_values[bin] = local_absorbed[i] - batch_start[bin];
+		batch_start[bin] = local_absorbed[i];
+	}
+	local_batch_stats.addBatch(&batch_values[0], batch_photons);
+    
+	if (local_radial_tally)
+		local_radial_tally->endBatch(batch_photons);
+    
+	batch_photons = 0;
+}
+
+
+
 void Photon::plotPath(void)
 
 {
@@ -283,6 +501,7 @@ void Photon::reset()
 	r = 0;
 	step = 0;
 	step_remainder = 0;
+	path_length = 0;
     
 	// Reset the number of interactions back to zero.
 	num_steps = 0;
@@ -295,6 +514,10 @@ void Photon::reset()
     // Reset the transmission angle for a photon.
     transmission_angle = 0;
     
+    // A quasi-random point only covers the photon it was given for.
+    qmc_dims = 0;
+    last_absorber = NULL;
+    
 	// Randomly set photon trajectory to yield isotropic or anisotropic source.
 	initTrajectory();
     
@@ -311,6 +534,24 @@ void Photon::setStepSize()
     double mu_a = currLayer->getAbsorpCoeff(currLocation);
     double mu_s = currLayer->getScatterCoeff(currLocation);
     
+    // When similarity scaling is enabled and the photon is far enough from every
+    // boundary, absorber and detector, the step is taken with the reduced scattering
+    // coefficient.  Far from features the fluence only depends on mu_s(1-g), so the
+    // photon takes roughly 1/(1-g) fewer steps in these regions.
+    scaled_step = false;
+    if (m_medium->useSimilarityScaling())
+    {
+        double mu_s_reduced = mu_s * (1.0 - currLayer->getAnisotropy());
+        double reduced_mfp = 1.0 / (mu_a + mu_s_reduced);
+        if (m_medium->getDistanceToFeature(currLocation->location) >
+            m_medium->getSimilarityDistance() * reduced_mfp)
+        {
+            scaled_step = true;
+            mu_s = mu_s_reduced;
+        }
+    }
+    step_mu_t = mu_a + mu_s;
+    
     
 	// If last step put the photon on the layer boundary
 	// then we need a new step size.  Otherwise, the step
@@ -318,11 +559,11 @@ void Photon::setStepSize()
 	if (step_remainder == 0.0) {
 		double rnd = getRandNum();
 		// Calculate the new step length of the photon.
-		step = -log(rnd)/(mu_a	+ mu_s);
+		step = -log(rnd)/step_mu_t;
 	}
 	else
 	{
-		step = step_remainder/(mu_a + mu_s);
+		step = step_remainder/step_mu_t;
 		step_remainder = 0.0;
 	}
 }
@@ -386,6 +627,7 @@ bool Photon::checkMediumBoundary(void)
 {
     if (hitMediumBoundary())
     {
+        counters.count(EventCounters::BOUNDARY_HITS);
 #ifdef DEBUG			
         cout << "Hit medium boundary\n";
 #endif
@@ -422,6 +664,8 @@ void Photon::hop()
 #endif	
     
 	num_steps++;
+	total_steps++;
+	counters.count(EventCounters::STEPS);
     
     
 	// Save the location before making the hop.
@@ -433,6 +677,8 @@ void Photon::hop()
     prevLocation->setDirZ(currLocation->getDirZ());
 
     
+	path_length += step;
+    
 	// Update the location
 	currLocation->location.x += step * currLocation->getDirX();
 	currLocation->location.y += step * currLocation->getDirY();
@@ -473,7 +719,9 @@ void Photon::drop()
         absorbed = weight * (1 - albedo);
         
         // Update the absorbed weight in this absorber.
-        absorber->updateAbsorbedWeight(absorbed);
+        addAbsorberWeight(absorber, absorbed);
+        if (absorber != last_absorber)
+            counters.count(EventCounters::ABSORBER_ENTRIES);
         
         // If this photon hit an absorber we set tagged to true, which
         // assumes our tagging volume completely encompasses the absorber
@@ -491,6 +739,10 @@ void Photon::drop()
         mu_a = currLayer->getAbsorpCoeff();
         mu_s = currLayer->getScatterCoeff();
         
+        // Use the reduced scattering coefficient if the step was scaled.
+        if (scaled_step)
+            mu_s *= (1.0 - currLayer->getAnisotropy());
+        
         // Calculate the albedo and remove a portion of the photon's weight for this
         // interaction.
         albedo = mu_s / (mu_a + mu_s);
@@ -501,6 +753,11 @@ void Photon::drop()
     
 	// Remove the portion of energy lost due to absorption at this location.
 	weight -= absorbed;
+	last_absorber = absorber;
+	counters.addWeight(EventCounters::DEPOSITED_WEIGHT, absorbed);
+    
+    if (local_radial_tally)
+        local_radial_tally->scoreAbsorption(getRadialDistance(), currLocation->location.z, absorbed);
     
 	// Deposit lost energy in the grid of the medium.
 	//m_medium->absorbEnergy(z, absorbed);
@@ -512,6 +769,14 @@ void Photon::drop()
 }
 
 
+double Photon::getRadialDistance(void)
+{
+	double dx = currLocation->location.x - illuminationCoords.x;
+	double dy = currLocation->location.y - illuminationCoords.y;
+	return sqrt(dx*dx + dy*dy);
+}
+
+
 // Update the local absorbed energy array.
 void Photon::updateLocalWeightArray(const double absorbed)
 {
@@ -537,7 +802,8 @@ void Photon::spin()
 	// Get the anisotropy factor from the layer that resides at depth 'z' in
 	// the medium.
 	// FIXME: Need to index into layer and check if absorber causes this to change.
-    double g = currLayer->getAnisotropy();
+    // Scaled steps scatter isotropically.
+    double g = scaled_step ? 0.0 : currLayer->getAnisotropy();
     
 	double rnd = getRandNum();
     
@@ -598,12 +864,16 @@ void Photon::performRoulette(void)
     
 	if (weight < THRESHOLD) {
 		if (getRandNum() <= CHANCE) {
+			counters.count(EventCounters::ROULETTE_SURVIVALS);
+			counters.addWeight(EventCounters::ROULETTE_GAIN, weight/CHANCE - weight);
 			weight /= CHANCE;
 		}
 		else {
 #ifdef DEBUG
             cout << "Photon died in Roulette\n";
 #endif
+			counters.count(EventCounters::ROULETTE_KILLS);
+			counters.addWeight(EventCounters::ROULETTE_LOSS, weight);
 			status = DEAD;
 		}
 	}
@@ -673,6 +943,7 @@ void Photon::transmit(const char *type)
             // if the photon should reflect or transmit through the medium.
             if (hitMediumBoundary())
             {
+                counters.count(EventCounters::BOUNDARY_HITS);
                 hop(); // Move the photon to the medium boundary.
                 transmitOrReflect("medium");
             }
@@ -693,17 +964,43 @@ void Photon::transmit(const char *type)
         // we see if the exit location passed through the detector.  If so, the exit
         // location and exit angle are written out to file, but only when this photon
         // has been tagged (i.e. interacted with an absorber).
-        if (checkDetector())
+        PROFILE_NESTED_START(profile);
+        bool detected = checkDetector();
+        PROFILE_NESTED_STAGE(profile, DETECTION);
+        if (detected)
         {
             // If we hit the detector when transmitting the photon, then we write the exit
             // data to file.
             Logger::getInstance()->writeExitData(this->currLocation,
                                                  this->transmission_angle,
                                                  this->weight);
-             
+            
+            num_detected++;
+            detected_weight += this->weight;
+            counters.count(EventCounters::DETECTIONS);
+        }
+        
+        // Photons leaving through the top of the medium add to the reflectance,
+        // and those leaving through the bottom to the transmittance.
+        if (local_radial_tally && hit_z_bound)
+        {
+            if (currLocation->getDirZ() < 0)
+                local_radial_tally->scoreReflectance(getRadialDistance(), this->weight);
+            else
+                local_radial_tally->scoreTransmittance(getRadialDistance(), this->weight);
+        }
+        
+        if (m_medium->useExitRecords() && hit_z_bound && currLocation->getDirZ() < 0)
+        {
+            local_exit_records.push_back(getRadialDistance());
+            local_exit_records.push_back(path_length);
         }
         
+        PROFILE_NESTED_STAGE(profile, LOGGING);
+        
         // The photon has left the medium, so kill it.
+        counters.count(EventCounters::TRANSMISSIONS);
+        counters.addWeight(EventCounters::ESCAPED_WEIGHT, this->weight);
         this->status = DEAD;
     }
     else
@@ -729,6 +1026,7 @@ void Photon::transmitOrReflect(const char *type)
             cout << "Internally reflecting on layer boundary\n";
 #endif
 			internallyReflectZ();
+			counters.count(EventCounters::REFLECTIONS);
             
 			// Since the photon has interacted with the tissue we deposit weight.
 			drop();
@@ -774,6 +1072,7 @@ void Photon::transmitOrReflect(const char *type)
             {
                 cout << "Error, no medium boundary hit\n";
             }
+            counters.count(EventCounters::REFLECTIONS);
             
             
 			// Since the photon has interacted with the tissue we deposit weight.
@@ -941,7 +1240,9 @@ bool Photon::hitMediumBoundary(void)
     double distance_to_boundary_Y = 0.0;
     double distance_to_boundary_Z = 0.0;
     
-	double mu_t = currLayer->getTotalAttenuationCoeff(currLocation);
+	// Use the attenuation the step was sampled with, which differs from the layer
+	// value when similarity scaling was applied to this step.
+	double mu_t = step_mu_t;
 	double x_bound = m_medium->getXbound();
 	double y_bound = m_medium->getYbound();
 	double z_bound = m_medium->getZbound();
@@ -1095,7 +1396,9 @@ bool Photon::hitLayerBoundary(void)
     
 	double distance_to_boundary = 0.0;
 	//Layer *layer = m_medium->getLayerFromDepth(currLocation->location.z);
-	double mu_t = currLayer->getTotalAttenuationCoeff(currLocation);
+	// As in hitMediumBoundary(), the leftover distance is converted back to optical
+	// depth with the attenuation the step was sampled with.
+	double mu_t = step_mu_t;
     
     
 	// If the direction the photon is traveling is towards the deeper boundary
@@ -1131,7 +1434,9 @@ bool Photon::hitLayerBoundary(void)
 void Photon::specularReflectance(double n1, double n2)
 {
 	// update the weight after specular reflectance has occurred.
-	weight = weight - (pow((n1 - n2), 2) / pow((n1 + n2), 2)) * weight;
+	double reflected = (pow((n1 - n2), 2) / pow((n1 + n2), 2)) * weight;
+	counters.addWeight(EventCounters::SPECULAR_WEIGHT, reflected);
+	weight = weight - reflected;
 }
 
 
@@ -1165,6 +1470,31 @@ void Photon::internallyReflectX(void)
 
 
 // Everything below deals with the random number generator.
+void Photon::counterSeeds(const uint64_t seed, const uint64_t counter, unsigned int state[4])
+{
+	// SplitMix64 applied to the seed combined with the counter.
+	uint64_t x = seed ^ (counter * 0x9E3779B97F4A7C15ULL);
+	for (int i = 0; i < 2; i++)
+	{
+		x += 0x9E3779B97F4A7C15ULL;
+		uint64_t z = x;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z = z ^ (z >> 31);
+		state[2*i] = (unsigned int)z;
+		state[2*i + 1] = (unsigned int)(z >> 32);
+	}
+	
+	// The state variables need to be >= 128.
+	for (int i = 0; i < 4; i++)
+	{
+		if (state[i] < 128)
+			state[i] += 128;
+	}
+}
+
+
+
 unsigned int Photon::TausStep(unsigned int &z, int s1, int s2, int s3, unsigned long M)
 {
 	unsigned int b=(((z << s1) ^ z) >> s2);
@@ -1192,6 +1522,10 @@ double Photon::HybridTaus(void)
 
 double Photon::getRandNum(void)
 {
+	// The leading dimensions of a photon history come from its quasi-random point.
+	if (qmc_next < qmc_dims)
+		return qmc_point[qmc_next++];
+    
 	// Thread safe RNG.
 	return HybridTaus();
     
@@ -3,8 +3,12 @@
 #define PHOTON_H
 
 #include "coordinates.h"
+#include "batchStatistics.h"
+#include "eventCounters.h"
+#include "stageProfiler.h"
 #include <boost/thread/mutex.hpp>
 #include <boost/shared_ptr.hpp>
+#include <stdint.h>
 #include <cmath>
 #include <ctime>
 #include <cstdlib>
@@ -33,6 +37,8 @@ using namespace std;
 class Medium;
 class Vector3d;
 class Layer;
+class RadialTally;
+class Absorber;
 
 
 
@@ -41,6 +47,9 @@ class Layer;
 
 class Photon
 {
+	// The microbenchmarks of mc-boost-bench set up photon states directly.
+	friend class PhotonBench;
+    
 public:
 	// Constructors
 	Photon(void);
@@ -91,6 +100,24 @@ public:
 	// Return the current weight of the photon
 	double	getWeight(void) {return weight;}
 	
+	// Return the total number of steps taken by the photons of the last call to injectPhoton().
+	unsigned long	getTotalSteps(void) {return total_steps;}
+	
+	// Return the number of photons, and their summed weight, that exited through a detector.
+	unsigned long	getNumDetected(void) {return num_detected;}
+	double	getDetectedWeight(void) {return detected_weight;}
+	
+	// Return the weight deposited in absorbers by the photons of the last injection.
+	double	getAbsorberWeight(void) {return absorber_weight;}
+	
+	// Return the event counters of the photons of the last injection.
+	const EventCounters & getEventCounters(void) {return counters;}
+	
+#ifdef STAGE_PROFILING
+	// Return the stage cycle counts of the last injection.
+	const StageProfile & getStageProfile(void) {return profile;}
+#endif
+	
 	// Returns a random number 'n': 0 < n < 1
 	double	getRandNum(void);
 	
@@ -136,6 +163,32 @@ public:
 	// of the random number generator.
 	void	injectPhoton(Medium *m, const int num_iterations, unsigned int state1, unsigned int state2,
 							unsigned int state3, unsigned int state4, coords &c);
+	
+	// The steps of injectPhoton() for callers that restart the RNG for every photon.
+	// beginInjection() binds the photon to the medium and clears the running totals,
+	// injectSeededPhoton() propagates a single photon on the 'index'-th stream of 'seed'
+	// and endInjection() adds the totals of 'iterations' photons to the medium.
+	void	beginInjection(Medium *m, coords &c);
+	void	injectSeededPhoton(const uint64_t seed, const uint64_t index);
+	
+	// As injectSeededPhoton(), but the first 'dims' random numbers of the photon's
+	// history (launch direction, first step, first scattering angles, ...) are taken
+	// from the quasi-random 'point' instead of the RNG.
+	void	injectQuasiRandomPhoton(const uint64_t seed, const uint64_t index,
+									const double *point, const int dims);
+	void	endInjection(const int iterations);
+	
+	// Photons per independently seeded block of a run.  Block k of a run with 'seed'
+	// uses the stream counterSeeds(seed, k * SEED_BLOCK), so the photons of a run do not
+	// depend on how it is split into chunks, as long as every chunk is made of whole blocks.
+	static const unsigned long SEED_BLOCK = 1000;
+	
+	// Propagate the photons [first_photon, first_photon + count) of the run with 'seed',
+	// restarting the RNG at every block boundary.  A chunk that starts inside a block
+	// seeds its first part from its own first photon.  Called between beginInjection()
+	// and endInjection().
+	void	propagateSeeded(const uint64_t seed, const unsigned long first_photon,
+							const unsigned long count);
     
     
     // Hop, Drop, Spin, Roulette and everything in between.
@@ -151,6 +204,11 @@ public:
 	// Initialize the RNG.
 	void	initRNG(unsigned int s1, unsigned int s2, unsigned int s3, unsigned int s4);
 
+	// Derive the four RNG state values for the 'counter'-th stream of 'seed'.  The
+	// mapping is a fixed hash, so the same (seed, counter) always gives the same
+	// random sequence regardless of which thread runs it.
+	static void	counterSeeds(const uint64_t seed, const uint64_t counter, unsigned int state[4]);
+
 	// Routines related to the thread-safe RNG
 	unsigned int TausStep(unsigned int &z, int s1, int s2, int s3, unsigned long M);
 	unsigned int LCGStep(unsigned int &z, unsigned int A, unsigned long C);
@@ -206,6 +264,15 @@ public:
     // structure and improves speed.
     void    updateLocalWeightArray(const double absorbed);
 
+	// Add weight absorbed in 'absorber' to the thread local absorber tallies.
+	void	addAbsorberWeight(Absorber *absorber, const double absorbed);
+
+	// Close the current batch of the batch statistics.
+	void	endBatch(void);
+
+	// Return the radial distance of the photon from the injection point in the x-y plane.
+	double	getRadialDistance(void);
+
 	// Write the x-y coordinates of the exit location when the photon left the medium, path length
 	// and also the weight of the photon when it exited the medium.
 	void	writeExitLocationsLengthWeight(void);
@@ -234,6 +301,9 @@ private:
 	// Step size for the photon.
 	double	step;
 	
+	// Total distance traveled by the photon since it was injected.
+	double	path_length;
+	
 	// Step size to boundary.  Used when calculating distance from layer
 	// boundary to current position of the photon.  Specifically, it is
 	// the remainder of the step size after calculating the distance to
@@ -263,6 +333,52 @@ private:
 	// the medium.
 	int num_steps;
 	
+	// Running totals over the photons of a call to injectPhoton().  Kept locally to
+	// avoid contention and added to the medium once all photons have been propagated.
+	unsigned long total_steps;
+	unsigned long num_detected;
+	double detected_weight;
+	double absorber_weight;
+	
+	// Thread local weight absorbed per absorber.  Added to the absorbers once all
+	// photons of this object have been propagated, instead of locking every absorber
+	// on each deposit.
+	std::vector<Absorber *> local_absorbers;
+	std::vector<double> local_absorbed;
+	
+	// Thread local batch statistics of the running totals above.  A batch is closed
+	// every 'batch_size' photons (zero disables them), 'batch_photons' counts the
+	// photons of the open batch and 'batch_start' holds the totals when it opened,
+	// indexed by Medium::BatchTally and followed by the weights of the absorbers.
+	// 'local_absorber_bins' holds the bin of every entry of 'local_absorbers', found
+	// when a batch closes so the deposits themselves do not search the medium.
+	unsigned long batch_size, batch_photons;
+	std::vector<double> batch_start;
+	std::vector<double> batch_values;
+	std::vector<Absorber *> batch_absorbers;
+	std::vector<int> local_absorber_bins;
+	BatchStatistics local_batch_stats;
+	
+	// Thread local event counters and energy audit, added to the medium with the
+	// running totals.  'last_absorber' is the absorber of the previous interaction,
+	// to count entries into absorbers rather than interactions inside them.
+	EventCounters counters;
+	Absorber *last_absorber;
+	
+#ifdef STAGE_PROFILING
+	// Thread local cycle counts of the stages of the propagation loop.
+	StageProfile profile;
+#endif
+	
+	// Set when the current step was sampled with the similarity-relation scaled
+	// coefficients (i.e. mu_s' = mu_s(1-g) and isotropic scattering), because the
+	// photon was far from any feature in the medium.
+	bool scaled_step;
+	
+	// The total attenuation coefficient used to sample the current step.  Used to
+	// convert the step remainder when the photon is moved to a boundary.
+	double step_mu_t;
+	
 	// Pointer to the medium which this photon will propagate through.
 	Medium *m_medium;
 
@@ -278,6 +394,15 @@ private:
 	double	radial_size;			// Maximum radial size.
 	int		num_radial_pos;			// Number of radial positions (i.e. NR).
 	double	radial_bin_size;		// Radial bin size of the medium (i.e dr).
+	
+	// Thread local pencil-beam tallies.  Only allocated when the medium is run in
+	// pencil-beam mode, and added to the medium's tallies once all photons of this
+	// object have been propagated.
+	boost::shared_ptr<RadialTally> local_radial_tally;
+	
+	// Thread local exit radius and path length pairs of photons leaving through the top
+	// surface.  Only filled when the medium records exits.
+	std::vector<float> local_exit_records;
 
 
 	// Boost Random Number Library implementation of Mersenne-twister RNG.
@@ -285,6 +410,11 @@ private:
 
 	// Used with the thread safe RNG to track state.
 	unsigned int z1, z2, z3, z4;
+	
+	// Quasi-random point of the current photon, handed out by getRandNum() before
+	// falling back to the RNG.  'qmc_dims' is zero when no point is set.
+	const double *qmc_point;
+	int qmc_dims, qmc_next;
 
 	// Tracks whether or not a photon has hit a medium boundary.
 	bool hit_x_bound, hit_y_bound, hit_z_bound;
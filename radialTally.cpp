@@ -0,0 +1,472 @@
+//
+//  radialTally.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "radialTally.h"
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#define PI 3.141592653589793238462643383
+
+
+RadialTally::RadialTally(const int num_r, const double dr, const int num_z, const double dz)
+{
+    this->num_r = num_r;
+    this->dr = dr;
+    this->num_z = num_z;
+    this->dz = dz;
+
+    Rr.resize(num_r);
+    Tr.resize(num_r);
+    Arz.resize(num_r * num_z);
+    batch_statistics = false;
+    num_levels = 0;
+
+    clear();
+}
+
+
+RadialTally::~RadialTally()
+{
+    // STUB
+}
+
+
+void RadialTally::clear(void)
+{
+    num_photons = 0;
+    std::fill(Rr.begin(), Rr.end(), 0.0);
+    std::fill(Tr.begin(), Tr.end(), 0.0);
+    std::fill(Arz.begin(), Arz.end(), 0.0);
+    stats.clear();
+    std::fill(batch_start.begin(), batch_start.end(), 0.0);
+    for (size_t l = 0; l < level_stats.size(); l++)
+        level_stats[l].clear();
+}
+
+
+void RadialTally::enableBatchStatistics(void)
+{
+    if (batch_statistics)
+        return;
+
+    batch_statistics = true;
+    stats.resize(2*num_r + num_r*num_z);
+    flatten(batch_start);
+    setPyramidLevels(num_levels);
+}
+
+
+void RadialTally::setPyramidLevels(const int num_levels)
+{
+    this->num_levels = num_levels;
+    level_stats.clear();
+    if (!batch_statistics)
+        return;
+
+    level_stats.resize(num_levels);
+    for (int l = 0; l < num_levels; l++)
+    {
+        int factor = getLevelFactor(l);
+        int nr = (num_r + factor - 1) / factor;
+        int nz = (num_z + factor - 1) / factor;
+        level_stats[l].resize(2*nr + nr*nz);
+    }
+}
+
+
+void RadialTally::coarsen(const std::vector<double> &values, const int factor,
+                          std::vector<double> &coarse) const
+{
+    int nr = (num_r + factor - 1) / factor;
+    int nz = (num_z + factor - 1) / factor;
+    coarse.assign(2*nr + nr*nz, 0.0);
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        coarse[ir/factor] += values[ir];
+        coarse[nr + ir/factor] += values[num_r + ir];
+        for (int iz = 0; iz < num_z; iz++)
+            coarse[2*nr + (ir/factor)*nz + iz/factor] += values[2*num_r + ir*num_z + iz];
+    }
+}
+
+
+RadialTally * RadialTally::getLevel(const int level) const
+{
+    int factor = getLevelFactor(level);
+    int nr = (num_r + factor - 1) / factor;
+    int nz = (num_z + factor - 1) / factor;
+
+    std::vector<double> values, coarse;
+    flatten(values);
+    coarsen(values, factor, coarse);
+
+    RadialTally *tally = new RadialTally(nr, dr*factor, nz, dz*factor);
+    tally->num_photons = num_photons;
+    std::copy(coarse.begin(), coarse.begin() + nr, tally->Rr.begin());
+    std::copy(coarse.begin() + nr, coarse.begin() + 2*nr, tally->Tr.begin());
+    std::copy(coarse.begin() + 2*nr, coarse.end(), tally->Arz.begin());
+    if (batch_statistics && level < (int)level_stats.size())
+    {
+        tally->enableBatchStatistics();
+        tally->stats = level_stats[level];
+        tally->batch_start = coarse;
+    }
+    return tally;
+}
+
+
+void RadialTally::flatten(std::vector<double> &values) const
+{
+    values.resize(2*num_r + num_r*num_z);
+    std::copy(Rr.begin(), Rr.end(), values.begin());
+    std::copy(Tr.begin(), Tr.end(), values.begin() + num_r);
+    std::copy(Arz.begin(), Arz.end(), values.begin() + 2*num_r);
+}
+
+
+void RadialTally::endBatch(const unsigned long photons)
+{
+    if (!batch_statistics)
+        return;
+
+    std::vector<double> current;
+    flatten(current);
+    for (size_t i = 0; i < current.size(); i++)
+        batch_start[i] = current[i] - batch_start[i];
+    stats.addBatch(&batch_start[0], photons);
+
+    std::vector<double> coarse;
+    for (size_t l = 0; l < level_stats.size(); l++)
+    {
+        coarsen(batch_start, getLevelFactor(l), coarse);
+        level_stats[l].addBatch(&coarse[0], photons);
+    }
+    batch_start.swap(current);
+}
+
+
+int RadialTally::radialBin(const double r) const
+{
+    int ir = (int)(r / dr);
+    return ir < num_r ? ir : num_r - 1;
+}
+
+
+int RadialTally::depthBin(const double z) const
+{
+    int iz = (int)(z / dz);
+    if (iz < 0)
+        return 0;
+    return iz < num_z ? iz : num_z - 1;
+}
+
+
+void RadialTally::scoreReflectance(const double r, const double weight)
+{
+    Rr[radialBin(r)] += weight;
+}
+
+
+void RadialTally::scoreTransmittance(const double r, const double weight)
+{
+    Tr[radialBin(r)] += weight;
+}
+
+
+void RadialTally::scoreAbsorption(const double r, const double z, const double weight)
+{
+    Arz[radialBin(r)*num_z + depthBin(z)] += weight;
+}
+
+
+void RadialTally::merge(const RadialTally &other)
+{
+    assert(other.num_r == num_r && other.num_z == num_z);
+
+    num_photons += other.num_photons;
+    for (int i = 0; i < num_r; i++)
+    {
+        Rr[i] += other.Rr[i];
+        Tr[i] += other.Tr[i];
+    }
+    for (int i = 0; i < num_r*num_z; i++)
+    {
+        Arz[i] += other.Arz[i];
+    }
+
+    if (batch_statistics && other.batch_statistics)
+    {
+        stats.merge(other.stats);
+        if (level_stats.size() == other.level_stats.size())
+        {
+            for (size_t l = 0; l < level_stats.size(); l++)
+                level_stats[l].merge(other.level_stats[l]);
+        }
+    }
+}
+
+
+std::vector<double> RadialTally::getReflectance(void) const
+{
+    std::vector<double> result(num_r);
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        // Area of the annulus: 2*pi*r*dr.
+        double area = 2.0 * PI * getRadius(ir) * dr;
+        result[ir] = Rr[ir] / num_photons / area;
+    }
+    return result;
+}
+
+
+std::vector<double> RadialTally::getTransmittance(void) const
+{
+    std::vector<double> result(num_r);
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        double area = 2.0 * PI * getRadius(ir) * dr;
+        result[ir] = Tr[ir] / num_photons / area;
+    }
+    return result;
+}
+
+
+std::vector<double> RadialTally::getAbsorption(void) const
+{
+    std::vector<double> result(num_r * num_z);
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        double volume = 2.0 * PI * getRadius(ir) * dr * dz;
+        for (int iz = 0; iz < num_z; iz++)
+        {
+            result[ir*num_z + iz] = Arz[ir*num_z + iz] / num_photons / volume;
+        }
+    }
+    return result;
+}
+
+
+std::vector<double> RadialTally::getReflectanceStdError(void) const
+{
+    std::vector<double> result(num_r, 0.0);
+    if (!batch_statistics)
+        return result;
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        double area = 2.0 * PI * getRadius(ir) * dr;
+        result[ir] = stats.getStdError(ir) / area;
+    }
+    return result;
+}
+
+
+std::vector<double> RadialTally::getTransmittanceStdError(void) const
+{
+    std::vector<double> result(num_r, 0.0);
+    if (!batch_statistics)
+        return result;
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        double area = 2.0 * PI * getRadius(ir) * dr;
+        result[ir] = stats.getStdError(num_r + ir) / area;
+    }
+    return result;
+}
+
+
+std::vector<double> RadialTally::getAbsorptionStdError(void) const
+{
+    std::vector<double> result(num_r * num_z, 0.0);
+    if (!batch_statistics)
+        return result;
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        double volume = 2.0 * PI * getRadius(ir) * dr * dz;
+        for (int iz = 0; iz < num_z; iz++)
+            result[ir*num_z + iz] = stats.getStdError(2*num_r + ir*num_z + iz) / volume;
+    }
+    return result;
+}
+
+
+// The file is plain text.  A header line with the grid and the number of photons
+// is followed by one line for each of R(r) and T(r), and one line per radial bin
+// for A(r,z).  Values are the raw weight sums so tallies from several runs can
+// be merged by simply adding them together.  With batch statistics enabled a
+// '# batch statistics' line and the raw batch sums follow.
+bool RadialTally::write(const std::string &filename)
+{
+    std::ofstream output(filename.c_str());
+    if (!output.is_open())
+        return false;
+
+    output << std::scientific << std::setprecision(10);
+    output << "# mc-boost radial tally\n";
+    output << num_photons << " " << num_r << " " << dr << " " << num_z << " " << dz << "\n";
+    for (int ir = 0; ir < num_r; ir++)
+        output << Rr[ir] << (ir == num_r-1 ? "\n" : " ");
+    for (int ir = 0; ir < num_r; ir++)
+        output << Tr[ir] << (ir == num_r-1 ? "\n" : " ");
+    for (int ir = 0; ir < num_r; ir++)
+    {
+        for (int iz = 0; iz < num_z; iz++)
+            output << Arz[ir*num_z + iz] << (iz == num_z-1 ? "\n" : " ");
+    }
+    if (batch_statistics)
+    {
+        output << "# batch statistics\n";
+        stats.write(output);
+    }
+
+    output.close();
+    return true;
+}
+
+
+RadialTally * RadialTally::read(const std::string &filename)
+{
+    std::ifstream input(filename.c_str());
+    if (!input.is_open())
+        return NULL;
+
+    // Skip the comment line.
+    std::string comment;
+    std::getline(input, comment);
+
+    unsigned long photons;
+    int nr, nz;
+    double r_size, z_size;
+    if (!(input >> photons >> nr >> r_size >> nz >> z_size) || nr <= 0 || nz <= 0)
+        return NULL;
+
+    RadialTally *tally = new RadialTally(nr, r_size, nz, z_size);
+    tally->num_photons = photons;
+    for (int ir = 0; ir < nr; ir++)
+        input >> tally->Rr[ir];
+    for (int ir = 0; ir < nr; ir++)
+        input >> tally->Tr[ir];
+    for (int i = 0; i < nr*nz; i++)
+        input >> tally->Arz[i];
+
+    if (input.fail())
+    {
+        cout << "Error: RadialTally::read() truncated file " << filename << endl;
+        delete tally;
+        return NULL;
+    }
+
+    // Optional batch statistics.
+    std::string line;
+    std::getline(input, line);
+    if (std::getline(input, line) && line == "# batch statistics")
+    {
+        tally->enableBatchStatistics();
+        if (!tally->stats.read(input) || tally->stats.getNumBins() != 2*nr + nr*nz)
+        {
+            cout << "Error: RadialTally::read() corrupt batch statistics in " << filename << endl;
+            delete tally;
+            return NULL;
+        }
+    }
+
+    return tally;
+}
+
+
+// Binary layout (native byte order):
+//     int32 num_r, double dr, int32 num_z, double dz, uint64 photons,
+//     double[] R(r), T(r), A(r,z), uint8 batch statistics flag
+//     [, batch statistics, uint8 pyramid levels, batch statistics of every level]
+void RadialTally::writeBinary(std::ostream &output) const
+{
+    int32_t nr = num_r, nz = num_z;
+    uint64_t photons = num_photons;
+    uint8_t batches = batch_statistics;
+    output.write((const char *)&nr, sizeof(nr));
+    output.write((const char *)&dr, sizeof(dr));
+    output.write((const char *)&nz, sizeof(nz));
+    output.write((const char *)&dz, sizeof(dz));
+    output.write((const char *)&photons, sizeof(photons));
+    output.write((const char *)&Rr[0], num_r * sizeof(double));
+    output.write((const char *)&Tr[0], num_r * sizeof(double));
+    output.write((const char *)&Arz[0], num_r * num_z * sizeof(double));
+    output.write((const char *)&batches, sizeof(batches));
+    if (batch_statistics)
+    {
+        stats.writeBinary(output);
+        uint8_t levels = level_stats.size();
+        output.write((const char *)&levels, sizeof(levels));
+        for (size_t l = 0; l < level_stats.size(); l++)
+            level_stats[l].writeBinary(output);
+    }
+}
+
+
+RadialTally * RadialTally::readBinary(std::istream &input)
+{
+    int32_t nr = 0, nz = 0;
+    double r_size = 0, z_size = 0;
+    uint64_t photons = 0;
+    input.read((char *)&nr, sizeof(nr));
+    input.read((char *)&r_size, sizeof(r_size));
+    input.read((char *)&nz, sizeof(nz));
+    input.read((char *)&z_size, sizeof(z_size));
+    input.read((char *)&photons, sizeof(photons));
+    if (input.fail() || nr <= 0 || nz <= 0)
+        return NULL;
+
+    RadialTally *tally = new RadialTally(nr, r_size, nz, z_size);
+    tally->num_photons = photons;
+    input.read((char *)&tally->Rr[0], nr * sizeof(double));
+    input.read((char *)&tally->Tr[0], nr * sizeof(double));
+    input.read((char *)&tally->Arz[0], nr * nz * sizeof(double));
+
+    uint8_t batches = 0;
+    input.read((char *)&batches, sizeof(batches));
+    if (!input.fail() && batches)
+    {
+        tally->enableBatchStatistics();
+        if (!tally->stats.readBinary(input) || tally->stats.getNumBins() != 2*nr + nr*nz)
+        {
+            delete tally;
+            return NULL;
+        }
+        tally->flatten(tally->batch_start);
+
+        uint8_t levels = 0;
+        input.read((char *)&levels, sizeof(levels));
+        tally->setPyramidLevels(levels);
+        for (int l = 0; l < levels; l++)
+        {
+            int size = tally->level_stats[l].getNumBins();
+            if (!tally->level_stats[l].readBinary(input) || tally->level_stats[l].getNumBins() != size)
+            {
+                delete tally;
+                return NULL;
+            }
+        }
+    }
+
+    if (input.fail())
+    {
+        delete tally;
+        return NULL;
+    }
+    return tally;
+}
+
+
+bool RadialTally::sameGrid(const RadialTally &other) const
+{
+    return num_r == other.num_r && num_z == other.num_z && dr == other.dr && dz == other.dz;
+}
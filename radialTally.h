@@ -0,0 +1,139 @@
+//
+//  radialTally.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Cylindrically symmetric tallies for a pencil beam normally incident on a
+// laterally uniform (layered) medium.  The diffuse reflectance R(r), the total
+// transmittance T(r) and the absorbed weight A(r,z) are accumulated as a function
+// of the radial distance 'r' from the injection point.  Because of translational
+// invariance these tallies can be convolved with any beam profile afterwards
+// (see beamConvolution.h).
+#ifndef RADIALTALLY_H
+#define RADIALTALLY_H
+
+#include "batchStatistics.h"
+#include <vector>
+#include <string>
+
+
+class RadialTally
+{
+public:
+    RadialTally(const int num_r, const double dr, const int num_z, const double dz);
+    ~RadialTally();
+
+    // Score the weight of a photon leaving the medium through the top (reflectance)
+    // or bottom (transmittance) surface at radial distance 'r' from the source.
+    void    scoreReflectance(const double r, const double weight);
+    void    scoreTransmittance(const double r, const double weight);
+
+    // Score the weight absorbed at radial distance 'r' and depth 'z'.
+    void    scoreAbsorption(const double r, const double z, const double weight);
+
+    // Add the photons and tallies from 'other' into this tally.  Both must
+    // have the same grid.
+    void    merge(const RadialTally &other);
+
+    // Add to the number of photons launched that contributed to this tally.
+    void    addPhotons(const unsigned long n) {num_photons += n;}
+
+    // Zero out all the bins.
+    void    clear(void);
+
+    // Keep batch-means statistics of every bin.  The weight scored since the previous
+    // call to endBatch() forms one batch of 'photons' photons.
+    void    enableBatchStatistics(void);
+    bool    useBatchStatistics(void) const {return batch_statistics;}
+    void    endBatch(const unsigned long photons);
+
+    // Multi-resolution pyramid for early previews.  Level 'l' (0 <= l < num_levels)
+    // merges 2^(l+1) x 2^(l+1) bins of this grid, so its bins are 2, 4, ... times
+    // larger and far less noisy early in a run.  The levels are sums of the same
+    // deposits and cost nothing while scoring; only their batch statistics are kept
+    // at the end of every batch.
+    void    setPyramidLevels(const int num_levels);
+    int     getNumPyramidLevels(void) const {return num_levels;}
+    static int getLevelFactor(const int level) {return 2 << level;}
+
+    // Return pyramid level 'level' as a new tally (with the standard errors of the
+    // level if batch statistics are enabled), to be deleted by the caller.  The last
+    // bin of each axis also collects everything beyond the grid.
+    RadialTally * getLevel(const int level) const;
+
+    // Write the raw tallies to 'filename' so they can be convolved later.
+    // Returns false if the file could not be written.
+    bool    write(const std::string &filename);
+
+    // Read raw tallies that were written with 'write()'.  Returns NULL if the file
+    // could not be parsed.
+    static RadialTally * read(const std::string &filename);
+
+    // Binary form of the raw tallies and their batch statistics, used by checkpoints
+    // and partial tallies.  readBinary() returns NULL if the stream is corrupt.
+    void    writeBinary(std::ostream &output) const;
+    static RadialTally * readBinary(std::istream &input);
+
+    // Return true if 'other' has the same grid, so the two can be merged.
+    bool    sameGrid(const RadialTally &other) const;
+
+    // Return R(r) [1/cm^2], T(r) [1/cm^2] and A(r,z) [1/cm^3] normalized per
+    // launched photon and by the area (volume) of each annulus (ring).
+    std::vector<double> getReflectance(void) const;
+    std::vector<double> getTransmittance(void) const;
+    std::vector<double> getAbsorption(void) const;
+
+    // Standard errors of the normalized tallies above, from the batch statistics.
+    // All zero unless batch statistics are enabled.
+    std::vector<double> getReflectanceStdError(void) const;
+    std::vector<double> getTransmittanceStdError(void) const;
+    std::vector<double> getAbsorptionStdError(void) const;
+
+    int     getNumRadialBins(void) const   {return num_r;}
+    int     getNumDepthBins(void) const    {return num_z;}
+    double  getRadialBinSize(void) const   {return dr;}
+    double  getDepthBinSize(void) const    {return dz;}
+    unsigned long getNumPhotons(void) const {return num_photons;}
+
+    // Return the radius at the center of bin 'ir'.
+    double  getRadius(const int ir) const  {return (ir + 0.5)*dr;}
+
+private:
+    // Return the radial (depth) bin for 'r' ('z').  Values beyond the grid are
+    // collected in the last bin.
+    int     radialBin(const double r) const;
+    int     depthBin(const double z) const;
+
+    // Copy all raw bins into 'values', ordered R(r), T(r), A(r,z).
+    void    flatten(std::vector<double> &values) const;
+
+    // Sum bins in flatten() order into bins 'factor' times larger along both axes.
+    void    coarsen(const std::vector<double> &values, const int factor,
+                    std::vector<double> &coarse) const;
+
+    int     num_r;
+    double  dr;
+    int     num_z;
+    double  dz;
+
+    // Number of photons launched.
+    unsigned long num_photons;
+
+    // Raw weight sums.  'Arz' is stored with 'z' varying fastest.
+    std::vector<double> Rr;
+    std::vector<double> Tr;
+    std::vector<double> Arz;
+
+    // Batch statistics of the bins in flatten() order, and the bins at the end of
+    // the previous batch.
+    bool batch_statistics;
+    BatchStatistics stats;
+    std::vector<double> batch_start;
+
+    // Batch statistics of the pyramid levels, in coarsen() order.
+    int num_levels;
+    std::vector<BatchStatistics> level_stats;
+};
+
+#endif // RADIALTALLY_H
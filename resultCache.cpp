@@ -0,0 +1,86 @@
+//
+//  resultCache.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "resultCache.h"
+#include "checkpointedRun.h"
+#include "scene.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+
+// Bump when a change to the physics or to the checkpoint format invalidates cached
+// results.
+static const int CACHE_VERSION = 2;
+
+
+
+ResultCache::ResultCache(const std::string &directory)
+{
+    this->directory = directory;
+    mkdir(directory.c_str(), 0755);
+}
+
+
+std::string ResultCache::entryFile(const std::string &key, const unsigned long num_photons) const
+{
+    std::ostringstream filename;
+    filename << directory << "/" << key << "-" << num_photons << ".mcc";
+    return filename.str();
+}
+
+
+unsigned long ResultCache::attach(CheckpointedRun &run, const SceneDescription &description,
+                                  const unsigned long num_photons)
+{
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)description.hash());
+    std::ostringstream key_stream;
+    key_stream << "v" << CACHE_VERSION << "-" << hash << "-" << run.getSeed() << "-" << run.getChunkSize();
+    std::string key = key_stream.str();
+
+    // Pick the exact entry, or else the largest smaller one that ends on a chunk
+    // boundary.  A run extended from the middle of a chunk would seed the rest of
+    // that chunk differently from an uncached run.
+    unsigned long best = 0;
+    DIR *d = opendir(directory.c_str());
+    if (d)
+    {
+        std::string prefix = key + "-";
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL)
+        {
+            std::string name = entry->d_name;
+            if (name.compare(0, prefix.size(), prefix) != 0)
+                continue;
+            char *end;
+            unsigned long photons = strtoul(name.c_str() + prefix.size(), &end, 10);
+            if (std::string(end) != ".mcc" || photons > num_photons)
+                continue;
+            if (photons == num_photons || (photons % run.getChunkSize() == 0 && photons > best))
+                best = photons;
+            if (best == num_photons)
+                break;
+        }
+        closedir(d);
+    }
+
+    // An entry written by an interrupted run lacks some photons; they are simply
+    // run again, since run() only propagates the photons that are missing.
+    unsigned long restored = 0;
+    if (best > 0)
+    {
+        run.setCheckpoint(entryFile(key, best), 0);
+        if (run.resume())
+            restored = run.getNumCompleted();
+    }
+
+    run.setCheckpoint(entryFile(key, num_photons), 0);
+    return restored;
+}
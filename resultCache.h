@@ -0,0 +1,47 @@
+//
+//  resultCache.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Content-addressed on-disk cache of run results.  An entry holds the checkpoint of
+// a run (see CheckpointedRun) and is keyed by the hash of the scene description,
+// which includes the tally configuration, the seed, the chunk size and the number of
+// photons.  Every chunk seeds its RNG from the seed and its first photon index, so a
+// cached run of M photons is exactly the first part of a run of N > M photons: a
+// request for more photons than cached propagates only the photons in [M, N) and
+// ends with the same tallies as an uncached run.
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <stdint.h>
+#include <string>
+
+class CheckpointedRun;
+struct SceneDescription;
+
+
+class ResultCache
+{
+public:
+    // Entries are stored in 'directory', which is created if needed.
+    ResultCache(const std::string &directory);
+
+    // Restore the cached tallies closest to a run of 'num_photons' photons of
+    // 'description' into 'run', and make the run store its tallies in the cache
+    // when it finishes.  The scene of 'run' must be compiled from 'description' and
+    // have cleared tallies.  Returns the number of photons restored; the caller
+    // then runs the rest, e.g.
+    //     if (cache.attach(run, description, N) < N)
+    //         run.run(N);
+    unsigned long   attach(CheckpointedRun &run, const SceneDescription &description,
+                           const unsigned long num_photons);
+
+private:
+    // File of the entry with 'num_photons' photons, for the key of a run.
+    std::string entryFile(const std::string &key, const unsigned long num_photons) const;
+
+    std::string directory;
+};
+
+#endif // RESULTCACHE_H
@@ -0,0 +1,215 @@
+//
+//  rqmcSampler.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "rqmcSampler.h"
+#include "workerPool.h"
+#include "photon.h"
+#include "medium.h"
+#include "radialTally.h"
+#include "traceRecorder.h"
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+
+
+RQMCSampler::RQMCSampler(WorkerPool &pool, const unsigned long chunk_size)
+: pool(pool)
+{
+    this->chunk_size = chunk_size > 0 ? chunk_size : 1;
+    sobol = NULL;
+    seed = 0;
+    photons = new Photon[pool.getNumThreads()];
+    points.resize(pool.getNumThreads() * ScrambledSobol::MAX_DIMS);
+}
+
+
+RQMCSampler::~RQMCSampler()
+{
+    for (size_t i = 0; i < scenes.size(); i++)
+        delete scenes[i];
+    if (sobol)
+        delete sobol;
+    delete [] photons;
+}
+
+
+void RQMCSampler::compileScene(const int randomization, const int worker)
+{
+    scenes[randomization] = new Scene(description);
+}
+
+
+void RQMCSampler::runChunk(const int randomization, const unsigned long first_photon,
+                           const unsigned long count, const int worker)
+{
+    TraceScope trace(TraceRecorder::CHUNK);
+    Scene *scene = scenes[randomization];
+    Photon &photon = photons[worker];
+    double *point = &points[worker * ScrambledSobol::MAX_DIMS];
+    int dims = sobol ? sobol->getNumDims() : 0;
+
+    // Every randomization has its own pseudo-random streams and its own scramble.
+    uint64_t stream_seed = seed + randomization;
+
+    photon.beginInjection(scene->getMedium(), scene->getSource());
+    for (unsigned long i = first_photon; i < first_photon + count; i++)
+    {
+        if (sobol)
+            sobol->getPoint(i, ~stream_seed, point);
+        photon.injectQuasiRandomPhoton(stream_seed, i, point, dims);
+    }
+    photon.endInjection(count);
+}
+
+
+void RQMCSampler::run(const SceneDescription &scene, const unsigned long num_photons,
+                      const int num_randomizations, const int dims, const uint64_t seed)
+{
+    for (size_t i = 0; i < scenes.size(); i++)
+        delete scenes[i];
+    if (sobol)
+        delete sobol;
+
+    description = scene;
+    this->seed = seed;
+    sobol = dims > 0 ? new ScrambledSobol(dims) : NULL;
+
+    scenes.assign(num_randomizations, (Scene *)NULL);
+    for (int r = 0; r < num_randomizations; r++)
+        pool.submit(boost::bind(&RQMCSampler::compileScene, this, r, _1));
+    pool.wait();
+
+    for (int r = 0; r < num_randomizations; r++)
+    {
+        for (unsigned long first = 0; first < num_photons; first += chunk_size)
+        {
+            unsigned long count = std::min(chunk_size, num_photons - first);
+            pool.submit(boost::bind(&RQMCSampler::runChunk, this, r, first, count, _1));
+        }
+    }
+    pool.wait();
+}
+
+
+void RQMCSampler::statistics(const std::vector<double> &values, double &mean, double &std_error) const
+{
+    mean = std_error = 0.0;
+    if (values.empty())
+        return;
+
+    double n = values.size();
+    for (size_t i = 0; i < values.size(); i++)
+        mean += values[i];
+    mean /= n;
+
+    if (values.size() < 2)
+        return;
+
+    double variance = 0.0;
+    for (size_t i = 0; i < values.size(); i++)
+        variance += (values[i] - mean) * (values[i] - mean);
+    variance /= n - 1;
+    std_error = sqrt(variance / n);
+}
+
+
+std::vector<double> RQMCSampler::detectedWeights(void) const
+{
+    std::vector<double> values;
+    for (size_t r = 0; r < scenes.size(); r++)
+    {
+        Medium *medium = scenes[r]->getMedium();
+        values.push_back(medium->getDetectedWeight() / medium->getNumPhotons());
+    }
+    return values;
+}
+
+
+double RQMCSampler::getDetectedWeight(void) const
+{
+    double mean, std_error;
+    statistics(detectedWeights(), mean, std_error);
+    return mean;
+}
+
+
+double RQMCSampler::getDetectedWeightStdError(void) const
+{
+    double mean, std_error;
+    statistics(detectedWeights(), mean, std_error);
+    return std_error;
+}
+
+
+std::vector<double> RQMCSampler::getReflectance(void) const
+{
+    std::vector<double> R;
+    if (scenes.empty() || !scenes[0]->getMedium()->getRadialTally())
+        return R;
+
+    R.assign(scenes[0]->getMedium()->getRadialTally()->getNumRadialBins(), 0.0);
+    for (size_t r = 0; r < scenes.size(); r++)
+    {
+        std::vector<double> Rr = scenes[r]->getMedium()->getRadialTally()->getReflectance();
+        for (size_t i = 0; i < R.size(); i++)
+            R[i] += Rr[i] / scenes.size();
+    }
+    return R;
+}
+
+
+std::vector<double> RQMCSampler::getReflectanceStdError(void) const
+{
+    std::vector<double> error;
+    if (scenes.empty() || !scenes[0]->getMedium()->getRadialTally())
+        return error;
+
+    std::vector< std::vector<double> > R;
+    for (size_t r = 0; r < scenes.size(); r++)
+        R.push_back(scenes[r]->getMedium()->getRadialTally()->getReflectance());
+
+    error.resize(R[0].size());
+    std::vector<double> values(scenes.size());
+    for (size_t i = 0; i < error.size(); i++)
+    {
+        for (size_t r = 0; r < scenes.size(); r++)
+            values[r] = R[r][i];
+
+        double mean;
+        statistics(values, mean, error[i]);
+    }
+    return error;
+}
+
+
+bool RQMCSampler::writeResults(const std::string &filename) const
+{
+    std::ofstream output(filename.c_str());
+    if (!output.is_open())
+        return false;
+
+    output << "randomizations\t" << scenes.size() << "\n";
+    output << "quasi-random dimensions\t" << (sobol ? sobol->getNumDims() : 0) << "\n";
+    if (!scenes.empty())
+        output << "photons/randomization\t" << scenes[0]->getMedium()->getNumPhotons() << "\n";
+    output << "detected weight/photon\t" << getDetectedWeight()
+           << "\t+/-\t" << getDetectedWeightStdError() << "\n";
+
+    std::vector<double> R = getReflectance();
+    if (!R.empty())
+    {
+        std::vector<double> error = getReflectanceStdError();
+        double dr = scenes[0]->getMedium()->getRadialTally()->getRadialBinSize();
+        output << "r [cm]\tR [1/cm^2]\tstd error\n";
+        for (size_t i = 0; i < R.size(); i++)
+            output << (i + 0.5) * dr << "\t" << R[i] << "\t" << error[i] << "\n";
+    }
+
+    output.close();
+    return !output.fail();
+}
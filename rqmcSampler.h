@@ -0,0 +1,79 @@
+//
+//  rqmcSampler.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Randomized quasi-Monte Carlo.  The first D random numbers of every photon history
+// (launch direction, first step and first scattering angles) are taken from an
+// Owen-scrambled Sobol point and the rest from the photon's pseudo-random stream.
+// The scene is run once per randomization, each with its own scramble, and the
+// spread of the randomizations gives the standard error of the estimates.
+#ifndef RQMCSAMPLER_H
+#define RQMCSAMPLER_H
+
+#include "scene.h"
+#include "scrambledSobol.h"
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+class WorkerPool;
+class Photon;
+
+
+class RQMCSampler
+{
+public:
+    // Photons are handed out to the workers 'chunk_size' at a time.
+    RQMCSampler(WorkerPool &pool, const unsigned long chunk_size);
+    ~RQMCSampler();
+
+    // Propagate 'num_photons' photons through 'num_randomizations' copies of the scene.
+    // 'dims' is the number of quasi-random dimensions per photon; zero gives plain Monte
+    // Carlo with the same bookkeeping, for comparison.  Powers of two for 'num_photons'
+    // keep the Sobol points balanced.  Blocks until done.
+    void    run(const SceneDescription &scene, const unsigned long num_photons,
+                const int num_randomizations, const int dims, const uint64_t seed);
+
+    int     getNumRandomizations(void) const {return (int)scenes.size();}
+    Scene * getScene(const int randomization) {return scenes[randomization];}
+
+    // Mean detected weight per photon over the randomizations, and its standard error.
+    double  getDetectedWeight(void) const;
+    double  getDetectedWeightStdError(void) const;
+
+    // Mean diffuse reflectance R(r) [1/cm^2] over the randomizations, and its standard
+    // error per bin.  Empty unless the scene is a pencil beam with radial tallies.
+    std::vector<double> getReflectance(void) const;
+    std::vector<double> getReflectanceStdError(void) const;
+
+    // Write the estimates with their standard errors.  Returns false on failure.
+    bool    writeResults(const std::string &filename) const;
+
+private:
+    // Tasks run on the pool.
+    void    compileScene(const int randomization, const int worker);
+    void    runChunk(const int randomization, const unsigned long first_photon,
+                     const unsigned long count, const int worker);
+
+    // Detected weight per photon of every randomization.
+    std::vector<double> detectedWeights(void) const;
+
+    // Mean and standard error of the mean of one value per randomization.
+    void    statistics(const std::vector<double> &values, double &mean, double &std_error) const;
+
+    WorkerPool &pool;
+    unsigned long chunk_size;
+
+    SceneDescription description;
+    std::vector<Scene *> scenes;
+    ScrambledSobol *sobol;
+    uint64_t seed;
+
+    // One photon object and quasi-random point buffer per worker.
+    Photon *photons;
+    std::vector<double> points;
+};
+
+#endif // RQMCSAMPLER_H
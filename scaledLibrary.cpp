@@ -0,0 +1,284 @@
+//
+//  scaledLibrary.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "scaledLibrary.h"
+#include "photon.h"
+#include "medium.h"
+#include "layer.h"
+#include <boost/thread/thread.hpp>
+#include <stdint.h>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// Identifies the binary library file and its layout version.
+static const char LIBRARY_MAGIC[8] = {'M', 'C', 'S', 'L', 'I', 'B', '0', '1'};
+static const uint32_t LIBRARY_VERSION = 1;
+
+// Scattering coefficient of the reference medium [1/cm].  The value itself is
+// arbitrary since everything scales with 1/mu_s.
+static const double REFERENCE_MU_S = 100.0;
+
+
+
+ScaledLibrary::ScaledLibrary()
+{
+    mu_s_ref = REFERENCE_MU_S;
+    refractive_index = 1.0;
+}
+
+
+ScaledLibrary::~ScaledLibrary()
+{
+    // STUB
+}
+
+
+void ScaledLibrary::build(const std::vector<double> &g_values, const double n,
+                          const int num_photons)
+{
+    refractive_index = n;
+    mu_s_ref = REFERENCE_MU_S;
+    entries.clear();
+
+    // The reference medium is 400 mean free paths wide and 200 deep, so hardly any
+    // photon that would have returned to the surface of a semi-infinite medium is lost
+    // through the sides or bottom.
+    double X_dim = 400.0 / mu_s_ref;
+    double Y_dim = 400.0 / mu_s_ref;
+    double Z_dim = 200.0 / mu_s_ref;
+
+    coords injectionCoords;
+    injectionCoords.x = X_dim/2;
+    injectionCoords.y = Y_dim/2;
+    injectionCoords.z = 1e-15f;
+
+    const int NUM_THREADS = boost::thread::hardware_concurrency();
+
+    for (size_t k = 0; k < g_values.size(); k++)
+    {
+        Medium *reference = new Medium(X_dim, Y_dim, Z_dim);
+        reference->addLayer(new Layer(0.0, mu_s_ref, n, g_values[k], 0.0f, Z_dim));
+        reference->setPencilBeam(true);
+        reference->enableExitRecords();
+
+        Photon *photons = new Photon[NUM_THREADS];
+        boost::thread *threads = new boost::thread[NUM_THREADS];
+        for (int i = 0; i < NUM_THREADS; i++)
+        {
+            threads[i] = boost::thread(&Photon::injectPhoton, &photons[i], reference, num_photons/NUM_THREADS,
+                                       rand() + 128, rand() + 128, rand() + 128, rand() + 128, injectionCoords);
+        }
+        for (int i = 0; i < NUM_THREADS; i++)
+        {
+            threads[i].join();
+        }
+
+        // Sort the records on exit radius so queries only visit the photons that
+        // fall within the requested annulus.
+        std::vector<float> &records = reference->getExitRecords();
+        std::vector< std::pair<float, float> > sorted(records.size()/2);
+        for (size_t i = 0; i < sorted.size(); i++)
+        {
+            sorted[i].first = records[2*i];
+            sorted[i].second = records[2*i + 1];
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        Entry entry;
+        entry.g = g_values[k];
+        entry.num_photons = (num_photons/NUM_THREADS) * NUM_THREADS;
+        entry.radius.resize(sorted.size());
+        entry.length.resize(sorted.size());
+        for (size_t i = 0; i < sorted.size(); i++)
+        {
+            entry.radius[i] = sorted[i].first;
+            entry.length[i] = sorted[i].second;
+        }
+        entries.push_back(entry);
+
+        cout << "Library entry g = " << entry.g << ": " << entry.radius.size()
+             << " of " << entry.num_photons << " photons reflected\n";
+
+        delete [] threads;
+        delete [] photons;
+        delete reference;
+    }
+
+    // Keep the entries ordered by anisotropy for interpolation.
+    for (size_t i = 1; i < entries.size(); i++)
+    {
+        for (size_t j = i; j > 0 && entries[j].g < entries[j-1].g; j--)
+            std::swap(entries[j], entries[j-1]);
+    }
+}
+
+
+double ScaledLibrary::scaledWeight(const Entry &entry, const double mu_a, const double mu_s,
+                                   const double rho_min, const double rho_max) const
+{
+    // Lengths in the target medium are those of the reference medium times 'scale'.
+    double scale = mu_s_ref / mu_s;
+
+    std::vector<float>::const_iterator first =
+        std::lower_bound(entry.radius.begin(), entry.radius.end(), (float)(rho_min/scale));
+    std::vector<float>::const_iterator last =
+        std::lower_bound(first, entry.radius.end(), (float)(rho_max/scale));
+
+    size_t begin = first - entry.radius.begin();
+    size_t end = last - entry.radius.begin();
+    double attenuation = mu_a * scale;
+    double sum = 0.0;
+    for (size_t i = begin; i < end; i++)
+    {
+        sum += exp(-attenuation * entry.length[i]);
+    }
+
+    return sum / entry.num_photons;
+}
+
+
+double ScaledLibrary::interpolatedWeight(const double mu_a, const double mu_s, const double g,
+                                         const double rho_min, const double rho_max) const
+{
+    if (entries.empty() || g < entries.front().g || g > entries.back().g)
+        return -1;
+
+    size_t i = 0;
+    while (i + 1 < entries.size() && entries[i+1].g <= g)
+        i++;
+
+    double weight = scaledWeight(entries[i], mu_a, mu_s, rho_min, rho_max);
+    if (entries[i].g == g || i + 1 == entries.size())
+        return weight;
+
+    double t = (g - entries[i].g) / (entries[i+1].g - entries[i].g);
+    return (1.0 - t)*weight + t*scaledWeight(entries[i+1], mu_a, mu_s, rho_min, rho_max);
+}
+
+
+double ScaledLibrary::reflectance(const double mu_a, const double mu_s, const double g,
+                                  const double rho_min, const double rho_max) const
+{
+    double weight = interpolatedWeight(mu_a, mu_s, g, rho_min, rho_max);
+    if (weight < 0)
+        return -1;
+
+    double area = PI * (rho_max*rho_max - rho_min*rho_min);
+    return weight / area;
+}
+
+
+double ScaledLibrary::totalReflectance(const double mu_a, const double mu_s, const double g) const
+{
+    return interpolatedWeight(mu_a, mu_s, g, 0.0, HUGE_VAL);
+}
+
+
+// Binary layout (native byte order):
+//     char[8]   magic "MCSLIB01"
+//     uint32    version
+//     double    refractive index
+//     double    reference scattering coefficient [1/cm]
+//     uint32    number of entries
+// followed for each entry by
+//     double    anisotropy
+//     uint64    number of photons launched
+//     uint64    number of records
+//     float[]   exit radii [cm], sorted
+//     float[]   path lengths [cm]
+bool ScaledLibrary::write(const std::string &filename) const
+{
+    std::ofstream output(filename.c_str(), std::ios::binary);
+    if (!output.is_open())
+        return false;
+
+    uint32_t num_entries = entries.size();
+    output.write(LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC));
+    output.write((const char *)&LIBRARY_VERSION, sizeof(LIBRARY_VERSION));
+    output.write((const char *)&refractive_index, sizeof(refractive_index));
+    output.write((const char *)&mu_s_ref, sizeof(mu_s_ref));
+    output.write((const char *)&num_entries, sizeof(num_entries));
+
+    for (size_t k = 0; k < entries.size(); k++)
+    {
+        const Entry &entry = entries[k];
+        uint64_t num_photons = entry.num_photons;
+        uint64_t num_records = entry.radius.size();
+        output.write((const char *)&entry.g, sizeof(entry.g));
+        output.write((const char *)&num_photons, sizeof(num_photons));
+        output.write((const char *)&num_records, sizeof(num_records));
+        if (num_records > 0)
+        {
+            output.write((const char *)&entry.radius[0], num_records * sizeof(float));
+            output.write((const char *)&entry.length[0], num_records * sizeof(float));
+        }
+    }
+
+    output.close();
+    return !output.fail();
+}
+
+
+bool ScaledLibrary::read(const std::string &filename)
+{
+    std::ifstream input(filename.c_str(), std::ios::binary);
+    if (!input.is_open())
+        return false;
+
+    char magic[sizeof(LIBRARY_MAGIC)];
+    uint32_t version = 0;
+    uint32_t num_entries = 0;
+    input.read(magic, sizeof(magic));
+    input.read((char *)&version, sizeof(version));
+    if (input.fail() || memcmp(magic, LIBRARY_MAGIC, sizeof(magic)) != 0 || version != LIBRARY_VERSION)
+    {
+        cout << "Error: " << filename << " is not a scaled Monte Carlo library\n";
+        return false;
+    }
+
+    input.read((char *)&refractive_index, sizeof(refractive_index));
+    input.read((char *)&mu_s_ref, sizeof(mu_s_ref));
+    input.read((char *)&num_entries, sizeof(num_entries));
+
+    entries.clear();
+    for (uint32_t k = 0; k < num_entries && !input.fail(); k++)
+    {
+        Entry entry;
+        uint64_t num_photons = 0;
+        uint64_t num_records = 0;
+        input.read((char *)&entry.g, sizeof(entry.g));
+        input.read((char *)&num_photons, sizeof(num_photons));
+        input.read((char *)&num_records, sizeof(num_records));
+        if (input.fail())
+            break;
+
+        entry.num_photons = num_photons;
+        entry.radius.resize(num_records);
+        entry.length.resize(num_records);
+        if (num_records > 0)
+        {
+            input.read((char *)&entry.radius[0], num_records * sizeof(float));
+            input.read((char *)&entry.length[0], num_records * sizeof(float));
+        }
+        entries.push_back(entry);
+    }
+
+    if (input.fail())
+    {
+        cout << "Error: truncated library file " << filename << endl;
+        entries.clear();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,78 @@
+//
+//  scaledLibrary.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Scaled Monte Carlo library for fast evaluation of spatially resolved reflectance.
+//
+// A non-absorbing reference medium (mu_a = 0, mu_s = mu_s_ref) is simulated once for
+// each anisotropy 'g', keeping the exit radius 'r' and path length 'L' of every photon
+// that leaves through the top surface.  The reflectance for any other (mu_a, mu_s)
+// follows from the scaling relations
+//     r = r_ref * mu_s_ref/mu_s,   L = L_ref * mu_s_ref/mu_s
+// and Beer-Lambert weighting of each photon with exp(-mu_a*L), without running a
+// new simulation.
+#ifndef SCALEDLIBRARY_H
+#define SCALEDLIBRARY_H
+
+#include <vector>
+#include <string>
+
+
+class ScaledLibrary
+{
+public:
+    ScaledLibrary();
+    ~ScaledLibrary();
+
+    // Simulate the reference medium with 'num_photons' photons for every anisotropy
+    // in 'g_values'.  'n' is the refractive index of the medium, which is not scaled.
+    void    build(const std::vector<double> &g_values, const double n,
+                  const int num_photons);
+
+    // Diffuse reflectance [1/cm^2] for a medium with (mu_a, mu_s, g), averaged over the
+    // annulus rho_min <= r < rho_max [cm].  Anisotropies between library entries are
+    // linearly interpolated.  Returns -1 if 'g' lies outside of the library.
+    double  reflectance(const double mu_a, const double mu_s, const double g,
+                        const double rho_min, const double rho_max) const;
+
+    // Total diffuse reflectance for a medium with (mu_a, mu_s, g).
+    double  totalReflectance(const double mu_a, const double mu_s, const double g) const;
+
+    // Write and read the library in its binary file format.  Both return false on error.
+    bool    write(const std::string &filename) const;
+    bool    read(const std::string &filename);
+
+    int     getNumEntries(void) const {return (int)entries.size();}
+
+private:
+    // One simulation of the reference medium.  Records are sorted on exit radius.
+    struct Entry
+    {
+        double g;
+        unsigned long num_photons;
+        std::vector<float> radius;
+        std::vector<float> length;
+    };
+
+    // Sum of the Beer-Lambert weights of the photons of 'entry' exiting within
+    // rho_min <= r < rho_max once scaled to (mu_a, mu_s), per launched photon.
+    double  scaledWeight(const Entry &entry, const double mu_a, const double mu_s,
+                         const double rho_min, const double rho_max) const;
+
+    // Interpolate scaledWeight() between the library entries bracketing 'g'.
+    double  interpolatedWeight(const double mu_a, const double mu_s, const double g,
+                               const double rho_min, const double rho_max) const;
+
+    // Scattering coefficient of the reference medium [1/cm].
+    double  mu_s_ref;
+
+    // Refractive index of the medium.
+    double  refractive_index;
+
+    // Entries sorted by increasing anisotropy.
+    std::vector<Entry> entries;
+};
+
+#endif // SCALEDLIBRARY_H
@@ -0,0 +1,224 @@
+//
+//  scene.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "scene.h"
+#include "medium.h"
+#include "layer.h"
+#include "sphereAbsorber.h"
+#include "circularDetector.h"
+#include "radialTally.h"
+#include <sstream>
+
+
+
+SceneDescription::SceneDescription()
+{
+    x_dim = y_dim = z_dim = 0;
+    source.x = source.y = source.z = 0;
+    pencil_beam = false;
+    num_radial_bins = num_depth_bins = 0;
+    radial_bin_size = depth_bin_size = 0;
+    pyramid_levels = 0;
+    similarity_mfp = 0;
+    batch_size = 0;
+}
+
+
+void SceneDescription::addLayer(const double mu_a, const double mu_s, const double n, const double g,
+                                const double depth_start, const double depth_end)
+{
+    LayerDescription layer;
+    layer.mu_a = mu_a;
+    layer.mu_s = mu_s;
+    layer.refractive_index = n;
+    layer.anisotropy = g;
+    layer.depth_start = depth_start;
+    layer.depth_end = depth_end;
+    layers.push_back(layer);
+}
+
+
+void SceneDescription::addSphereAbsorber(const double radius, const double x, const double y, const double z,
+                                         const double mu_a, const double mu_s)
+{
+    SphereAbsorberDescription absorber;
+    absorber.radius = radius;
+    absorber.center.x = x;
+    absorber.center.y = y;
+    absorber.center.z = z;
+    absorber.mu_a = mu_a;
+    absorber.mu_s = mu_s;
+    absorbers.push_back(absorber);
+}
+
+
+void SceneDescription::addDetector(const double radius, const double x, const double y, const double z)
+{
+    DetectorDescription detector;
+    detector.radius = radius;
+    detector.center.x = x;
+    detector.center.y = y;
+    detector.center.z = z;
+    detectors.push_back(detector);
+}
+
+
+void SceneDescription::write(std::ostream &output) const
+{
+    // Full precision, so the text form (and the hash) changes with any value.
+    std::streamsize precision = output.precision(17);
+
+    output << "dimensions " << x_dim << " " << y_dim << " " << z_dim << "\n";
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const LayerDescription &l = layers[i];
+        output << "layer " << l.mu_a << " " << l.mu_s << " " << l.refractive_index << " "
+               << l.anisotropy << " " << l.depth_start << " " << l.depth_end << "\n";
+    }
+    for (size_t i = 0; i < absorbers.size(); i++)
+    {
+        const SphereAbsorberDescription &a = absorbers[i];
+        output << "absorber " << a.radius << " " << a.center.x << " " << a.center.y << " "
+               << a.center.z << " " << a.mu_a << " " << a.mu_s << "\n";
+    }
+    for (size_t i = 0; i < detectors.size(); i++)
+    {
+        const DetectorDescription &d = detectors[i];
+        output << "detector " << d.radius << " " << d.center.x << " " << d.center.y << " "
+               << d.center.z << "\n";
+    }
+    output << "source " << source.x << " " << source.y << " " << source.z << "\n";
+    output << "pencil-beam " << (pencil_beam ? 1 : 0) << "\n";
+    if (num_radial_bins > 0)
+        output << "radial-tallies " << num_radial_bins << " " << radial_bin_size << " "
+               << num_depth_bins << " " << depth_bin_size << "\n";
+    if (pyramid_levels > 0)
+        output << "pyramid-levels " << pyramid_levels << "\n";
+    output << "batch-size " << batch_size << "\n";
+    output << "similarity-mfp " << similarity_mfp << "\n";
+
+    output.precision(precision);
+}
+
+
+bool SceneDescription::readLine(const std::string &keyword, std::istream &values)
+{
+    if (keyword == "dimensions")
+        values >> x_dim >> y_dim >> z_dim;
+    else if (keyword == "layer")
+    {
+        LayerDescription l;
+        values >> l.mu_a >> l.mu_s >> l.refractive_index >> l.anisotropy
+               >> l.depth_start >> l.depth_end;
+        layers.push_back(l);
+    }
+    else if (keyword == "absorber")
+    {
+        SphereAbsorberDescription a;
+        values >> a.radius >> a.center.x >> a.center.y >> a.center.z >> a.mu_a >> a.mu_s;
+        absorbers.push_back(a);
+    }
+    else if (keyword == "detector")
+    {
+        DetectorDescription d;
+        values >> d.radius >> d.center.x >> d.center.y >> d.center.z;
+        detectors.push_back(d);
+    }
+    else if (keyword == "source")
+        values >> source.x >> source.y >> source.z;
+    else if (keyword == "pencil-beam")
+        values >> pencil_beam;
+    else if (keyword == "radial-tallies")
+        values >> num_radial_bins >> radial_bin_size >> num_depth_bins >> depth_bin_size;
+    else if (keyword == "pyramid-levels")
+        values >> pyramid_levels;
+    else if (keyword == "batch-size")
+        values >> batch_size;
+    else if (keyword == "similarity-mfp")
+        values >> similarity_mfp;
+    else
+        return false;
+
+    return !values.fail();
+}
+
+
+uint64_t SceneDescription::hash(void) const
+{
+    std::ostringstream text;
+    write(text);
+    std::string data = text.str();
+
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+
+Scene::Scene(const SceneDescription &description)
+{
+    this->description = description;
+    source = description.source;
+
+    medium = new Medium(description.x_dim, description.y_dim, description.z_dim);
+
+    std::vector<Layer *> layers;
+    for (size_t i = 0; i < description.layers.size(); i++)
+    {
+        const LayerDescription &l = description.layers[i];
+        layers.push_back(new Layer(l.mu_a, l.mu_s, l.refractive_index, l.anisotropy,
+                                   l.depth_start, l.depth_end));
+        medium->addLayer(layers.back());
+    }
+
+    // Absorbers are placed in the layer holding their center.
+    for (size_t i = 0; i < description.absorbers.size(); i++)
+    {
+        const SphereAbsorberDescription &a = description.absorbers[i];
+        SphereAbsorber *absorber = new SphereAbsorber(a.radius, a.center.x, a.center.y, a.center.z);
+        absorber->setAbsorberAbsorptionCoeff(a.mu_a);
+        absorber->setAbsorberScatterCoeff(a.mu_s);
+        medium->getLayerFromDepth(a.center.z)->addAbsorber(absorber);
+        absorbers.push_back(absorber);
+    }
+
+    for (size_t i = 0; i < description.detectors.size(); i++)
+    {
+        const DetectorDescription &d = description.detectors[i];
+        CircularDetector *detector = new CircularDetector(d.radius, Vector3d(d.center.x, d.center.y, d.center.z));
+        detector->setDetectorPlaneXY();
+        medium->addDetector(detector);
+        detectors.push_back(detector);
+    }
+
+    medium->setPencilBeam(description.pencil_beam);
+    if (description.num_radial_bins > 0)
+        medium->enablePencilBeamTallies(description.num_radial_bins, description.radial_bin_size,
+                                        description.num_depth_bins, description.depth_bin_size);
+    if (description.batch_size > 0)
+        medium->enableBatchStatistics(description.batch_size);
+    if (description.pyramid_levels > 0 && medium->getRadialTally())
+        medium->getRadialTally()->setPyramidLevels(description.pyramid_levels);
+
+    // The feature map needs the complete scene.
+    if (description.similarity_mfp > 0)
+        medium->enableSimilarityScaling(description.similarity_mfp);
+}
+
+
+Scene::~Scene()
+{
+    // Deleting the medium also deletes its layers and their absorbers.
+    delete medium;
+
+    for (size_t i = 0; i < detectors.size(); i++)
+        delete detectors[i];
+}
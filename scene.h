@@ -0,0 +1,138 @@
+//
+//  scene.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// A plain description of a simulation scene (medium, layers, absorbers, detectors and
+// source) and the compiled form that photons propagate through.  Keeping the
+// description separate allows many scene variants to be defined up front and compiled
+// only when they are run.
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "coordinates.h"
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <iostream>
+
+class Medium;
+class SphereAbsorber;
+class CircularDetector;
+
+
+struct LayerDescription
+{
+    double mu_a;                // [1/cm]
+    double mu_s;                // [1/cm]
+    double refractive_index;
+    double anisotropy;
+    double depth_start;         // [cm]
+    double depth_end;           // [cm]
+};
+
+
+struct SphereAbsorberDescription
+{
+    double radius;              // [cm]
+    coords center;              // [cm]
+    double mu_a;                // [1/cm]
+    double mu_s;                // [1/cm]
+};
+
+
+// Circular detectors lie in the x-y plane.
+struct DetectorDescription
+{
+    double radius;              // [cm]
+    coords center;              // [cm]
+};
+
+
+struct SceneDescription
+{
+    SceneDescription();
+
+    // Dimensions of the medium [cm].
+    double x_dim, y_dim, z_dim;
+
+    std::vector<LayerDescription> layers;
+    std::vector<SphereAbsorberDescription> absorbers;
+    std::vector<DetectorDescription> detectors;
+
+    // Injection point of the photons.
+    coords source;
+
+    // Launch a normally incident pencil beam instead of the default source.
+    bool pencil_beam;
+
+    // Pencil-beam tallies R(r), T(r) and A(r,z); zero radial bins disables them.
+    // Enabling them also launches a pencil beam.
+    int num_radial_bins, num_depth_bins;
+    double radial_bin_size, depth_bin_size;     // [cm]
+
+    // Coarser levels of the pencil-beam tallies for early previews (see
+    // RadialTally::setPyramidLevels()), zero for none.
+    int pyramid_levels;
+
+    // Photons per batch of the batch-means error estimates, zero disables them.
+    unsigned long batch_size;
+
+    // Similarity scaling distance in reduced mean free paths, zero disables it.
+    double similarity_mfp;
+
+    // Convenience routines to fill in the description.
+    void addLayer(const double mu_a, const double mu_s, const double n, const double g,
+                  const double depth_start, const double depth_end);
+    void addSphereAbsorber(const double radius, const double x, const double y, const double z,
+                           const double mu_a, const double mu_s);
+    void addDetector(const double radius, const double x, const double y, const double z);
+
+    // Text form of the description, one keyword with its values per line:
+    //     dimensions <x> <y> <z>
+    //     layer <mu_a> <mu_s> <n> <g> <depth start> <depth end>
+    //     absorber <radius> <x> <y> <z> <mu_a> <mu_s>
+    //     detector <radius> <x> <y> <z>
+    //     source <x> <y> <z>
+    //     pencil-beam <0|1>
+    //     radial-tallies <radial bins> <radial bin size> <depth bins> <depth bin size>
+    //     pyramid-levels <levels>
+    //     batch-size <photons>
+    //     similarity-mfp <distance>
+    void write(std::ostream &output) const;
+
+    // Parse one line of the text form, with 'keyword' already read from 'values'.
+    // Returns false for an unknown keyword or malformed values.
+    bool readLine(const std::string &keyword, std::istream &values);
+
+    // 64-bit FNV-1a hash of the text form, so equal descriptions hash equally.
+    uint64_t hash(void) const;
+};
+
+
+// The compiled scene.  Owns the medium and everything placed in it.
+class Scene
+{
+public:
+    Scene(const SceneDescription &description);
+    ~Scene();
+
+    Medium * getMedium(void) {return medium;}
+    coords & getSource(void) {return source;}
+    const SceneDescription & getDescription(void) const {return description;}
+
+    // The absorbers in the order they were described, to read back their tallies.
+    const std::vector<SphereAbsorber *> & getAbsorbers(void) const {return absorbers;}
+
+private:
+    SceneDescription description;
+    Medium *medium;
+    coords source;
+    std::vector<SphereAbsorber *> absorbers;
+
+    // The medium does not own its detectors.
+    std::vector<CircularDetector *> detectors;
+};
+
+#endif // SCENE_H
@@ -0,0 +1,124 @@
+//
+//  scrambledSobol.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "scrambledSobol.h"
+
+
+// Primitive polynomials and initial direction numbers of dimensions 2 to 16 from
+// Joe and Kuo (new-joe-kuo-6.21201).  Dimension 1 is the van der Corput sequence.
+struct SobolInit
+{
+    int s;
+    uint32_t a;
+    uint32_t m[6];
+};
+
+static const SobolInit SOBOL_INIT[ScrambledSobol::MAX_DIMS - 1] =
+{
+    {1,  0, {1}},
+    {2,  1, {1, 3}},
+    {3,  1, {1, 3, 1}},
+    {3,  2, {1, 1, 1}},
+    {4,  1, {1, 1, 3, 3}},
+    {4,  4, {1, 3, 5, 13}},
+    {5,  2, {1, 1, 5, 5, 17}},
+    {5,  4, {1, 1, 5, 5, 5}},
+    {5,  7, {1, 1, 7, 11, 19}},
+    {5, 11, {1, 1, 5, 1, 1}},
+    {5, 13, {1, 1, 1, 3, 11}},
+    {5, 14, {1, 3, 5, 5, 31}},
+    {6,  1, {1, 3, 3, 9, 7, 49}},
+    {6, 13, {1, 1, 1, 15, 21, 21}},
+    {6, 16, {1, 3, 1, 13, 27, 49}}
+};
+
+
+static uint32_t reverseBits(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+
+// Nested uniform scramble.  On the bit-reversed value every step of the
+// Laine-Karras hash only propagates bits upwards, so each output bit is flipped
+// depending on the more significant input bits only, as in Owen's scrambling.
+static uint32_t owenScramble(uint32_t x, const uint32_t seed)
+{
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+
+// Independent scramble seed for every (randomization, dimension) pair.
+static uint32_t scrambleSeed(const uint64_t seed, const int dim)
+{
+    uint64_t z = seed + (uint64_t)(dim + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)(z ^ (z >> 31));
+}
+
+
+
+ScrambledSobol::ScrambledSobol(const int dims)
+{
+    this->dims = dims < 1 ? 1 : (dims > MAX_DIMS ? MAX_DIMS : dims);
+
+    for (int k = 0; k < 32; k++)
+        directions[0][k] = 1u << (31 - k);
+
+    for (int d = 1; d < MAX_DIMS; d++)
+    {
+        const SobolInit &init = SOBOL_INIT[d - 1];
+        uint32_t *v = directions[d];
+        for (int k = 0; k < 32; k++)
+        {
+            if (k < init.s)
+            {
+                v[k] = init.m[k] << (31 - k);
+                continue;
+            }
+            v[k] = v[k - init.s] ^ (v[k - init.s] >> init.s);
+            for (int j = 1; j < init.s; j++)
+            {
+                if ((init.a >> (init.s - 1 - j)) & 1)
+                    v[k] ^= v[k - j];
+            }
+        }
+    }
+}
+
+
+uint32_t ScrambledSobol::sobol(const uint32_t index, const int dim) const
+{
+    uint32_t x = 0;
+    uint32_t i = index;
+    for (int k = 0; i != 0; k++, i >>= 1)
+    {
+        if (i & 1)
+            x ^= directions[dim][k];
+    }
+    return x;
+}
+
+
+void ScrambledSobol::getPoint(const uint32_t index, const uint64_t seed, double *point) const
+{
+    for (int d = 0; d < dims; d++)
+    {
+        uint32_t x = owenScramble(sobol(index, d), scrambleSeed(seed, d));
+        point[d] = (x + 0.5) / 4294967296.0;
+    }
+}
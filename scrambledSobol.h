@@ -0,0 +1,43 @@
+//
+//  scrambledSobol.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Owen-scrambled Sobol points for randomized quasi-Monte Carlo.  Every randomization
+// applies an independent nested uniform scramble (a hash based approximation of
+// Owen's scrambling) to the Sobol sequence, so each randomization is an unbiased
+// estimate and their spread gives the error estimate.  Points are generated on
+// demand from the index, so any worker can compute any point.
+#ifndef SCRAMBLEDSOBOL_H
+#define SCRAMBLEDSOBOL_H
+
+#include <stdint.h>
+
+
+class ScrambledSobol
+{
+public:
+    // Number of dimensions with built-in direction numbers.
+    static const int MAX_DIMS = 16;
+
+    // 'dims' is clamped to [1, MAX_DIMS].
+    ScrambledSobol(const int dims);
+
+    int     getNumDims(void) const {return dims;}
+
+    // Fill 'point[dims]' with the 'index'-th point of the randomization selected by
+    // 'seed'.  Coordinates lie strictly within (0,1).
+    void    getPoint(const uint32_t index, const uint64_t seed, double *point) const;
+
+private:
+    // Unscrambled Sobol coordinate of 'index' in dimension 'dim'.
+    uint32_t sobol(const uint32_t index, const int dim) const;
+
+    int dims;
+
+    // 32-bit direction numbers of every dimension.
+    uint32_t directions[MAX_DIMS][32];
+};
+
+#endif // SCRAMBLEDSOBOL_H
@@ -0,0 +1,96 @@
+//
+//  simulator.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "simulator.h"
+#include "checkpointedRun.h"
+#include "resultCache.h"
+#include "medium.h"
+#include "absorber.h"
+#include "sphereAbsorber.h"
+#include "radialTally.h"
+
+
+
+RunOptions::RunOptions()
+{
+    num_photons = 100000;
+    seed = 1;
+    chunk_size = 1000;
+}
+
+
+RunResults::RunResults()
+{
+    num_photons = 0;
+    num_detected = 0;
+    steps_per_photon = 0;
+    detected_weight = detected_weight_error = 0;
+    total_absorber_weight = total_absorber_weight_error = 0;
+}
+
+
+
+Simulator::Simulator(const int num_threads)
+: pool(num_threads)
+{
+}
+
+
+RunResults Simulator::run(const SceneDescription &description, const RunOptions &options)
+{
+    Scene scene(description);
+    return run(scene, options);
+}
+
+
+RunResults Simulator::run(Scene &scene, const RunOptions &options)
+{
+    Medium *medium = scene.getMedium();
+    medium->clearTallies();
+
+    CheckpointedRun run(pool, &scene, options.chunk_size, options.seed);
+    unsigned long cached = 0;
+    if (!options.cache_dir.empty())
+    {
+        ResultCache cache(options.cache_dir);
+        cached = cache.attach(run, scene.getDescription(), options.num_photons);
+    }
+    if (cached < options.num_photons)
+        run.run(options.num_photons);
+
+    RunResults results;
+    results.num_photons = medium->getNumPhotons();
+    results.num_detected = medium->getNumDetected();
+    if (results.num_photons == 0)
+        return results;
+
+    double photons = results.num_photons;
+    results.steps_per_photon = medium->getTotalSteps() / photons;
+    results.detected_weight = medium->getDetectedWeight() / photons;
+    results.detected_weight_error = medium->getDetectedWeightStdError();
+
+    const std::vector<SphereAbsorber *> &absorbers = scene.getAbsorbers();
+    for (size_t i = 0; i < absorbers.size(); i++)
+    {
+        results.absorber_weight.push_back(absorbers[i]->getAbsorbedWeight() / photons);
+        results.absorber_weight_error.push_back(medium->getAbsorberWeightStdError(absorbers[i]));
+        results.total_absorber_weight += results.absorber_weight.back();
+    }
+    results.total_absorber_weight_error = medium->getAbsorberWeightStdError();
+
+    RadialTally *radial_tally = medium->getRadialTally();
+    if (radial_tally)
+    {
+        results.reflectance = radial_tally->getReflectance();
+        results.reflectance_error = radial_tally->getReflectanceStdError();
+        results.transmittance = radial_tally->getTransmittance();
+        results.transmittance_error = radial_tally->getTransmittanceStdError();
+        results.absorption = radial_tally->getAbsorption();
+        results.absorption_error = radial_tally->getAbsorptionStdError();
+    }
+
+    return results;
+}
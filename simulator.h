@@ -0,0 +1,83 @@
+//
+//  simulator.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Embeddable entry point of libmcboost.  A Simulator owns a worker pool that stays
+// alive between runs, so callers that run many small simulations (e.g. the forward
+// model of a reconstruction) create threads only once, and results are returned in
+// memory instead of files.  See mcBoostC.h for the C interface.
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "scene.h"
+#include "workerPool.h"
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+
+struct RunOptions
+{
+    RunOptions();
+
+    unsigned long num_photons;
+    uint64_t seed;
+
+    // Photons handed to a worker at a time.  Results only depend on the seed and
+    // the chunk size, not on the number of threads.
+    unsigned long chunk_size;
+
+    // Directory of a ResultCache to reuse earlier runs from, empty for none.
+    std::string cache_dir;
+};
+
+
+// Tallies of a run, normalized per launched photon.  Standard errors are zero
+// unless the scene has batch statistics enabled.
+struct RunResults
+{
+    RunResults();
+
+    unsigned long num_photons;
+    unsigned long num_detected;
+    double steps_per_photon;
+
+    double detected_weight;
+    double detected_weight_error;
+
+    // Weight absorbed in each absorber, in the order they were described, and in all
+    // absorbers together.
+    std::vector<double> absorber_weight, absorber_weight_error;
+    double total_absorber_weight;
+    double total_absorber_weight_error;
+
+    // Pencil-beam tallies R(r) [1/cm^2], T(r) [1/cm^2] and A(r,z) [1/cm^3], with 'z'
+    // varying fastest.  Empty unless the scene has pencil-beam tallies.
+    std::vector<double> reflectance, reflectance_error;
+    std::vector<double> transmittance, transmittance_error;
+    std::vector<double> absorption, absorption_error;
+};
+
+
+class Simulator
+{
+public:
+    // Create the worker pool.  A value <= 0 uses one worker per core.
+    Simulator(const int num_threads);
+
+    // Compile 'description' and run it.
+    RunResults run(const SceneDescription &description, const RunOptions &options);
+
+    // Run a compiled scene.  Its tallies are cleared first, so a scene can be run any
+    // number of times without compiling it again.
+    RunResults run(Scene &scene, const RunOptions &options);
+
+    WorkerPool & getPool(void) {return pool;}
+
+private:
+    WorkerPool pool;
+};
+
+#endif // SIMULATOR_H
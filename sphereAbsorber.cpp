@@ -167,6 +167,19 @@ bool SphereAbsorber::inSphereVolume(const boost::shared_ptr<Vector3d> photonLoca
 }
 
 
+// Distance from 'point' to the surface of the sphere.  Points inside the
+// sphere are considered to be on the absorber and return zero.
+double SphereAbsorber::distanceToAbsorber(const coords &point)
+{
+    double dx = point.x - center->location.x;
+    double dy = point.y - center->location.y;
+    double dz = point.z - center->location.z;
+    
+    double dist = sqrt(dx*dx + dy*dy + dz*dz) - radius;
+    return dist > 0.0 ? dist : 0.0;
+}
+
+
 // FIXME: Verify this is correct.
 sphereCoords SphereAbsorber::cartesianToSpherical(const coords &center)
 {
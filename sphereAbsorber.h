@@ -22,6 +22,7 @@ public:
     virtual bool inAbsorber(const boost::shared_ptr<Vector3d> photonVector);
     virtual bool crossedAbsorber(const boost::shared_ptr<Vector3d> A,
                                  const boost::shared_ptr<Vector3d> B);
+    virtual double distanceToAbsorber(const coords &point);
 
     
     // Check if photon is within the radius of the absorber.
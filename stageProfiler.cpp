@@ -0,0 +1,98 @@
+//
+//  stageProfiler.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "stageProfiler.h"
+#include <algorithm>
+
+
+
+StageProfile::StageProfile()
+{
+    clear();
+}
+
+
+void StageProfile::clear(void)
+{
+    std::fill(cycles, cycles + NUM_STAGES, 0);
+    std::fill(samples, samples + NUM_STAGES, 0);
+    std::fill(&histogram[0][0], &histogram[0][0] + NUM_STAGES * NUM_CYCLE_BINS, 0);
+    nested = 0;
+}
+
+
+void StageProfile::merge(const StageProfile &other)
+{
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        cycles[s] += other.cycles[s];
+        samples[s] += other.samples[s];
+        for (int k = 0; k < NUM_CYCLE_BINS; k++)
+            histogram[s][k] += other.histogram[s][k];
+    }
+}
+
+
+double StageProfile::getCyclesPerStep(const Stage stage, const uint64_t steps) const
+{
+    return steps > 0 ? (double)cycles[stage] / steps : 0.0;
+}
+
+
+const char * StageProfile::getStageName(const Stage stage)
+{
+    static const char *names[NUM_STAGES] = {"setStepSize", "boundary checks", "hop", "drop",
+                                            "spin", "roulette", "detection", "logging"};
+    return names[stage];
+}
+
+
+void StageProfile::write(std::ostream &output, const uint64_t steps) const
+{
+    uint64_t total = 0;
+    for (int s = 0; s < NUM_STAGES; s++)
+        total += cycles[s];
+
+    output << "stage\tcycles/step\tshare\tsamples\tcycles/sample\n";
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        output << getStageName((Stage)s) << "\t" << getCyclesPerStep((Stage)s, steps) << "\t"
+               << (total > 0 ? 100.0 * cycles[s] / total : 0.0) << "%\t" << samples[s] << "\t"
+               << (samples[s] > 0 ? (double)cycles[s] / samples[s] : 0.0) << "\n";
+    }
+    output << "total\t" << (steps > 0 ? (double)total / steps : 0.0) << "\n";
+
+    // Histograms over the bins any stage uses.
+    int first = NUM_CYCLE_BINS, last = -1;
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        for (int k = 0; k < NUM_CYCLE_BINS; k++)
+        {
+            if (histogram[s][k] == 0)
+                continue;
+            first = std::min(first, k);
+            last = std::max(last, k);
+        }
+    }
+    if (last < 0)
+        return;
+
+    output << "cycles";
+    for (int s = 0; s < NUM_STAGES; s++)
+        output << "\t" << getStageName((Stage)s);
+    output << "\n";
+    for (int k = first; k <= last; k++)
+    {
+        output << "[" << (k == 0 ? 0 : 1ULL << k) << ", ";
+        if (k == NUM_CYCLE_BINS - 1)
+            output << "inf)";
+        else
+            output << (1ULL << (k + 1)) << ")";
+        for (int s = 0; s < NUM_STAGES; s++)
+            output << "\t" << histogram[s][k];
+        output << "\n";
+    }
+}
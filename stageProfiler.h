@@ -0,0 +1,121 @@
+//
+//  stageProfiler.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Cycle counts of the stages of the photon propagation loop, taken with the time
+// stamp counter.  External profilers smear the inlined hot loop over a few symbols;
+// timing the stages in place tells which one to optimize for a given scene.
+//
+// Profiling is compiled in only when STAGE_PROFILING is defined (see the makefile),
+// otherwise the macros below expand to nothing and the loop is left untouched.
+// Stages are timed back to back, so every time stamp both ends one stage and starts
+// the next.  Detection and logging run inside the boundary stage and are timed as
+// nested stages, whose cycles are subtracted from the stage around them.
+#ifndef STAGEPROFILER_H
+#define STAGEPROFILER_H
+
+#include <stdint.h>
+#include <iostream>
+#if !defined(__i386__) && !defined(__x86_64__)
+#include <time.h>
+#endif
+
+
+struct StageProfile
+{
+    enum Stage
+    {
+        SET_STEP_SIZE,
+        BOUNDARY_CHECK,
+        HOP,
+        DROP,
+        SPIN,
+        ROULETTE,
+        DETECTION,
+        LOGGING,
+        NUM_STAGES
+    };
+
+    // Bin 'k' of the histogram of a stage counts samples of [2^k, 2^(k+1)) cycles.
+    static const int NUM_CYCLE_BINS = 24;
+
+    StageProfile();
+
+    void    clear(void);
+    void    merge(const StageProfile &other);
+
+    // Read the time stamp counter (nanoseconds where there is none).
+    static uint64_t readCycles(void)
+    {
+#if defined(__i386__) || defined(__x86_64__)
+        uint32_t low, high;
+        __asm__ __volatile__("rdtsc" : "=a" (low), "=d" (high));
+        return ((uint64_t)high << 32) | low;
+#else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+    }
+
+    // Close 'stage' that started at 'start', less the nested stages it ran.  Returns
+    // the time stamp, which starts the next stage.
+    uint64_t record(const Stage stage, const uint64_t start)
+    {
+        uint64_t now = readCycles();
+        add(stage, now - start - nested);
+        nested = 0;
+        return now;
+    }
+
+    // Close a stage nested in another one.
+    uint64_t recordNested(const Stage stage, const uint64_t start)
+    {
+        uint64_t now = readCycles();
+        add(stage, now - start);
+        nested += now - start;
+        return now;
+    }
+
+    // Mean cycles of the stage per step of 'steps' steps.
+    double  getCyclesPerStep(const Stage stage, const uint64_t steps) const;
+
+    // Cycles per step, the share of every stage and their histograms.
+    void    write(std::ostream &output, const uint64_t steps) const;
+
+    static const char * getStageName(const Stage stage);
+
+    uint64_t cycles[NUM_STAGES];
+    uint64_t samples[NUM_STAGES];
+    uint64_t histogram[NUM_STAGES][NUM_CYCLE_BINS];
+
+private:
+    void    add(const Stage stage, const uint64_t elapsed)
+    {
+        int bin = 0;
+        for (uint64_t n = elapsed; n > 1 && bin < NUM_CYCLE_BINS - 1; n >>= 1)
+            bin++;
+        cycles[stage] += elapsed;
+        samples[stage]++;
+        histogram[stage][bin]++;
+    }
+
+    uint64_t nested;
+} __attribute__((aligned(64)));
+
+
+#ifdef STAGE_PROFILING
+#define PROFILE_START(profile)                 uint64_t profile_stamp = StageProfile::readCycles()
+#define PROFILE_STAGE(profile, stage)          profile_stamp = (profile).record(StageProfile::stage, profile_stamp)
+#define PROFILE_NESTED_START(profile)          uint64_t profile_nested_stamp = StageProfile::readCycles()
+#define PROFILE_NESTED_STAGE(profile, stage)   profile_nested_stamp = (profile).recordNested(StageProfile::stage, profile_nested_stamp)
+#else
+#define PROFILE_START(profile)
+#define PROFILE_STAGE(profile, stage)
+#define PROFILE_NESTED_START(profile)
+#define PROFILE_NESTED_STAGE(profile, stage)
+#endif
+
+#endif // STAGEPROFILER_H
@@ -0,0 +1,204 @@
+//
+//  sweepEngine.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "sweepEngine.h"
+#include "workerPool.h"
+#include "photon.h"
+#include "medium.h"
+#include "layer.h"
+#include "sphereAbsorber.h"
+#include "radialTally.h"
+#include "timer.h"
+#include "traceRecorder.h"
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+
+SweepEngine::SweepEngine(WorkerPool &pool, const unsigned long chunk_size)
+: pool(pool)
+{
+    this->chunk_size = chunk_size > 0 ? chunk_size : 1;
+    photons = new Photon[pool.getNumThreads()];
+}
+
+
+SweepEngine::~SweepEngine()
+{
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        if (variants[i].scene)
+            delete variants[i].scene;
+    }
+    delete [] photons;
+}
+
+
+int SweepEngine::addVariant(const std::string &name, const SceneDescription &scene,
+                            const unsigned long num_photons, const uint64_t seed)
+{
+    Variant variant;
+    variant.name = name;
+    variant.description = scene;
+    variant.scene = NULL;
+    variant.num_photons = num_photons;
+    variant.seed = seed;
+    variant.start_time = 0;
+    variant.end_time = 0;
+    variants.push_back(variant);
+
+    return variants.size() - 1;
+}
+
+
+void SweepEngine::compileVariant(const int variant, const int worker)
+{
+    variants[variant].scene = new Scene(variants[variant].description);
+}
+
+
+void SweepEngine::runChunk(const int variant, const unsigned long first_photon,
+                           const unsigned long count, const int worker)
+{
+    TraceScope trace(TraceRecorder::CHUNK);
+    Variant &v = variants[variant];
+    double start = getWallTime();
+
+    unsigned int state[4];
+    Photon::counterSeeds(v.seed, first_photon, state);
+    photons[worker].injectPhoton(v.scene->getMedium(), count,
+                                 state[0], state[1], state[2], state[3],
+                                 v.scene->getSource());
+
+    double end = getWallTime();
+    boost::mutex::scoped_lock lock(m_mutex);
+    if (v.start_time == 0 || start < v.start_time)
+        v.start_time = start;
+    if (end > v.end_time)
+        v.end_time = end;
+}
+
+
+// Sort variant indices on decreasing number of photons.
+struct LargerVariant
+{
+    LargerVariant(const std::vector<unsigned long> &photons) : photons(photons) {}
+    bool operator()(const int a, const int b) const {return photons[a] > photons[b];}
+    const std::vector<unsigned long> &photons;
+};
+
+
+void SweepEngine::run(void)
+{
+    // Compiling scenes (e.g. building feature maps) is done in parallel as well.
+    for (size_t v = 0; v < variants.size(); v++)
+    {
+        if (!variants[v].scene)
+            pool.submit(boost::bind(&SweepEngine::compileVariant, this, (int)v, _1));
+    }
+    pool.wait();
+
+    // Chunks are queued round-robin over the variants, starting with the largest.
+    // Large variants therefore start right away and are spread over all workers, while
+    // the chunks of small variants fill in between.  The tail is at most one chunk.
+    std::vector<unsigned long> queued(variants.size(), 0);
+    std::vector<unsigned long> num_photons(variants.size());
+    std::vector<int> order(variants.size());
+    for (size_t v = 0; v < variants.size(); v++)
+    {
+        num_photons[v] = variants[v].num_photons;
+        order[v] = v;
+    }
+    std::stable_sort(order.begin(), order.end(), LargerVariant(num_photons));
+
+    bool remaining = true;
+    while (remaining)
+    {
+        remaining = false;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            int v = order[i];
+            if (queued[v] >= num_photons[v])
+                continue;
+
+            unsigned long count = std::min(chunk_size, num_photons[v] - queued[v]);
+            pool.submit(boost::bind(&SweepEngine::runChunk, this, v, queued[v], count, _1));
+            queued[v] += count;
+            remaining = true;
+        }
+    }
+    pool.wait();
+}
+
+
+bool SweepEngine::writeResults(const std::string &prefix)
+{
+    bool success = true;
+    for (size_t v = 0; v < variants.size(); v++)
+    {
+        Variant &variant = variants[v];
+        if (!variant.scene)
+            continue;
+
+        Medium *medium = variant.scene->getMedium();
+        double photons_run = medium->getNumPhotons();
+
+        std::string filename = prefix + "-" + variant.name + ".txt";
+        std::ofstream output(filename.c_str());
+        if (!output.is_open())
+        {
+            cout << "Error: could not write " << filename << endl;
+            success = false;
+            continue;
+        }
+
+        output << "variant\t" << variant.name << "\n";
+        output << "photons\t" << medium->getNumPhotons() << "\n";
+        output << "elapsed [s]\t" << getElapsed(v) << "\n";
+        output << "steps/photon\t" << medium->getTotalSteps() / photons_run << "\n";
+        output << "detected photons\t" << medium->getNumDetected() << "\n";
+        output << "detected weight/photon\t" << medium->getDetectedWeight() / photons_run;
+        if (medium->getBatchSize() > 0)
+            output << "\t+/-\t" << medium->getDetectedWeightStdError();
+        output << "\n";
+
+        const std::vector<SphereAbsorber *> &absorbers = variant.scene->getAbsorbers();
+        double absorbed = 0;
+        for (size_t i = 0; i < absorbers.size(); i++)
+        {
+            output << "absorber " << i << " weight/photon\t"
+                   << absorbers[i]->getAbsorbedWeight() / photons_run;
+            if (medium->getBatchSize() > 0)
+                output << "\t+/-\t" << medium->getAbsorberWeightStdError(absorbers[i]);
+            output << "\n";
+            absorbed += absorbers[i]->getAbsorbedWeight();
+        }
+        if (absorbers.size() > 1 || medium->getBatchSize() > 0)
+        {
+            output << "total absorber weight/photon\t" << absorbed / photons_run;
+            if (medium->getBatchSize() > 0)
+                output << "\t+/-\t" << medium->getAbsorberWeightStdError();
+            output << "\n";
+        }
+        output.close();
+
+        if (medium->getRadialTally())
+        {
+            std::string radial_file = prefix + "-" + variant.name + "-radial.txt";
+            if (!medium->getRadialTally()->write(radial_file))
+            {
+                cout << "Error: could not write " << radial_file << endl;
+                success = false;
+            }
+        }
+    }
+
+    return success;
+}
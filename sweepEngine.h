@@ -0,0 +1,81 @@
+//
+//  sweepEngine.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Runs many scene variants within one process.  Every variant is split into chunks of
+// photons and all (variant, chunk) tasks are scheduled on one persistent WorkerPool,
+// so small variants fill the gaps left by large ones and no core sits idle while a
+// single long variant finishes.  Each chunk seeds its RNG from the variant seed and
+// the index of its first photon, so results do not depend on which worker ran it.
+#ifndef SWEEPENGINE_H
+#define SWEEPENGINE_H
+
+#include "scene.h"
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <boost/thread/mutex.hpp>
+
+class WorkerPool;
+class Photon;
+
+
+class SweepEngine
+{
+public:
+    // Photons are handed out to the workers 'chunk_size' at a time.
+    SweepEngine(WorkerPool &pool, const unsigned long chunk_size);
+    ~SweepEngine();
+
+    // Add a variant to the sweep.  Returns the index of the variant.
+    int     addVariant(const std::string &name, const SceneDescription &scene,
+                       const unsigned long num_photons, const uint64_t seed);
+
+    // Compile every variant and propagate all of their photons.  Blocks until done.
+    void    run(void);
+
+    int     getNumVariants(void) const {return (int)variants.size();}
+    const std::string & getName(const int variant) const {return variants[variant].name;}
+
+    // Return the compiled scene of a variant after run(), holding its tallies.
+    Scene * getScene(const int variant) {return variants[variant].scene;}
+
+    // Wall-clock time from the first to the last chunk of a variant.
+    double  getElapsed(const int variant) const
+                {return variants[variant].end_time - variants[variant].start_time;}
+
+    // Write the tallies of every variant to '<prefix>-<name>.txt' (and the pencil-beam
+    // tallies to '<prefix>-<name>-radial.txt').  Returns false if a file failed.
+    bool    writeResults(const std::string &prefix);
+
+private:
+    struct Variant
+    {
+        std::string name;
+        SceneDescription description;
+        Scene *scene;
+        unsigned long num_photons;
+        uint64_t seed;
+        double start_time;
+        double end_time;
+    };
+
+    // Tasks run on the pool.
+    void    compileVariant(const int variant, const int worker);
+    void    runChunk(const int variant, const unsigned long first_photon,
+                     const unsigned long count, const int worker);
+
+    WorkerPool &pool;
+    unsigned long chunk_size;
+    std::vector<Variant> variants;
+
+    // One photon object per worker, reused by every chunk the worker runs.
+    Photon *photons;
+
+    // Serializes updates of the variant timing.
+    boost::mutex m_mutex;
+};
+
+#endif // SWEEPENGINE_H
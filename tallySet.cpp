@@ -0,0 +1,241 @@
+//
+//  tallySet.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "tallySet.h"
+#include "medium.h"
+#include "absorber.h"
+#include "radialTally.h"
+#include <stdint.h>
+#include <fstream>
+#include <sstream>
+#include <boost/scoped_ptr.hpp>
+
+
+
+TallySet::TallySet()
+{
+    num_photons = 0;
+    num_detected = 0;
+    detected_weight = 0;
+    total_steps = 0;
+    batch_size = 0;
+}
+
+
+void TallySet::capture(Medium *medium)
+{
+    boost::mutex::scoped_lock lock(medium->m_sensor_mutex);
+
+    num_photons = medium->num_photons;
+    num_detected = medium->num_detected;
+    detected_weight = medium->detected_weight;
+    total_steps = medium->total_steps;
+    batch_size = medium->batch_size;
+    batch_stats = medium->batch_stats;
+
+    std::vector<Absorber *> absorbers = medium->getAbsorbers();
+    absorber_weights.resize(absorbers.size());
+    for (size_t i = 0; i < absorbers.size(); i++)
+        absorber_weights[i] = absorbers[i]->getAbsorbedWeight();
+
+    if (medium->radial_tally)
+        radial_tally.reset(new RadialTally(*medium->radial_tally));
+    else
+        radial_tally.reset();
+}
+
+
+bool TallySet::restore(Medium *medium) const
+{
+    std::vector<Absorber *> absorbers = medium->getAbsorbers();
+    if (batch_size != medium->batch_size || absorbers.size() != absorber_weights.size() ||
+        batch_stats.getNumBins() != medium->batch_stats.getNumBins() ||
+        (radial_tally != NULL) != (medium->radial_tally != NULL))
+        return false;
+    if (radial_tally && (!radial_tally->sameGrid(*medium->radial_tally) ||
+                         radial_tally->useBatchStatistics() != medium->radial_tally->useBatchStatistics()))
+        return false;
+
+    boost::mutex::scoped_lock lock(medium->m_sensor_mutex);
+    medium->num_photons = num_photons;
+    medium->num_detected = num_detected;
+    medium->detected_weight = detected_weight;
+    medium->total_steps = total_steps;
+    medium->batch_stats = batch_stats;
+    for (size_t i = 0; i < absorbers.size(); i++)
+        absorbers[i]->setAbsorbedWeight(absorber_weights[i]);
+    if (radial_tally)
+        *medium->radial_tally = *radial_tally;
+
+    return true;
+}
+
+
+bool TallySet::merge(const TallySet &other)
+{
+    if (batch_size != other.batch_size || absorber_weights.size() != other.absorber_weights.size() ||
+        batch_stats.getNumBins() != other.batch_stats.getNumBins() ||
+        (radial_tally != NULL) != (other.radial_tally != NULL))
+        return false;
+    if (radial_tally && (!radial_tally->sameGrid(*other.radial_tally) ||
+                         radial_tally->useBatchStatistics() != other.radial_tally->useBatchStatistics()))
+        return false;
+
+    num_photons += other.num_photons;
+    num_detected += other.num_detected;
+    detected_weight += other.detected_weight;
+    total_steps += other.total_steps;
+    if (batch_size > 0)
+        batch_stats.merge(other.batch_stats);
+    for (size_t i = 0; i < absorber_weights.size(); i++)
+        absorber_weights[i] += other.absorber_weights[i];
+    if (radial_tally)
+        radial_tally->merge(*other.radial_tally);
+
+    return true;
+}
+
+
+// Binary layout (native byte order):
+//     uint64 photons, uint64 detected, double detected weight, uint64 steps,
+//     uint64 batch size [, batch statistics], uint32 absorbers, double[] absorbed weights,
+//     uint8 pencil-beam tally flag [, pencil-beam tallies]
+void TallySet::writeBinary(std::ostream &output) const
+{
+    uint64_t photons = num_photons, detected = num_detected, steps = total_steps;
+    uint64_t batches = batch_size;
+    output.write((const char *)&photons, sizeof(photons));
+    output.write((const char *)&detected, sizeof(detected));
+    output.write((const char *)&detected_weight, sizeof(detected_weight));
+    output.write((const char *)&steps, sizeof(steps));
+    output.write((const char *)&batches, sizeof(batches));
+    if (batch_size > 0)
+        batch_stats.writeBinary(output);
+
+    uint32_t num_absorbers = absorber_weights.size();
+    output.write((const char *)&num_absorbers, sizeof(num_absorbers));
+    if (num_absorbers > 0)
+        output.write((const char *)&absorber_weights[0], num_absorbers * sizeof(double));
+
+    uint8_t has_radial = radial_tally != NULL;
+    output.write((const char *)&has_radial, sizeof(has_radial));
+    if (radial_tally)
+        radial_tally->writeBinary(output);
+}
+
+
+bool TallySet::readBinary(std::istream &input)
+{
+    uint64_t photons = 0, detected = 0, steps = 0, batches = 0;
+    input.read((char *)&photons, sizeof(photons));
+    input.read((char *)&detected, sizeof(detected));
+    input.read((char *)&detected_weight, sizeof(detected_weight));
+    input.read((char *)&steps, sizeof(steps));
+    input.read((char *)&batches, sizeof(batches));
+    if (input.fail())
+        return false;
+    num_photons = photons;
+    num_detected = detected;
+    total_steps = steps;
+    batch_size = batches;
+
+    if (batch_size > 0 && !batch_stats.readBinary(input))
+        return false;
+
+    uint32_t num_absorbers = 0;
+    input.read((char *)&num_absorbers, sizeof(num_absorbers));
+    if (input.fail())
+        return false;
+    absorber_weights.resize(num_absorbers);
+    if (num_absorbers > 0)
+        input.read((char *)&absorber_weights[0], num_absorbers * sizeof(double));
+
+    uint8_t has_radial = 0;
+    input.read((char *)&has_radial, sizeof(has_radial));
+    if (input.fail())
+        return false;
+    radial_tally.reset();
+    if (has_radial)
+    {
+        radial_tally.reset(RadialTally::readBinary(input));
+        if (!radial_tally)
+            return false;
+    }
+
+    return !input.fail();
+}
+
+
+double TallySet::getDetectedWeightStdError(void) const
+{
+    return batch_size > 0 ? batch_stats.getStdError(Medium::BATCH_DETECTED_WEIGHT) : 0.0;
+}
+
+
+double TallySet::getAbsorberWeightStdError(void) const
+{
+    return batch_size > 0 ? batch_stats.getStdError(Medium::BATCH_ABSORBER_WEIGHT) : 0.0;
+}
+
+
+double TallySet::getAbsorberWeightStdError(const int absorber) const
+{
+    return batch_size > 0 ? batch_stats.getStdError(Medium::NUM_BATCH_TALLIES + absorber) : 0.0;
+}
+
+
+bool TallySet::writeSummary(const std::string &prefix) const
+{
+    std::string filename = prefix + ".txt";
+    std::ofstream output(filename.c_str());
+    if (!output.is_open())
+        return false;
+
+    double photons = num_photons > 0 ? num_photons : 1;
+    output << "photons\t" << num_photons << "\n";
+    output << "steps/photon\t" << total_steps / photons << "\n";
+    output << "detected photons\t" << num_detected << "\n";
+    output << "detected weight/photon\t" << detected_weight / photons;
+    if (batch_size > 0)
+        output << "\t+/-\t" << batch_stats.getStdError(Medium::BATCH_DETECTED_WEIGHT);
+    output << "\n";
+
+    double absorbed = 0;
+    for (size_t i = 0; i < absorber_weights.size(); i++)
+    {
+        output << "absorber " << i << " weight/photon\t" << absorber_weights[i] / photons;
+        if (batch_size > 0)
+            output << "\t+/-\t" << batch_stats.getStdError(Medium::NUM_BATCH_TALLIES + i);
+        output << "\n";
+        absorbed += absorber_weights[i];
+    }
+    if (absorber_weights.size() > 1 || batch_size > 0)
+    {
+        output << "total absorber weight/photon\t" << absorbed / photons;
+        if (batch_size > 0)
+            output << "\t+/-\t" << batch_stats.getStdError(Medium::BATCH_ABSORBER_WEIGHT);
+        output << "\n";
+    }
+    output.close();
+    if (output.fail())
+        return false;
+
+    if (!radial_tally)
+        return true;
+    if (!radial_tally->write(prefix + "-radial.txt"))
+        return false;
+
+    // The coarser pyramid levels, as '<prefix>-radial-x<factor>.txt'.
+    for (int l = 0; l < radial_tally->getNumPyramidLevels(); l++)
+    {
+        std::ostringstream filename;
+        filename << prefix << "-radial-x" << RadialTally::getLevelFactor(l) << ".txt";
+        boost::scoped_ptr<RadialTally> level(radial_tally->getLevel(l));
+        if (!level->write(filename.str()))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+//
+//  tallySet.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// A copy of the tallies of a medium (photon totals, batch statistics, absorber
+// weights and pencil-beam tallies) detached from the scene.  Used to checkpoint and
+// restore a medium, and to store and merge the partial tallies of sharded runs
+// without compiling the scene.  Exit records are not included.
+#ifndef TALLYSET_H
+#define TALLYSET_H
+
+#include "batchStatistics.h"
+#include <vector>
+#include <string>
+#include <iostream>
+#include <boost/shared_ptr.hpp>
+
+class Medium;
+class RadialTally;
+
+
+class TallySet
+{
+public:
+    TallySet();
+
+    // Copy the tallies of 'medium'.
+    void    capture(Medium *medium);
+
+    // Overwrite the tallies of 'medium', which must be built from the same scene.
+    // Returns false if the tallies do not match the medium.
+    bool    restore(Medium *medium) const;
+
+    // Add the tallies of 'other'.  Returns false, leaving this set unchanged, if the
+    // two were not produced by the same scene.
+    bool    merge(const TallySet &other);
+
+    // Binary form (native byte order).  readBinary() returns false if the stream is
+    // corrupt.
+    void    writeBinary(std::ostream &output) const;
+    bool    readBinary(std::istream &input);
+
+    // Write the normalized tallies with their standard errors as text, and the
+    // pencil-beam tallies (if any) to '<prefix>-radial.txt' and their pyramid levels
+    // to '<prefix>-radial-x<factor>.txt'.
+    bool    writeSummary(const std::string &prefix) const;
+
+    unsigned long   getNumPhotons(void) const {return num_photons;}
+    unsigned long   getNumDetected(void) const {return num_detected;}
+    double          getDetectedWeight(void) const {return detected_weight;}
+    unsigned long   getTotalSteps(void) const {return total_steps;}
+    const std::vector<double> & getAbsorberWeights(void) const {return absorber_weights;}
+
+    // Batch-means standard errors per photon, zero without batch statistics.  The
+    // absorber weight error is of the sum over all absorbers, or of one absorber.
+    double  getDetectedWeightStdError(void) const;
+    double  getAbsorberWeightStdError(void) const;
+    double  getAbsorberWeightStdError(const int absorber) const;
+
+    // The pencil-beam tallies, NULL when the medium has none.
+    const RadialTally * getRadialTally(void) const {return radial_tally.get();}
+
+private:
+    unsigned long num_photons;
+    unsigned long num_detected;
+    double detected_weight;
+    unsigned long total_steps;
+
+    // Batch size of the batch statistics, zero when disabled.
+    unsigned long batch_size;
+    BatchStatistics batch_stats;
+
+    // Weight absorbed in every absorber of the medium, top layer first.
+    std::vector<double> absorber_weights;
+
+    // Pencil-beam tallies, empty when the medium has none.
+    boost::shared_ptr<RadialTally> radial_tally;
+};
+
+#endif // TALLYSET_H
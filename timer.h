@@ -0,0 +1,23 @@
+//
+//  timer.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <sys/time.h>
+#include <cstddef>
+
+
+// Returns the wall-clock time in seconds.  Unlike clock(), which sums the CPU time
+// of all threads, this measures elapsed time.
+inline double getWallTime(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+#endif // TIMER_H
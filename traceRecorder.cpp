@@ -0,0 +1,153 @@
+//
+//  traceRecorder.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "traceRecorder.h"
+#include <time.h>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+TraceRecorder * TraceRecorder::pInstance = NULL;
+bool TraceRecorder::enabled = false;
+
+// Events reserved per thread up front, so the buffers rarely grow during a run.
+static const size_t INITIAL_EVENTS = 4096;
+
+
+static void writeTraceAtExit(void)
+{
+    TraceRecorder::getInstance()->write();
+}
+
+
+
+TraceRecorder * TraceRecorder::getInstance(void)
+{
+    if (!pInstance)
+        pInstance = new TraceRecorder();
+    return pInstance;
+}
+
+
+TraceRecorder::TraceRecorder()
+: local_buffer(keepBuffer)
+{
+    start_time = now();
+}
+
+
+void TraceRecorder::enable(const std::string &filename)
+{
+    this->filename = filename;
+    start_time = now();
+    if (!enabled)
+        atexit(writeTraceAtExit);
+    enabled = true;
+    setThreadName("main");
+}
+
+
+uint64_t TraceRecorder::now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+TraceRecorder::Buffer * TraceRecorder::getBuffer(void)
+{
+    Buffer *buffer = local_buffer.get();
+    if (!buffer)
+    {
+        buffer = new Buffer;
+        buffer->events.reserve(INITIAL_EVENTS);
+        boost::mutex::scoped_lock lock(m_mutex);
+        buffer->thread = buffers.size();
+        buffers.push_back(buffer);
+        local_buffer.reset(buffer);
+    }
+    return buffer;
+}
+
+
+void TraceRecorder::setThreadName(const std::string &name)
+{
+    if (enabled)
+        getBuffer()->name = name;
+}
+
+
+void TraceRecorder::record(const Span span, const uint64_t start, const uint64_t end)
+{
+    Event event;
+    event.start = start;
+    event.end = end;
+    event.span = span;
+    getBuffer()->events.push_back(event);
+}
+
+
+const char * TraceRecorder::getSpanName(const Span span)
+{
+    static const char *names[NUM_SPANS] = {"inject photons", "chunk", "tally merge",
+                                           "logger write", "checkpoint", "live snapshot",
+                                           "idle", "wait", "join"};
+    return names[span];
+}
+
+
+bool TraceRecorder::write(void)
+{
+    std::ofstream output(filename.c_str());
+    if (!output.is_open())
+    {
+        cout << "Error: could not write trace " << filename << endl;
+        return false;
+    }
+
+    // Complete events ("X") with times in microseconds, and a metadata event ("M")
+    // naming every thread.
+    boost::mutex::scoped_lock lock(m_mutex);
+    output << std::fixed << std::setprecision(3);
+    output << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        const Buffer &buffer = *buffers[i];
+        output << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+               << buffer.thread << ",\"args\":{\"name\":\"";
+        if (buffer.name.empty())
+            output << "thread " << buffer.thread;
+        else
+            output << buffer.name;
+        output << "\"}}";
+        first = false;
+
+        for (size_t j = 0; j < buffer.events.size(); j++)
+        {
+            const Event &event = buffer.events[j];
+            if (event.start < start_time)
+                continue;
+            output << ",\n{\"name\":\"" << getSpanName((Span)event.span) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                   << buffer.thread << ",\"ts\":" << (event.start - start_time) / 1000.0
+                   << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+        }
+    }
+    output << "\n]}\n";
+    output.close();
+
+    if (output.fail())
+    {
+        cout << "Error: could not write trace " << filename << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+//
+//  traceRecorder.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// Timeline of what every thread is doing, for finding load imbalance at the end of a
+// run and stalls on I/O.  Spans are appended as small binary records to a buffer of
+// their own thread, so recording takes no lock, and the buffers are converted to the
+// Chrome trace event format (chrome://tracing, ui.perfetto.dev) when the program exits.
+//
+// Recording is off unless enable() is called; a TraceScope then costs one branch.
+// Like the Logger, the recorder is a singleton that must be created in main before any
+// threads are spawned.
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+
+class TraceRecorder
+{
+public:
+    enum Span
+    {
+        INJECT_PHOTONS,     // Photon::injectPhoton(), i.e. a thread of runMonteCarlo
+        CHUNK,              // a chunk of photons run on a worker pool
+        TALLY_MERGE,        // adding the tallies of a thread to the medium
+        LOGGER_WRITE,       // writing (and flushing) data files through the Logger
+        CHECKPOINT,
+        LIVE_SNAPSHOT,
+        IDLE,               // a worker waiting for a task
+        WAIT,               // waiting for the worker pool to finish its tasks
+        JOIN,               // joining the threads of runMonteCarlo
+        NUM_SPANS
+    };
+
+    static TraceRecorder * getInstance(void);
+
+    // Start recording, and write the trace to 'filename' when the program exits.
+    void    enable(const std::string &filename);
+    static bool isEnabled(void) {return enabled;}
+
+    // Name the calling thread in the trace, e.g. "worker 3".
+    void    setThreadName(const std::string &name);
+
+    // Nanoseconds since an arbitrary point in time.
+    static uint64_t now(void);
+
+    // Add a span of the calling thread.
+    void    record(const Span span, const uint64_t start, const uint64_t end);
+
+    // Write the spans recorded so far in the Chrome trace event format.
+    bool    write(void);
+
+    static const char * getSpanName(const Span span);
+
+private:
+    TraceRecorder();
+    ~TraceRecorder() {}
+    TraceRecorder(TraceRecorder const &);
+    TraceRecorder & operator=(TraceRecorder const &);
+
+    struct Event
+    {
+        uint64_t start, end;
+        uint32_t span;
+    };
+
+    struct Buffer
+    {
+        int thread;
+        std::string name;
+        std::vector<Event> events;
+    };
+
+    // Return the buffer of the calling thread, creating it on first use.
+    Buffer *    getBuffer(void);
+
+    // Buffers are owned by the recorder, not by their thread.
+    static void keepBuffer(Buffer *) {}
+
+    static TraceRecorder *pInstance;
+    static bool enabled;
+
+    std::string filename;
+    uint64_t start_time;
+
+    // Buffers of all threads, which outlive the threads themselves.
+    std::vector<Buffer *> buffers;
+    boost::thread_specific_ptr<Buffer> local_buffer;
+    boost::mutex m_mutex;
+};
+
+
+// Records a span from construction to destruction when tracing is enabled.
+class TraceScope
+{
+public:
+    TraceScope(const TraceRecorder::Span span)
+    : span(span), start(TraceRecorder::isEnabled() ? TraceRecorder::now() : 0) {}
+
+    ~TraceScope()
+    {
+        if (start)
+            TraceRecorder::getInstance()->record(span, start, TraceRecorder::now());
+    }
+
+private:
+    TraceRecorder::Span span;
+    uint64_t start;
+};
+
+#endif // TRACERECORDER_H
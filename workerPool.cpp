@@ -0,0 +1,152 @@
+//
+//  workerPool.cpp
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+#include "workerPool.h"
+#include "traceRecorder.h"
+#include "lockWait.h"
+#include "cpuTopology.h"
+#include "timer.h"
+#include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+
+
+
+WorkerPool::WorkerPool(const int num_threads)
+{
+    this->num_threads = num_threads > 0 ? num_threads : boost::thread::hardware_concurrency();
+    if (this->num_threads <= 0)
+        this->num_threads = 1;
+    start();
+}
+
+
+WorkerPool::WorkerPool(const std::vector<int> &cpus)
+: cpus(cpus)
+{
+    num_threads = cpus.size();
+    if (num_threads <= 0)
+    {
+        num_threads = 1;
+        this->cpus.clear();
+    }
+    start();
+}
+
+
+void WorkerPool::start(void)
+{
+    num_running = 0;
+    shutting_down = false;
+    stats.resize(this->num_threads);
+    resetStats();
+
+    for (int i = 0; i < this->num_threads; i++)
+    {
+        threads.create_thread(boost::bind(&WorkerPool::workerLoop, this, i));
+    }
+}
+
+
+WorkerPool::~WorkerPool()
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        shutting_down = true;
+    }
+    task_available.notify_all();
+    threads.join_all();
+}
+
+
+void WorkerPool::submit(const Task &task)
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        tasks.push_back(task);
+    }
+    task_available.notify_one();
+}
+
+
+void WorkerPool::wait(void)
+{
+    TraceScope trace(TraceRecorder::WAIT);
+    boost::mutex::scoped_lock lock(m_mutex);
+    while (!tasks.empty() || num_running > 0)
+    {
+        tasks_done.wait(lock);
+    }
+}
+
+
+WorkerPool::WorkerStats WorkerPool::getWorkerStats(const int worker)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    return stats[worker];
+}
+
+
+void WorkerPool::resetStats(void)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    for (size_t i = 0; i < stats.size(); i++)
+    {
+        stats[i].busy = 0;
+        stats[i].lock_wait = 0;
+        stats[i].tasks = 0;
+    }
+}
+
+
+void WorkerPool::workerLoop(const int worker)
+{
+    TraceRecorder::getInstance()->setThreadName("worker " + boost::lexical_cast<std::string>(worker));
+
+    // Bind before the first task, so everything the worker allocates is placed on
+    // the memory of its own node.
+    if (!cpus.empty() && !CpuTopology::pinCurrentThread(cpus[worker]))
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        std::cout << "Warning: could not bind worker " << worker << " to CPU " << cpus[worker] << std::endl;
+    }
+    while (true)
+    {
+        Task task;
+        {
+            TraceScope idle(TraceRecorder::IDLE);
+            boost::mutex::scoped_lock lock(m_mutex);
+            while (tasks.empty() && !shutting_down)
+            {
+                task_available.wait(lock);
+            }
+
+            // Pending tasks are finished before the pool shuts down.
+            if (tasks.empty())
+                return;
+
+            task = tasks.front();
+            tasks.pop_front();
+            num_running++;
+        }
+
+        double start = getWallTime();
+        double lock_wait = LockWait::getThreadTotal();
+        task(worker);
+        double busy = getWallTime() - start;
+        lock_wait = LockWait::getThreadTotal() - lock_wait;
+
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            stats[worker].busy += busy;
+            stats[worker].lock_wait += lock_wait;
+            stats[worker].tasks++;
+            num_running--;
+            if (tasks.empty() && num_running == 0)
+                tasks_done.notify_all();
+        }
+    }
+}
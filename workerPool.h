@@ -0,0 +1,83 @@
+//
+//  workerPool.h
+//
+//  Copyright 2011 BMPI. All rights reserved.
+//
+
+// A fixed set of worker threads that stay alive between runs.  Tasks are handed to
+// the first idle worker, which passes its index to the task so callers can keep
+// per-worker state (e.g. a Photon object or a compiled Medium) without locking.
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+class WorkerPool
+{
+public:
+    // The task is called with the index of the worker executing it (0 <= worker < num_threads).
+    typedef boost::function<void (const int worker)> Task;
+
+    // Create a pool of 'num_threads' workers.  A value <= 0 uses one worker per core.
+    WorkerPool(const int num_threads);
+
+    // Create one worker per entry of 'cpus', each bound to that logical CPU (see
+    // cpuTopology.h).
+    WorkerPool(const std::vector<int> &cpus);
+    ~WorkerPool();
+
+    // Queue a task for execution.
+    void    submit(const Task &task);
+
+    // Block until every submitted task has finished.
+    void    wait(void);
+
+    int     getNumThreads(void) const {return num_threads;}
+
+    // Logical CPU worker 'worker' is bound to, or -1 if it is not bound.
+    int     getWorkerCpu(const int worker) const {return cpus.empty() ? -1 : cpus[worker];}
+
+    // Time a worker spent running tasks, and the part of it spent waiting for contended
+    // locks (see lockWait.h), since the pool was created or resetStats() was called.
+    // The rest of the wall-clock time the worker was idle.
+    struct WorkerStats
+    {
+        double busy, lock_wait;     // [s]
+        unsigned long tasks;
+    };
+    WorkerStats getWorkerStats(const int worker);
+    void    resetStats(void);
+
+private:
+    // Start the workers.
+    void    start(void);
+
+    // Main loop of each worker thread.
+    void    workerLoop(const int worker);
+
+    int     num_threads;
+
+    // CPU of every worker, empty when they are not bound.
+    std::vector<int> cpus;
+    boost::thread_group threads;
+
+    // Pending tasks, and the number of tasks currently executing.
+    std::deque<Task> tasks;
+    int     num_running;
+    bool    shutting_down;
+
+    // Per worker statistics, guarded by 'm_mutex'.
+    std::vector<WorkerStats> stats;
+
+    boost::mutex m_mutex;
+    boost::condition_variable task_available;
+    boost::condition_variable tasks_done;
+};
+
+#endif // WORKERPOOL_H